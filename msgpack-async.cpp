@@ -0,0 +1,257 @@
+// (c) 2025 Mika Pi
+
+#include "msgpack-async.hpp"
+#include <array>
+#include <cerrno>
+#include <cstring>
+#include <fcntl.h>
+#include <stdexcept>
+#include <sys/epoll.h>
+#include <system_error>
+#include <unistd.h>
+
+namespace msgpack
+{
+  namespace
+  {
+    // Free space made available in the read buffer before each read.
+    constexpr auto MinRead = size_t{64 * 1024};
+
+    auto throwErrno(const char *what) -> void
+    {
+      throw std::system_error{errno, std::generic_category(), what};
+    }
+  } // namespace
+
+  auto Task::promise_type::get_return_object() -> Task
+  {
+    return Task{std::coroutine_handle<promise_type>::from_promise(*this)};
+  }
+
+  auto Task::promise_type::initial_suspend() noexcept -> std::suspend_always
+  {
+    return {};
+  }
+
+  auto Task::promise_type::return_void() -> void {}
+
+  auto Task::promise_type::unhandled_exception() -> void
+  {
+    error = std::current_exception();
+  }
+
+  Task::Task(std::coroutine_handle<promise_type> aH) : h(aH) {}
+
+  Task::Task(Task &&o) : h(std::exchange(o.h, {})) {}
+
+  Task::~Task()
+  {
+    if (h)
+      h.destroy();
+  }
+
+  EventLoop::EventLoop() : epfd(epoll_create1(EPOLL_CLOEXEC))
+  {
+    if (epfd < 0)
+      throwErrno("epoll_create1");
+  }
+
+  EventLoop::~EventLoop()
+  {
+    for (auto p : live)
+      std::coroutine_handle<>::from_address(p).destroy();
+    close(epfd);
+  }
+
+  auto EventLoop::spawn(Task t) -> void
+  {
+    t.h.promise().loop = this;
+    live.insert(t.h.address());
+    ready.push_back(std::exchange(t.h, {}));
+  }
+
+  auto EventLoop::run() -> void
+  {
+    auto events = std::array<epoll_event, 256>{};
+    while (!live.empty())
+    {
+      while (!ready.empty())
+      {
+        std::swap(running, ready);
+        for (auto h : running)
+          h.resume();
+        running.clear();
+
+        auto error = std::exception_ptr{};
+        for (auto h : done)
+        {
+          if (!error)
+            error = h.promise().error;
+          live.erase(h.address());
+          h.destroy();
+        }
+        done.clear();
+        if (error)
+          std::rethrow_exception(error);
+      }
+      if (live.empty())
+        break;
+      if (watching == 0)
+        throw std::logic_error{"EventLoop: tasks are suspended but nothing is being watched"};
+
+      const auto n = epoll_wait(epfd, events.data(), static_cast<int>(events.size()), -1);
+      if (n < 0)
+      {
+        if (errno == EINTR)
+          continue;
+        throwErrno("epoll_wait");
+      }
+      for (auto i = 0; i < n; ++i)
+      {
+        --watching;
+        static_cast<Waiter *>(events[static_cast<size_t>(i)].data.ptr)->onReady();
+      }
+    }
+  }
+
+  auto EventLoop::watch(int fd, Waiter &w, bool added) -> void
+  {
+    auto ev = epoll_event{};
+    ev.events = EPOLLIN | EPOLLRDHUP | EPOLLONESHOT;
+    ev.data.ptr = &w;
+    if (epoll_ctl(epfd, added ? EPOLL_CTL_MOD : EPOLL_CTL_ADD, fd, &ev) < 0)
+      throwErrno("epoll_ctl");
+    ++watching;
+  }
+
+  auto EventLoop::unwatch(int fd, bool armed) -> void
+  {
+    epoll_ctl(epfd, EPOLL_CTL_DEL, fd, nullptr);
+    if (armed)
+      --watching;
+  }
+
+  auto EventLoop::schedule(std::coroutine_handle<> h) -> void
+  {
+    ready.push_back(h);
+  }
+
+  auto EventLoop::finished(std::coroutine_handle<Task::promise_type> h) -> void
+  {
+    done.push_back(h);
+  }
+
+  AsyncReader::AsyncReader(EventLoop &aLoop, int aFd) : loop(aLoop), fd(aFd)
+  {
+    const auto flags = fcntl(fd, F_GETFL);
+    if (flags < 0 || fcntl(fd, F_SETFL, flags | O_NONBLOCK) < 0)
+      throwErrno("fcntl");
+  }
+
+  AsyncReader::~AsyncReader()
+  {
+    if (added)
+      loop.unwatch(fd, static_cast<bool>(waiting));
+  }
+
+  auto AsyncReader::val() const -> const Val &
+  {
+    if (!blob)
+      throw std::logic_error{"AsyncReader: no message has been read"};
+    return blob->val;
+  }
+
+  auto AsyncReader::poll() -> bool
+  {
+    for (;;)
+    {
+      if (frame > 0 || error)
+        return true;
+      if (end > begin)
+      {
+        // resumes where the last read ran out, so a large message is scanned once
+        try
+        {
+          frame = objectSize(std::span{buf}.subspan(begin, end - begin), scan);
+        }
+        catch (const ParsingError &)
+        {
+          error = std::current_exception();
+          return true;
+        }
+        if (frame > 0)
+          return true;
+      }
+      if (eof)
+        return true;
+
+      if (buf.size() - end < MinRead)
+      {
+        if (begin > 0)
+        {
+          std::memmove(buf.data(), buf.data() + begin, end - begin);
+          end -= begin;
+          begin = 0;
+        }
+        if (buf.size() - end < MinRead)
+          buf.resize(std::max(2 * buf.size(), end + MinRead));
+      }
+      const auto n = read(fd, buf.data() + end, buf.size() - end);
+      if (n > 0)
+        end += static_cast<size_t>(n);
+      else if (n == 0)
+        eof = true;
+      else if (errno == EAGAIN || errno == EWOULDBLOCK)
+        return false;
+      else if (errno != EINTR)
+        throwErrno("read");
+    }
+  }
+
+  auto AsyncReader::suspend(std::coroutine_handle<> h) -> void
+  {
+    waiting = h;
+    loop.watch(fd, *this, added);
+    added = true;
+  }
+
+  auto AsyncReader::onReady() -> void
+  {
+    try
+    {
+      if (!poll())
+      {
+        loop.watch(fd, *this, true);
+        return;
+      }
+    }
+    catch (...)
+    {
+      error = std::current_exception();
+    }
+    loop.schedule(std::exchange(waiting, {}));
+  }
+
+  auto AsyncReader::take() -> bool
+  {
+    if (error)
+      std::rethrow_exception(std::exchange(error, {}));
+    if (frame == 0)
+    {
+      if (end > begin)
+        throw ParsingError("Unexpected EOF");
+      return false;
+    }
+    const auto msg = std::span<const std::byte>{buf}.subspan(begin, frame);
+    begin += frame;
+    frame = 0;
+    scan = {};
+    if (begin == end)
+      begin = end = 0;
+    if (blob)
+      blob->assign(msg);
+    else
+      blob.emplace(msg);
+    return true;
+  }
+} // namespace msgpack
@@ -0,0 +1,176 @@
+// (c) 2025 Mika Pi
+
+#pragma once
+#include "msgpack-ser.hpp"
+#include "msgpack.hpp"
+#include <coroutine>
+#include <cstddef>
+#include <exception>
+#include <optional>
+#include <span>
+#include <unordered_set>
+#include <vector>
+
+namespace msgpack
+{
+  class EventLoop;
+
+  // Coroutine spawned on an EventLoop, e.g. one per connection:
+  //   auto serve(msgpack::AsyncReader &r) -> msgpack::Task
+  //   {
+  //     auto req = Request{};
+  //     while (co_await r.next(req))
+  //       handle(req);
+  //   }
+  class Task
+  {
+  public:
+    struct promise_type
+    {
+      auto get_return_object() -> Task;
+      auto initial_suspend() noexcept -> std::suspend_always;
+      auto final_suspend() noexcept;
+      auto return_void() -> void;
+      auto unhandled_exception() -> void;
+
+      EventLoop *loop = nullptr;
+      std::exception_ptr error;
+    };
+
+    Task(Task &&);
+    auto operator=(Task &&) -> Task & = delete;
+    Task(const Task &) = delete;
+    ~Task();
+
+  private:
+    friend class EventLoop;
+    explicit Task(std::coroutine_handle<promise_type>);
+    std::coroutine_handle<promise_type> h;
+  };
+
+  // Single-threaded epoll loop resuming tasks when their fds become readable.
+  class EventLoop
+  {
+  public:
+    // Notified once when the fd it is waiting on becomes readable or hung up.
+    class Waiter
+    {
+    public:
+      virtual auto onReady() -> void = 0;
+
+    protected:
+      ~Waiter() = default;
+    };
+
+    EventLoop();
+    ~EventLoop();
+    EventLoop(const EventLoop &) = delete;
+    auto operator=(const EventLoop &) -> EventLoop & = delete;
+
+    // Starts t on the next run().
+    auto spawn(Task t) -> void;
+    // Runs until all spawned tasks have finished. An exception escaping a task is rethrown
+    // here once that task has been destroyed.
+    auto run() -> void;
+
+    // Notifies w once when fd becomes readable; added tells whether fd is already registered.
+    auto watch(int fd, Waiter &w, bool added) -> void;
+    // Deregisters fd; armed tells whether a watch on it is still pending.
+    auto unwatch(int fd, bool armed) -> void;
+    auto schedule(std::coroutine_handle<>) -> void;
+
+  private:
+    friend struct Task::promise_type;
+    auto finished(std::coroutine_handle<Task::promise_type>) -> void;
+
+    int epfd;
+    size_t watching = 0;
+    std::unordered_set<void *> live; // frame addresses of spawned tasks
+    std::vector<std::coroutine_handle<>> ready;
+    std::vector<std::coroutine_handle<>> running;
+    std::vector<std::coroutine_handle<Task::promise_type>> done;
+  };
+
+  // Reads a stream of msgpack objects from a non-blocking fd on an EventLoop. Objects are framed
+  // incrementally as bytes arrive and parsed in place; the read buffer and the parsed Val are
+  // reused between messages. The fd stays owned by the caller and must outlive the reader.
+  class AsyncReader final : private EventLoop::Waiter
+  {
+  public:
+    AsyncReader(EventLoop &, int fd);
+    ~AsyncReader();
+    AsyncReader(const AsyncReader &) = delete;
+    auto operator=(const AsyncReader &) -> AsyncReader & = delete;
+
+    // co_await next() yields false at the end of the stream, true when val() holds the next
+    // message. The Val, and strings borrowed from it, are valid until the next call. Throws
+    // ParsingError if the stream ends inside a message or holds an unknown type byte.
+    auto next();
+    // Like next(), decoding the message into v.
+    template <typename T>
+    auto next(T &v);
+    auto val() const -> const Val &;
+
+  private:
+    template <typename T>
+    struct Awaiter
+    {
+      auto await_ready() -> bool { return r.poll(); }
+      auto await_suspend(std::coroutine_handle<> h) -> void { r.suspend(h); }
+      auto await_resume() -> bool
+      {
+        if (!r.take())
+          return false;
+        if constexpr (!std::is_same_v<T, void>)
+          msgpackDeser(r.val(), *v);
+        return true;
+      }
+      AsyncReader &r;
+      T *v;
+    };
+
+    auto onReady() -> void final;
+    // Reads what is available; true once a message is framed or the stream has ended.
+    auto poll() -> bool;
+    auto suspend(std::coroutine_handle<>) -> void;
+    auto take() -> bool;
+
+    EventLoop &loop;
+    int fd;
+    bool added = false;
+    bool eof = false;
+    std::exception_ptr error;
+    std::coroutine_handle<> waiting;
+    std::vector<std::byte> buf;
+    size_t begin = 0;
+    size_t end = 0;
+    size_t frame = 0;
+    ObjectScan scan; // progress framing the message at begin
+    std::optional<Blob> blob;
+  };
+
+  inline auto Task::promise_type::final_suspend() noexcept
+  {
+    struct Final
+    {
+      auto await_ready() noexcept -> bool { return false; }
+      auto await_suspend(std::coroutine_handle<promise_type> h) noexcept -> void
+      {
+        h.promise().loop->finished(h);
+      }
+      auto await_resume() noexcept -> void {}
+    };
+    return Final{};
+  }
+
+  inline auto AsyncReader::next()
+  {
+    return Awaiter<void>{*this, nullptr};
+  }
+
+  template <typename T>
+  auto AsyncReader::next(T &v)
+  {
+    return Awaiter<T>{*this, &v};
+  }
+} // namespace msgpack
@@ -0,0 +1,517 @@
+// (c) 2025 Mika Pi
+
+#include "msgpack-diff.hpp"
+#include "msgpack-ser.hpp"
+#include <algorithm>
+#include <cstring>
+#include <optional>
+#include <sstream>
+#include <string_view>
+#include <unordered_map>
+#include <vector>
+
+namespace
+{
+  using Bytes = std::span<const std::byte>;
+
+  enum Op : uint8_t
+  {
+    Set = 0,
+    Delete = 1,
+    Splice = 2
+  };
+
+  template <typename U>
+  auto readBe(Bytes in, size_t at) -> U
+  {
+    if (in.size() < at + sizeof(U))
+      throw msgpack::ParsingError("Unexpected EOF");
+    auto r = U{};
+    for (size_t i = 0; i < sizeof(U); ++i)
+      r = static_cast<U>(r << 8 | static_cast<uint8_t>(in[at + i]));
+    return r;
+  }
+
+  struct Container
+  {
+    bool map;
+    uint64_t n;
+    size_t head; // bytes of the type byte and count
+  };
+
+  // Header of the array or map at the start of in, nullopt for other types.
+  auto container(Bytes in) -> std::optional<Container>
+  {
+    if (in.empty())
+      throw msgpack::ParsingError("Unexpected EOF");
+    const auto b = static_cast<uint8_t>(in[0]);
+    if ((b & 0xf0) == 0x90)
+      return Container{false, b & 0x0fu, 1};
+    if ((b & 0xf0) == 0x80)
+      return Container{true, b & 0x0fu, 1};
+    switch (b)
+    {
+    case 0xdc:
+      return Container{false, readBe<uint16_t>(in, 1), 3};
+    case 0xdd:
+      return Container{false, readBe<uint32_t>(in, 1), 5};
+    case 0xde:
+      return Container{true, readBe<uint16_t>(in, 1), 3};
+    case 0xdf:
+      return Container{true, readBe<uint32_t>(in, 1), 5};
+    default:
+      return std::nullopt;
+    }
+  }
+
+  // Bytes of each item of a container: the elements of an array, the keys and values of a map.
+  auto items(Bytes in, const Container &c) -> std::vector<Bytes>
+  {
+    const auto n = c.map ? 2 * c.n : c.n;
+    auto r = std::vector<Bytes>{};
+    r.reserve(static_cast<size_t>(std::min<uint64_t>(n, in.size())));
+    auto rest = in.subspan(c.head);
+    for (uint64_t i = 0; i < n; ++i)
+    {
+      const auto next = msgpack::skip(rest);
+      r.push_back(rest.first(rest.size() - next.size()));
+      rest = next;
+    }
+    return r;
+  }
+
+  auto same(Bytes a, Bytes b) -> bool
+  {
+    return a.size() == b.size() && (a.empty() || std::memcmp(a.data(), b.data(), a.size()) == 0);
+  }
+
+  auto view(Bytes b) -> std::string_view
+  {
+    return {reinterpret_cast<const char *>(b.data()), b.size()};
+  }
+
+  auto write(std::ostream &st, Bytes b) -> void
+  {
+    st.write(reinterpret_cast<const char *>(b.data()), static_cast<std::streamsize>(b.size()));
+  }
+
+  auto write(std::ostream &st, std::string_view s) -> void
+  {
+    st.write(s.data(), static_cast<std::streamsize>(s.size()));
+  }
+
+  class Differ
+  {
+  public:
+    // Writes the operations turning a into b; returns their number.
+    auto diff(Bytes a, Bytes b, std::ostream &st) -> size_t
+    {
+      if (same(a, b))
+        return 0;
+      const auto ca = container(a);
+      const auto cb = container(b);
+      if (ca && cb && ca->map == cb->map)
+      {
+        auto sub = std::ostringstream{};
+        const auto n = ca->map ? diffMap(a, *ca, b, *cb, sub) : diffArray(a, *ca, b, *cb, sub);
+        // setting the whole container is smaller than its changes
+        if (sub.view().size() < b.size())
+        {
+          write(st, sub.view());
+          return n;
+        }
+      }
+      set(b, st);
+      return 1;
+    }
+
+  private:
+    // A map key, or an array index if key is empty.
+    struct Step
+    {
+      Bytes key;
+      uint64_t index;
+    };
+
+    auto diffMap(Bytes a, const Container &ca, Bytes b, const Container &cb, std::ostream &st)
+      -> size_t
+    {
+      const auto ia = items(a, ca);
+      const auto ib = items(b, cb);
+      auto keys = std::unordered_map<std::string_view, size_t>{};
+      keys.reserve(ib.size() / 2);
+      for (size_t j = 0; j < ib.size(); j += 2)
+        keys.emplace(view(ib[j]), j);
+      auto matched = std::vector<bool>(ib.size() / 2);
+      auto n = size_t{0};
+      for (size_t i = 0; i < ia.size(); i += 2)
+      {
+        path.push_back(Step{ia[i], 0});
+        if (const auto it = keys.find(view(ia[i])); it != keys.end())
+        {
+          matched[it->second / 2] = true;
+          n += diff(ia[i + 1], ib[it->second + 1], st);
+        }
+        else
+        {
+          head(st, Delete, 2);
+          ++n;
+        }
+        path.pop_back();
+      }
+      for (size_t j = 0; j < ib.size(); j += 2)
+        if (!matched[j / 2])
+        {
+          path.push_back(Step{ib[j], 0});
+          set(ib[j + 1], st);
+          path.pop_back();
+          ++n;
+        }
+      return n;
+    }
+
+    // Finds the runs of elements to change with an edit script over the elements' bytes, diffs
+    // the elements replaced one for one and splices in or out the rest. Runs are written from
+    // the last to the first so that the indices of the old array stay valid.
+    auto diffArray(Bytes a, const Container &ca, Bytes b, const Container &cb, std::ostream &st)
+      -> size_t
+    {
+      const auto ia = items(a, ca);
+      const auto ib = items(b, cb);
+      const auto runs = changes(ia, ib);
+      auto n = size_t{0};
+      for (auto r = runs.rbegin(); r != runs.rend(); ++r)
+      {
+        const auto paired = std::min(r->aSize, r->bSize);
+        for (auto i = size_t{0}; i < paired; ++i)
+        {
+          path.push_back(Step{{}, r->a + i});
+          n += diff(ia[r->a + i], ib[r->b + i], st);
+          path.pop_back();
+        }
+        if (r->aSize == r->bSize)
+          continue;
+        head(st, Splice, 5);
+        msgpackSer(st, r->a + paired);
+        msgpackSer(st, r->aSize - paired);
+        InternalMsgPack::msgpackSerArrayHeader(st, r->bSize - paired);
+        for (auto i = r->b + paired; i < r->b + r->bSize; ++i)
+          write(st, ib[i]);
+        ++n;
+      }
+      return n;
+    }
+
+    // Elements [a, a + aSize) of the old array replaced by [b, b + bSize) of the new one.
+    struct Run
+    {
+      size_t a;
+      size_t aSize;
+      size_t b;
+      size_t bSize;
+    };
+
+    // Shortest edit script between the arrays (Myers' algorithm) as runs of changed elements,
+    // in order. Past MaxEdits edits, everything between the common prefix and suffix is one
+    // run.
+    static auto changes(const std::vector<Bytes> &ia, const std::vector<Bytes> &ib)
+      -> std::vector<Run>
+    {
+      static constexpr auto MaxEdits = 512L;
+      const auto common = std::min(ia.size(), ib.size());
+      auto pre = size_t{0};
+      while (pre < common && same(ia[pre], ib[pre]))
+        ++pre;
+      auto suf = size_t{0};
+      while (suf < common - pre && same(ia[ia.size() - 1 - suf], ib[ib.size() - 1 - suf]))
+        ++suf;
+      const auto n = static_cast<long>(ia.size() - pre - suf);
+      const auto m = static_cast<long>(ib.size() - pre - suf);
+      if (n == 0 && m == 0)
+        return {};
+      const auto whole = std::vector<Run>{
+        {pre, static_cast<size_t>(n), pre, static_cast<size_t>(m)}};
+      if (n == 0 || m == 0)
+        return whole;
+
+      const auto eq = [&](long x, long y) {
+        return same(ia[pre + static_cast<size_t>(x)], ib[pre + static_cast<size_t>(y)]);
+      };
+      // trace[d][k + d]: furthest x on diagonal k = x - y after d edits
+      auto trace = std::vector<std::vector<long>>{};
+      auto d = 0L;
+      for (;; ++d)
+      {
+        if (d > MaxEdits)
+          return whole;
+        auto v = std::vector<long>(static_cast<size_t>(2 * d + 1));
+        auto done = false;
+        for (auto k = -d; k <= d && !done; k += 2)
+        {
+          auto x = 0L;
+          if (d > 0)
+          {
+            const auto &p = trace.back();
+            const auto at = [&](long kk) { return p[static_cast<size_t>(kk + d - 1)]; };
+            x = k == -d || (k != d && at(k - 1) < at(k + 1)) ? at(k + 1) : at(k - 1) + 1;
+          }
+          auto y = x - k;
+          while (x < n && y < m && eq(x, y))
+            ++x, ++y;
+          v[static_cast<size_t>(k + d)] = x;
+          done = x >= n && y >= m;
+        }
+        trace.push_back(std::move(v));
+        if (done)
+          break;
+      }
+
+      // walk back from the end, merging edits not separated by equal elements into runs
+      auto runs = std::vector<Run>{};
+      auto x = n;
+      auto y = m;
+      for (; d > 0; --d)
+      {
+        const auto k = x - y;
+        const auto &p = trace[static_cast<size_t>(d - 1)];
+        const auto at = [&](long kk) { return p[static_cast<size_t>(kk + d - 1)]; };
+        const auto down = k == -d || (k != d && at(k - 1) < at(k + 1));
+        const auto px = down ? at(k + 1) : at(k - 1);
+        const auto py = px - (down ? k + 1 : k - 1);
+        // the edit goes from (px, py) to (sx, sy), then equal elements to (x, y)
+        const auto sx = down ? px : px + 1;
+        const auto sy = down ? py + 1 : py;
+        if (runs.empty() || sx != x || sy != y)
+          runs.push_back(Run{static_cast<size_t>(px), 0, static_cast<size_t>(py), 0});
+        auto &r = runs.back();
+        r.a = static_cast<size_t>(px);
+        r.b = static_cast<size_t>(py);
+        (down ? r.bSize : r.aSize) += 1;
+        x = px;
+        y = py;
+      }
+      std::reverse(runs.begin(), runs.end());
+      for (auto &r : runs)
+      {
+        r.a += pre;
+        r.b += pre;
+      }
+      return runs;
+    }
+
+    auto set(Bytes value, std::ostream &st) -> void
+    {
+      head(st, Set, 3);
+      write(st, value);
+    }
+
+    // Writes the start of an operation of `size` fields: the op and the current path.
+    auto head(std::ostream &st, Op op, size_t size) -> void
+    {
+      InternalMsgPack::msgpackSerArrayHeader(st, size);
+      msgpackSer(st, static_cast<int>(op));
+      InternalMsgPack::msgpackSerArrayHeader(st, path.size());
+      for (const auto &s : path)
+        if (s.key.empty())
+          msgpackSer(st, s.index);
+        else
+          write(st, s.key);
+    }
+
+    std::vector<Step> path;
+  };
+
+  // Part of the patched message. Until a patch goes through it, a node is the bytes of the
+  // original value or of a value from the patch.
+  struct Node
+  {
+    explicit Node(Bytes aRaw) : raw(aRaw) {}
+
+    Bytes raw;
+    bool expanded = false;
+    bool map = false;
+    std::vector<Node> items; // as in items()
+  };
+
+  auto expand(Node &n) -> void
+  {
+    if (n.expanded)
+      return;
+    const auto c = container(n.raw);
+    if (!c)
+      throw msgpack::ParsingError("Patch path goes through a scalar");
+    n.map = c->map;
+    for (const auto item : items(n.raw, *c))
+      n.items.push_back(Node{item});
+    n.expanded = true;
+  }
+
+  auto toIndex(Bytes v) -> uint64_t
+  {
+    const auto b = static_cast<uint8_t>(v[0]);
+    if (b <= 0x7f)
+      return b;
+    switch (b)
+    {
+    case 0xcc:
+      return readBe<uint8_t>(v, 1);
+    case 0xcd:
+      return readBe<uint16_t>(v, 1);
+    case 0xce:
+      return readBe<uint32_t>(v, 1);
+    case 0xcf:
+      return readBe<uint64_t>(v, 1);
+    default:
+      throw msgpack::ParsingError("Patch index is not an unsigned integer");
+    }
+  }
+
+  // Position in n.items of the value at step: a map value or an array element; for a missing
+  // map key, n.items.size().
+  auto find(Node &n, Bytes step) -> size_t
+  {
+    expand(n);
+    if (n.map)
+    {
+      for (size_t i = 0; i < n.items.size(); i += 2)
+        if (same(n.items[i].raw, step))
+          return i + 1;
+      return n.items.size();
+    }
+    const auto i = toIndex(step);
+    if (i >= n.items.size())
+      throw msgpack::ParsingError("Patch index " + std::to_string(i) + " out of range");
+    return static_cast<size_t>(i);
+  }
+
+  auto emit(const Node &n, std::ostream &st) -> void
+  {
+    if (!n.expanded)
+    {
+      write(st, n.raw);
+      return;
+    }
+    if (n.map)
+      InternalMsgPack::msgpackSerMapHeader(st, n.items.size() / 2);
+    else
+      InternalMsgPack::msgpackSerArrayHeader(st, n.items.size());
+    for (const auto &item : n.items)
+      emit(item, st);
+  }
+
+  class PatchReader
+  {
+  public:
+    explicit PatchReader(Bytes aIn) : in(aIn) {}
+
+    auto array() -> uint64_t
+    {
+      const auto c = container(in.subspan(pos));
+      if (!c || c->map)
+        throw msgpack::ParsingError("Malformed patch");
+      pos += c->head;
+      return c->n;
+    }
+
+    auto value() -> Bytes
+    {
+      const auto rest = in.subspan(pos);
+      const auto n = rest.size() - msgpack::skip(rest).size();
+      pos += n;
+      return rest.first(n);
+    }
+
+    auto index() -> uint64_t { return toIndex(value()); }
+
+  private:
+    Bytes in;
+    size_t pos = 0;
+  };
+
+  auto apply(Node &root, PatchReader &r) -> void
+  {
+    const auto fields = r.array();
+    const auto op = r.index();
+    auto steps = std::vector<Bytes>{};
+    for (auto depth = r.array(); depth > 0; --depth)
+      steps.push_back(r.value());
+    if (fields != (op == Set ? 3u : op == Delete ? 2u : op == Splice ? 5u : 0u))
+      throw msgpack::ParsingError("Malformed patch");
+
+    auto *node = &root;
+    const auto last = op == Splice ? steps.size() : steps.size() - (steps.empty() ? 0 : 1);
+    for (size_t i = 0; i < last; ++i)
+    {
+      const auto at = find(*node, steps[i]);
+      if (at == node->items.size())
+        throw msgpack::ParsingError("Patch path not found");
+      node = &node->items[at];
+    }
+
+    if (op == Splice)
+    {
+      const auto index = r.index();
+      const auto count = r.index();
+      const auto n = r.array();
+      expand(*node);
+      if (node->map || index > node->items.size() || count > node->items.size() - index)
+        throw msgpack::ParsingError("Patch splice out of range");
+      auto added = std::vector<Node>{};
+      for (uint64_t i = 0; i < n; ++i)
+        added.push_back(Node{r.value()});
+      const auto from = node->items.begin() + static_cast<ptrdiff_t>(index);
+      node->items.insert(node->items.erase(from, from + static_cast<ptrdiff_t>(count)),
+                         added.begin(),
+                         added.end());
+      return;
+    }
+    if (steps.empty())
+    {
+      if (op != Set)
+        throw msgpack::ParsingError("Patch deletes the whole message");
+      *node = Node{r.value()};
+      return;
+    }
+    const auto at = find(*node, steps.back());
+    const auto found = at != node->items.size();
+    if (op == Set && found)
+      node->items[at] = Node{r.value()};
+    else if (op == Set)
+    {
+      node->items.push_back(Node{steps.back()});
+      node->items.push_back(Node{r.value()});
+    }
+    else if (!found)
+      throw msgpack::ParsingError("Patch path not found");
+    else
+    {
+      const auto key = node->items.begin() + static_cast<ptrdiff_t>(at);
+      node->items.erase(node->map ? key - 1 : key, key + 1);
+    }
+  }
+} // namespace
+
+namespace msgpack
+{
+  auto diff(std::span<const std::byte> from, std::span<const std::byte> to, std::ostream &st)
+    -> void
+  {
+    auto ops = std::ostringstream{};
+    const auto n = Differ{}.diff(from.first(from.size() - skip(from).size()),
+                                 to.first(to.size() - skip(to).size()),
+                                 ops);
+    InternalMsgPack::msgpackSerArrayHeader(st, n);
+    write(st, ops.view());
+  }
+
+  auto patch(std::span<const std::byte> from, std::span<const std::byte> delta, std::ostream &st)
+    -> void
+  {
+    auto root = Node{from.first(from.size() - skip(from).size())};
+    auto r = PatchReader{delta};
+    const auto n = r.array();
+    for (uint64_t i = 0; i < n; ++i)
+      apply(root, r);
+    emit(root, st);
+  }
+} // namespace msgpack
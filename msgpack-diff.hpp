@@ -0,0 +1,27 @@
+// (c) 2025 Mika Pi
+
+#pragma once
+#include "msgpack.hpp"
+#include <ostream>
+#include <span>
+
+namespace msgpack
+{
+  // Writes to st a patch that turns the message `from` into `to`, for sending changes to a
+  // document instead of the whole document. The patch is a msgpack array of operations:
+  //   [0, path, value]                     set the value at path, adding a missing map key
+  //   [1, path]                            delete the map key or array element at path
+  //   [2, path, index, count, [items...]]  replace count elements of the array at path
+  // A path is an array of steps, the encoded key for a map and the index for an array; the
+  // empty path is the whole message. Subtrees whose bytes are the same in both messages are
+  // skipped without being decoded, and a container changed too much to be worth describing is
+  // set whole, so the patch grows with the change rather than with the document.
+  auto diff(std::span<const std::byte> from, std::span<const std::byte> to, std::ostream &st)
+    -> void;
+
+  // Writes to st the message `from` with the patch `delta` applied. Only the containers on the
+  // patched paths are taken apart and written with new headers; everything else is copied as
+  // it is. A malformed patch, or one that does not fit `from`, throws ParsingError.
+  auto patch(std::span<const std::byte> from, std::span<const std::byte> delta, std::ostream &st)
+    -> void;
+} // namespace msgpack
@@ -0,0 +1,316 @@
+// (c) 2025 Mika Pi
+
+#pragma once
+#include "msgpack-ser.hpp"
+#include "msgpack.hpp"
+#include <cstring>
+#include <span>
+#include <string>
+#include <vector>
+
+// Decodes the object in `in` into v without building a msgpack::Val when the bytes have the
+// layout msgpackSer writes for T: SER_PROPS structs with every field in declaration order, and
+// values of the expected types. Field names are matched with memcmp against T's encoded names
+// and scalars, strings and vectors are read directly. Values of other types go through the
+// generic decoder one at a time, and a message that does not match the layout is decoded with
+// msgpack::Blob and msgpackDeser, so the result is always the same as msgpackDeser's. Borrowed
+// members point into `in`. Not for key dictionary streams.
+template <typename T>
+auto msgpackDeserFast(std::span<const std::byte> in, T &v) -> void;
+
+namespace InternalMsgPack
+{
+  // Cursor of the fast path: every read either consumes the expected encoding or returns false
+  // without advancing.
+  class FastReader
+  {
+  public:
+    explicit FastReader(std::span<const std::byte> aIn) : in(aIn) {}
+
+    auto done() const -> bool { return pos == in.size(); }
+    auto rest() const -> std::span<const std::byte> { return in.subspan(pos); }
+    auto advance(size_t n) -> void { pos += n; }
+
+    auto arrayHeader(size_t &n) -> bool { return header(0x90, 0x0f, 0xdc, 0xdd, n); }
+    auto mapHeader(size_t &n) -> bool { return header(0x80, 0x0f, 0xde, 0xdf, n); }
+
+    auto strHeader(size_t &n) -> bool
+    {
+      if (pos < in.size() && static_cast<uint8_t>(in[pos]) == 0xd9)
+        return sized<uint8_t>(n);
+      return header(0xa0, 0x1f, 0xda, 0xdb, n);
+    }
+
+    auto binHeader(size_t &n) -> bool
+    {
+      if (pos == in.size())
+        return false;
+      switch (static_cast<uint8_t>(in[pos]))
+      {
+      case 0xc4:
+        return sized<uint8_t>(n);
+      case 0xc5:
+        return sized<uint16_t>(n);
+      case 0xc6:
+        return sized<uint32_t>(n);
+      default:
+        return false;
+      }
+    }
+
+    // The next n bytes, or nullptr if fewer are left.
+    auto take(size_t n) -> const char *
+    {
+      if (n > in.size() - pos)
+        return nullptr;
+      const auto p = reinterpret_cast<const char *>(in.data() + pos);
+      pos += n;
+      return p;
+    }
+
+    auto key(std::string_view encoded) -> bool
+    {
+      if (encoded.size() > in.size() - pos ||
+          std::memcmp(in.data() + pos, encoded.data(), encoded.size()) != 0)
+        return false;
+      pos += encoded.size();
+      return true;
+    }
+
+    auto boolean(bool &v) -> bool
+    {
+      if (pos == in.size())
+        return false;
+      const auto b = static_cast<uint8_t>(in[pos]);
+      if (b != 0xc2 && b != 0xc3)
+        return false;
+      v = b == 0xc3;
+      ++pos;
+      return true;
+    }
+
+    template <typename T>
+    auto integer(T &v) -> bool
+    {
+      if (pos == in.size())
+        return false;
+      const auto b = static_cast<uint8_t>(in[pos]);
+      if (b <= 0x7f || b >= 0xe0)
+      {
+        v = static_cast<T>(static_cast<int8_t>(b));
+        ++pos;
+        return true;
+      }
+      switch (b)
+      {
+      case 0xcc:
+        return scalar<uint8_t>(v);
+      case 0xcd:
+        return scalar<uint16_t>(v);
+      case 0xce:
+        return scalar<uint32_t>(v);
+      case 0xcf:
+        return scalar<uint64_t>(v);
+      case 0xd0:
+        return scalar<uint8_t, int8_t>(v);
+      case 0xd1:
+        return scalar<uint16_t, int16_t>(v);
+      case 0xd2:
+        return scalar<uint32_t, int32_t>(v);
+      case 0xd3:
+        return scalar<uint64_t, int64_t>(v);
+      default:
+        return false;
+      }
+    }
+
+    // A float32 for float, a float32 or float64 for double.
+    template <typename T>
+    auto real(T &v) -> bool
+    {
+      if (pos == in.size())
+        return false;
+      const auto b = static_cast<uint8_t>(in[pos]);
+      if (b == 0xca)
+        return floating<float>(v);
+      if (b == 0xcb && sizeof(T) > 4)
+        return floating<double>(v);
+      return false;
+    }
+
+  private:
+    template <typename U>
+    auto bigEndian(size_t at, U &v) const -> bool
+    {
+      if (sizeof(U) > in.size() - std::min(at, in.size()))
+        return false;
+      v = 0;
+      for (size_t i = 0; i < sizeof(U); ++i)
+        v = static_cast<U>((v << 8) | static_cast<uint8_t>(in[at + i]));
+      return true;
+    }
+
+    // A value of Raw big-endian bytes after the type byte, reinterpreted as As.
+    template <typename Raw, typename As = Raw, typename T>
+    auto scalar(T &v) -> bool
+    {
+      auto raw = Raw{};
+      if (!bigEndian(pos + 1, raw))
+        return false;
+      v = static_cast<T>(static_cast<As>(raw));
+      pos += 1 + sizeof(Raw);
+      return true;
+    }
+
+    template <typename F, typename T>
+    auto floating(T &v) -> bool
+    {
+      using Raw = std::conditional_t<sizeof(F) == 4, uint32_t, uint64_t>;
+      auto raw = Raw{};
+      if (!bigEndian(pos + 1, raw))
+        return false;
+      auto f = F{};
+      std::memcpy(&f, &raw, sizeof f);
+      v = static_cast<T>(f);
+      pos += 1 + sizeof(Raw);
+      return true;
+    }
+
+    template <typename U>
+    auto sized(size_t &n) -> bool
+    {
+      auto len = U{};
+      if (!bigEndian(pos + 1, len))
+        return false;
+      n = len;
+      pos += 1 + sizeof(U);
+      return true;
+    }
+
+    auto header(uint8_t fix, uint8_t mask, uint8_t b16, uint8_t b32, size_t &n) -> bool
+    {
+      if (pos == in.size())
+        return false;
+      const auto b = static_cast<uint8_t>(in[pos]);
+      if ((b & ~mask) == fix)
+      {
+        n = b & mask;
+        ++pos;
+        return true;
+      }
+      if (b == b16)
+        return sized<uint16_t>(n);
+      if (b == b32)
+        return sized<uint32_t>(n);
+      return false;
+    }
+
+    std::span<const std::byte> in;
+    size_t pos = 0;
+  };
+
+  template <typename T>
+  struct IsStdVector : std::false_type
+  {
+  };
+
+  template <typename T, typename A>
+  struct IsStdVector<std::vector<T, A>> : std::true_type
+  {
+  };
+
+  template <typename T>
+  auto msgpackDeserFastVal(FastReader &r, T &v) -> bool;
+
+  // Archive passed to deser() of a SER_PROPS struct on the fast path.
+  struct FastArch
+  {
+    template <typename T>
+    auto operator()(const char *, T &vv) -> void
+    {
+      if (!ok)
+        return;
+      ok = (positional || r.key(keys[index])) && msgpackDeserFastVal(r, vv);
+      ++index;
+    }
+
+    FastReader &r;
+    const std::vector<std::string_view> &keys;
+    bool positional;
+    size_t index = 0;
+    bool ok = true;
+  };
+
+  template <typename T>
+  auto msgpackDeserFastVal(FastReader &r, T &v) -> bool
+  {
+    if constexpr (IsSerializableClassV<T>)
+    {
+      const auto &keys = fieldKeys(v).keys;
+      auto n = size_t{};
+      constexpr auto positional = msgpack::SerAsArray<T>::value;
+      if (!(positional ? r.arrayHeader(n) : r.mapHeader(n)) || n != keys.size())
+        return false;
+      auto arch = FastArch{r, keys, positional};
+      v.deser(arch);
+      return arch.ok;
+    }
+    else if constexpr (std::is_same_v<T, bool>)
+      return r.boolean(v);
+    else if constexpr (std::is_integral_v<T>)
+      return r.integer(v);
+    else if constexpr (std::is_floating_point_v<T>)
+      return r.real(v);
+    else if constexpr (std::is_same_v<T, std::string>)
+    {
+      auto n = size_t{};
+      const auto p = r.strHeader(n) ? r.take(n) : nullptr;
+      if (!p)
+        return false;
+      v.assign(p, n);
+      return true;
+    }
+    else if constexpr (IsStdVector<T>::value && msgpack::IsBinElement<typename T::value_type>::value)
+    {
+      auto n = size_t{};
+      const auto p = r.binHeader(n) ? r.take(n) : nullptr;
+      if (!p)
+        return false;
+      v.resize(n);
+      if (n > 0)
+        std::memcpy(v.data(), p, n);
+      return true;
+    }
+    else if constexpr (IsStdVector<T>::value)
+    {
+      auto n = size_t{};
+      if (!r.arrayHeader(n) || n > r.rest().size())
+        return false;
+      v.resize(n);
+      for (auto &e : v)
+        if (!msgpackDeserFastVal(r, e))
+          return false;
+      return true;
+    }
+    else
+    {
+      const auto n = msgpack::objectSize(r.rest());
+      if (n == 0)
+        return false;
+      const auto blob = msgpack::Blob{r.rest().first(n)};
+      msgpackDeser(blob.val, v);
+      r.advance(n);
+      return true;
+    }
+  }
+} // namespace InternalMsgPack
+
+template <typename T>
+auto msgpackDeserFast(std::span<const std::byte> in, T &v) -> void
+{
+  auto r = InternalMsgPack::FastReader{in};
+  if (InternalMsgPack::msgpackDeserFastVal(r, v) && r.done())
+    return;
+  const auto blob = msgpack::Blob{in};
+  msgpackDeser(blob.val, v);
+}
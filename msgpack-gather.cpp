@@ -0,0 +1,141 @@
+// (c) 2025 Mika Pi
+
+#include "msgpack-gather.hpp"
+#include <algorithm>
+#include <cerrno>
+#include <climits>
+#include <cstring>
+#include <system_error>
+#include <unistd.h>
+
+namespace msgpack
+{
+  GatherStream::GatherStream() : std::ostream(nullptr)
+  {
+    rdbuf(&buf);
+  }
+
+  GatherStream::~GatherStream() = default;
+
+  auto GatherStream::ref(const char *data, size_t size) -> void
+  {
+    refs.push_back(Segment{data, buf.used(), size});
+    refSize += size;
+  }
+
+  auto GatherStream::segments() const -> std::vector<iovec>
+  {
+    auto r = std::vector<iovec>{};
+    r.reserve(2 * refs.size() + 1);
+    auto pos = size_t{0};
+    for (const auto &s : refs)
+    {
+      if (s.off > pos)
+        r.push_back(iovec{const_cast<char *>(buf.data() + pos), s.off - pos});
+      r.push_back(iovec{const_cast<char *>(s.ext), s.len});
+      pos = s.off;
+    }
+    if (buf.used() > pos)
+      r.push_back(iovec{const_cast<char *>(buf.data() + pos), buf.used() - pos});
+    return r;
+  }
+
+  auto GatherStream::size() const -> size_t
+  {
+    return buf.used() + refSize;
+  }
+
+  auto GatherStream::staged() const -> size_t
+  {
+    return buf.used();
+  }
+
+  auto GatherStream::writev(int fd) const -> void
+  {
+    auto iov = segments();
+    auto seg = iov.data();
+    auto segEnd = iov.data() + iov.size();
+    while (seg != segEnd)
+    {
+      const auto cnt = std::min<ptrdiff_t>(segEnd - seg, IOV_MAX);
+      const auto n = ::writev(fd, seg, static_cast<int>(cnt));
+      if (n < 0)
+      {
+        if (errno == EINTR)
+          continue;
+        throw std::system_error(errno, std::generic_category(), "writev");
+      }
+      auto written = static_cast<size_t>(n);
+      while (seg != segEnd && written >= seg->iov_len)
+      {
+        written -= seg->iov_len;
+        ++seg;
+      }
+      if (written > 0)
+      {
+        seg->iov_base = static_cast<char *>(seg->iov_base) + written;
+        seg->iov_len -= written;
+      }
+    }
+  }
+
+  auto GatherStream::reset() -> void
+  {
+    buf.reset();
+    refs.clear();
+    refSize = 0;
+    std::ostream::clear();
+  }
+
+  GatherStream::Buf::~Buf() = default;
+
+  auto GatherStream::Buf::used() const -> size_t
+  {
+    return static_cast<size_t>(pptr() - pbase());
+  }
+
+  auto GatherStream::Buf::data() const -> const char *
+  {
+    return staging.data();
+  }
+
+  auto GatherStream::Buf::reset() -> void
+  {
+    setPut(0);
+  }
+
+  auto GatherStream::Buf::overflow(int_type ch) -> int_type
+  {
+    if (traits_type::eq_int_type(ch, traits_type::eof()))
+      return traits_type::not_eof(ch);
+    grow(1);
+    *pptr() = traits_type::to_char_type(ch);
+    pbump(1);
+    return ch;
+  }
+
+  auto GatherStream::Buf::xsputn(const char *s, std::streamsize n) -> std::streamsize
+  {
+    const auto len = static_cast<size_t>(n);
+    if (static_cast<size_t>(epptr() - pptr()) < len)
+      grow(len);
+    std::memcpy(pptr(), s, len);
+    setPut(used() + len);
+    return n;
+  }
+
+  auto GatherStream::Buf::grow(size_t need) -> void
+  {
+    const auto u = used();
+    staging.resize(std::max({staging.size() * 2, u + need, size_t{256}}));
+    setPut(u);
+  }
+
+  auto GatherStream::Buf::setPut(size_t u) -> void
+  {
+    setp(staging.data(), staging.data() + staging.size());
+    for (; u > INT_MAX; u -= INT_MAX)
+      pbump(INT_MAX);
+    pbump(static_cast<int>(u));
+  }
+} // namespace msgpack
@@ -0,0 +1,66 @@
+// (c) 2025 Mika Pi
+
+#pragma once
+#include <cstddef>
+#include <ostream>
+#include <streambuf>
+#include <sys/uio.h>
+#include <vector>
+
+namespace msgpack
+{
+  // Output stream producing scatter-gather segments ready for writev(). Headers and scalars are
+  // packed into an internal staging buffer, str/bin payloads of RefThreshold bytes or more are
+  // referenced in place. Referenced objects must stay alive and unchanged until the segments
+  // have been written.
+  class GatherStream final : public std::ostream
+  {
+  public:
+    static constexpr size_t RefThreshold = 1024;
+
+    GatherStream();
+    ~GatherStream() final;
+    GatherStream(const GatherStream &) = delete;
+    auto operator=(const GatherStream &) -> GatherStream & = delete;
+
+    auto ref(const char *data, size_t size) -> void;
+    auto segments() const -> std::vector<iovec>;
+    // Total number of bytes in all segments.
+    auto size() const -> size_t;
+    // Number of bytes copied into the staging buffer.
+    auto staged() const -> size_t;
+    // Writes all segments to a blocking fd, retrying on partial writes and EINTR.
+    auto writev(int fd) const -> void;
+    auto reset() -> void;
+
+  private:
+    class Buf final : public std::streambuf
+    {
+    public:
+      ~Buf() final;
+      auto used() const -> size_t;
+      auto data() const -> const char *;
+      auto reset() -> void;
+
+    protected:
+      auto overflow(int_type ch) -> int_type final;
+      auto xsputn(const char *s, std::streamsize n) -> std::streamsize final;
+
+    private:
+      auto grow(size_t need) -> void;
+      auto setPut(size_t used) -> void;
+      std::vector<char> staging;
+    };
+
+    struct Segment
+    {
+      const char *ext;
+      size_t off; // position in the staging buffer the reference is inserted at
+      size_t len;
+    };
+
+    Buf buf;
+    std::vector<Segment> refs;
+    size_t refSize = 0;
+  };
+} // namespace msgpack
@@ -0,0 +1,214 @@
+// (c) 2025 Mika Pi
+
+#include "msgpack-hash.hpp"
+#include <algorithm>
+#include <bit>
+#include <cstring>
+
+namespace
+{
+  constexpr auto P1 = uint64_t{0x9e3779b185ebca87};
+  constexpr auto P2 = uint64_t{0xc2b2ae3d27d4eb4f};
+  constexpr auto P3 = uint64_t{0x165667b19e3779f9};
+  constexpr auto P4 = uint64_t{0x85ebca77c2b2ae63};
+  constexpr auto P5 = uint64_t{0x27d4eb2f165667c5};
+
+  template <typename T>
+  auto readLe(const unsigned char *p) -> T
+  {
+    auto v = T{};
+    std::memcpy(&v, p, sizeof(v));
+    if constexpr (std::endian::native == std::endian::big)
+    {
+      if constexpr (sizeof(T) == 8)
+        v = __builtin_bswap64(v);
+      else
+        v = __builtin_bswap32(v);
+    }
+    return v;
+  }
+
+  auto mix(uint64_t acc, uint64_t input) -> uint64_t
+  {
+    return std::rotl(acc + input * P2, 31) * P1;
+  }
+
+  auto merge(uint64_t h, uint64_t acc) -> uint64_t
+  {
+    return (h ^ mix(0, acc)) * P1 + P4;
+  }
+} // namespace
+
+namespace msgpack
+{
+  HashStream::HashStream() : std::ostream(nullptr), buf(nullptr)
+  {
+    rdbuf(&buf);
+  }
+
+  HashStream::HashStream(std::ostream &sink) : std::ostream(nullptr), buf(sink.rdbuf())
+  {
+    rdbuf(&buf);
+  }
+
+  HashStream::~HashStream() = default;
+
+  auto HashStream::digest() -> uint64_t
+  {
+    return buf.digest();
+  }
+
+  auto HashStream::size() const -> uint64_t
+  {
+    return buf.size();
+  }
+
+  auto HashStream::reset() -> void
+  {
+    const auto passed = buf.reset();
+    std::ostream::clear();
+    if (!passed)
+      setstate(std::ios_base::badbit);
+  }
+
+  HashStream::Buf::Buf(std::streambuf *aSink) : sink(aSink)
+  {
+    reset();
+  }
+
+  HashStream::Buf::~Buf()
+  {
+    drain();
+  }
+
+  auto HashStream::Buf::digest() -> uint64_t
+  {
+    drain();
+    auto h = total >= 32 ? std::rotl(acc[0], 1) + std::rotl(acc[1], 7) + std::rotl(acc[2], 12) +
+                             std::rotl(acc[3], 18)
+                         : acc[2] + P5;
+    if (total >= 32)
+      for (const auto a : acc)
+        h = merge(h, a);
+    h += total;
+
+    auto p = stripe.data();
+    const auto end = p + striped;
+    for (; end - p >= 8; p += 8)
+      h = std::rotl(h ^ mix(0, readLe<uint64_t>(p)), 27) * P1 + P4;
+    if (end - p >= 4)
+    {
+      h = std::rotl(h ^ (readLe<uint32_t>(p) * P1), 23) * P2 + P3;
+      p += 4;
+    }
+    for (; p != end; ++p)
+      h = std::rotl(h ^ (*p * P5), 11) * P1;
+
+    h ^= h >> 33;
+    h *= P2;
+    h ^= h >> 29;
+    h *= P3;
+    h ^= h >> 32;
+    return h;
+  }
+
+  auto HashStream::Buf::size() const -> uint64_t
+  {
+    return total + static_cast<uint64_t>(pptr() - pbase());
+  }
+
+  auto HashStream::Buf::reset() -> bool
+  {
+    // bytes still buffered belong to the sink, even if their hash is dropped
+    const auto passed = drain();
+    acc = {P1 + P2, P2, 0, 0 - P1};
+    striped = 0;
+    total = 0;
+    return passed;
+  }
+
+  auto HashStream::Buf::overflow(int_type ch) -> int_type
+  {
+    if (!drain())
+      return traits_type::eof();
+    if (traits_type::eq_int_type(ch, traits_type::eof()))
+      return traits_type::not_eof(ch);
+    *pptr() = traits_type::to_char_type(ch);
+    pbump(1);
+    return ch;
+  }
+
+  auto HashStream::Buf::xsputn(const char *s, std::streamsize n) -> std::streamsize
+  {
+    const auto len = static_cast<size_t>(n);
+    if (len <= static_cast<size_t>(epptr() - pptr()))
+    {
+      std::memcpy(pptr(), s, len);
+      pbump(static_cast<int>(len));
+      return n;
+    }
+    if (!drain())
+      return 0;
+    if (len < area.size())
+    {
+      std::memcpy(pptr(), s, len);
+      pbump(static_cast<int>(len));
+      return n;
+    }
+    return consume(s, len) ? n : 0;
+  }
+
+  auto HashStream::Buf::sync() -> int
+  {
+    if (!drain())
+      return -1;
+    return sink ? sink->pubsync() : 0;
+  }
+
+  auto HashStream::Buf::seekoff(off_type off,
+                                std::ios_base::seekdir dir,
+                                std::ios_base::openmode which) -> pos_type
+  {
+    // only tellp() is supported
+    if (off != 0 || dir != std::ios_base::cur || !(which & std::ios_base::out))
+      return pos_type(off_type(-1));
+    return pos_type(static_cast<off_type>(size()));
+  }
+
+  auto HashStream::Buf::drain() -> bool
+  {
+    const auto n = static_cast<size_t>(pptr() - pbase());
+    setp(area.data(), area.data() + area.size());
+    return n == 0 || consume(area.data(), n);
+  }
+
+  auto HashStream::Buf::consume(const char *s, size_t n) -> bool
+  {
+    update(reinterpret_cast<const unsigned char *>(s), n);
+    const auto len = static_cast<std::streamsize>(n);
+    return !sink || sink->sputn(s, len) == len;
+  }
+
+  auto HashStream::Buf::update(const unsigned char *p, size_t n) -> void
+  {
+    total += n;
+    if (striped > 0)
+    {
+      const auto fill = std::min(n, stripe.size() - striped);
+      std::memcpy(stripe.data() + striped, p, fill);
+      striped += fill;
+      p += fill;
+      n -= fill;
+      if (striped < stripe.size())
+        return;
+      for (size_t i = 0; i < 4; ++i)
+        acc[i] = mix(acc[i], readLe<uint64_t>(stripe.data() + 8 * i));
+      striped = 0;
+    }
+    for (; n >= 32; p += 32, n -= 32)
+      for (size_t i = 0; i < 4; ++i)
+        acc[i] = mix(acc[i], readLe<uint64_t>(p + 8 * i));
+    std::memcpy(stripe.data(), p, n);
+    striped = n;
+  }
+} // namespace msgpack
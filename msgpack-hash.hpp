@@ -0,0 +1,80 @@
+// (c) 2025 Mika Pi
+
+#pragma once
+#include "msgpack-ser.hpp"
+#include <array>
+#include <cstdint>
+#include <ostream>
+#include <streambuf>
+
+namespace msgpack
+{
+  // Output stream computing the XXH64 hash (seed 0) of the bytes written to it while they are
+  // encoded, without a second pass over the output. Constructed with a sink, it also passes the
+  // bytes on, so a value is stored and hashed at once:
+  //   auto hs = msgpack::HashStream{file};
+  //   hs << msgpack::canonical;
+  //   msgpackSer(hs, v);
+  //   const auto key = hs.digest();
+  class HashStream final : public std::ostream
+  {
+  public:
+    HashStream();
+    explicit HashStream(std::ostream &sink);
+    ~HashStream() final;
+    HashStream(const HashStream &) = delete;
+    auto operator=(const HashStream &) -> HashStream & = delete;
+
+    // Hash of the bytes written since construction or the last reset(). Passes buffered bytes
+    // on to the sink.
+    auto digest() -> uint64_t;
+    // Number of bytes written since construction or the last reset().
+    auto size() const -> uint64_t;
+    // Starts a new hash. Passes buffered bytes on to the sink.
+    auto reset() -> void;
+
+  private:
+    class Buf final : public std::streambuf
+    {
+    public:
+      explicit Buf(std::streambuf *sink);
+      ~Buf() final;
+      auto digest() -> uint64_t;
+      auto size() const -> uint64_t;
+      // False if the sink did not take the buffered bytes.
+      auto reset() -> bool;
+
+    protected:
+      auto overflow(int_type ch) -> int_type final;
+      auto xsputn(const char *s, std::streamsize n) -> std::streamsize final;
+      auto sync() -> int final;
+      auto seekoff(off_type off, std::ios_base::seekdir dir, std::ios_base::openmode which)
+        -> pos_type final;
+
+    private:
+      // Hashes and passes on the put area.
+      auto drain() -> bool;
+      auto consume(const char *s, size_t n) -> bool;
+      auto update(const unsigned char *p, size_t n) -> void;
+
+      std::streambuf *sink;
+      std::array<char, 4096> area;
+      std::array<uint64_t, 4> acc;
+      std::array<unsigned char, 32> stripe; // input not yet forming a whole 32-byte stripe
+      size_t striped = 0;
+      uint64_t total = 0;
+    };
+
+    Buf buf;
+  };
+
+  // Content hash of v: XXH64 of its canonical encoding, so equal values hash equal.
+  template <typename T>
+  auto contentHash(const T &v) -> uint64_t
+  {
+    auto hs = HashStream{};
+    hs << canonical;
+    msgpackSer(hs, v);
+    return hs.digest();
+  }
+} // namespace msgpack
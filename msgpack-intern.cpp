@@ -0,0 +1,137 @@
+// (c) 2025 Mika Pi
+
+#include "msgpack-intern.hpp"
+#include <cstring>
+
+namespace msgpack
+{
+  namespace
+  {
+    thread_local InternPool *currentPool = nullptr;
+
+    constexpr auto K0 = uint64_t{0x9e3779b97f4a7c15};
+    constexpr auto K1 = uint64_t{0xbf58476d1ce4e5b9};
+
+    auto mix(uint64_t h, uint64_t w) -> uint64_t
+    {
+      h ^= w * K1;
+      h = (h << 31) | (h >> 33);
+      return h * K0;
+    }
+  } // namespace
+
+  Interned::Interned() = default;
+
+  Interned::Interned(std::string_view v)
+    : str(currentPool ? currentPool->intern(v).str : std::make_shared<const std::string>(v))
+  {
+  }
+
+  Interned::Interned(std::shared_ptr<const std::string> v) : str(std::move(v)) {}
+
+  auto Interned::view() const -> std::string_view
+  {
+    return str ? std::string_view{*str} : std::string_view{};
+  }
+
+  Interned::operator std::string_view() const
+  {
+    return view();
+  }
+
+  auto Interned::operator==(const Interned &o) const -> bool
+  {
+    return str == o.str || view() == o.view();
+  }
+
+  auto Interned::operator<=>(const Interned &o) const -> std::strong_ordering
+  {
+    if (str == o.str)
+      return std::strong_ordering::equal;
+    return view().compare(o.view()) <=> 0;
+  }
+
+  auto hashBytes(std::string_view v) -> uint64_t
+  {
+    auto h = K0 ^ v.size();
+    auto p = v.data();
+    auto n = v.size();
+    for (; n >= 8; n -= 8, p += 8)
+    {
+      uint64_t w;
+      std::memcpy(&w, p, 8);
+      h = mix(h, w);
+    }
+    if (n > 0)
+    {
+      uint64_t w = 0;
+      std::memcpy(&w, p, n);
+      h = mix(h, w);
+    }
+    h ^= h >> 29;
+    h *= K1;
+    return h ^ (h >> 32);
+  }
+
+  InternPool::InternPool(size_t aCapacity, size_t aMaxLen)
+    : capacity(aCapacity > 0 ? aCapacity : 1), maxLen(aMaxLen)
+  {
+    index.reserve(capacity);
+    slots.reserve(capacity);
+  }
+
+  auto InternPool::intern(std::string_view v) -> Interned
+  {
+    if (auto it = index.find(v); it != index.end())
+    {
+      auto &slot = slots[it->second];
+      slot.used = true;
+      return Interned{slot.str};
+    }
+    auto str = std::make_shared<const std::string>(v);
+    if (v.size() > maxLen)
+      return Interned{std::move(str)};
+
+    if (slots.size() < capacity)
+    {
+      index.emplace(*str, slots.size());
+      slots.push_back(Slot{str, false});
+      return Interned{std::move(str)};
+    }
+    while (slots[hand].used)
+    {
+      slots[hand].used = false;
+      hand = (hand + 1) % slots.size();
+    }
+    index.erase(*slots[hand].str);
+    index.emplace(*str, hand);
+    slots[hand] = Slot{str, false};
+    hand = (hand + 1) % slots.size();
+    return Interned{std::move(str)};
+  }
+
+  auto InternPool::size() const -> size_t
+  {
+    return slots.size();
+  }
+
+  auto InternPool::current() -> InternPool *
+  {
+    return currentPool;
+  }
+
+  auto InternPool::Hash::operator()(std::string_view v) const -> size_t
+  {
+    return static_cast<size_t>(hashBytes(v));
+  }
+
+  InternPool::Scope::Scope(InternPool &pool) : prev(currentPool)
+  {
+    currentPool = &pool;
+  }
+
+  InternPool::Scope::~Scope()
+  {
+    currentPool = prev;
+  }
+} // namespace msgpack
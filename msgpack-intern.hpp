@@ -0,0 +1,90 @@
+// (c) 2025 Mika Pi
+
+#pragma once
+#include <compare>
+#include <cstdint>
+#include <memory>
+#include <string>
+#include <string_view>
+#include <unordered_map>
+#include <vector>
+
+namespace msgpack
+{
+  // Shared handle to an immutable string. Constructed from a string_view it is interned in the
+  // InternPool in use on the current thread, if any, so repeated keys share one string and do not
+  // allocate. A handle stays valid after its pool evicts or drops the string.
+  class Interned
+  {
+  public:
+    Interned();
+    explicit Interned(std::string_view);
+    explicit Interned(std::shared_ptr<const std::string>);
+
+    auto view() const -> std::string_view;
+    operator std::string_view() const;
+    auto operator==(const Interned &) const -> bool;
+    auto operator<=>(const Interned &) const -> std::strong_ordering;
+
+  private:
+    std::shared_ptr<const std::string> str;
+  };
+
+  // Hash of a byte string, mixing 8-byte words at a time.
+  auto hashBytes(std::string_view) -> uint64_t;
+
+  // Bounded interning table shared by a decoder across messages. Once `capacity` strings are
+  // pooled, new ones replace strings that have not been looked up since the clock hand last
+  // passed them (CLOCK eviction). Strings longer than maxLen are never pooled. Not thread-safe:
+  // use one pool per decoding thread.
+  class InternPool
+  {
+  public:
+    explicit InternPool(size_t capacity = 4096, size_t maxLen = 64);
+    InternPool(const InternPool &) = delete;
+    auto operator=(const InternPool &) -> InternPool & = delete;
+
+    auto intern(std::string_view) -> Interned;
+    auto size() const -> size_t;
+    static auto current() -> InternPool *;
+
+    // Makes pool the current thread's pool for the lifetime of the scope.
+    class Scope
+    {
+    public:
+      explicit Scope(InternPool &pool);
+      ~Scope();
+      Scope(const Scope &) = delete;
+      auto operator=(const Scope &) -> Scope & = delete;
+
+    private:
+      InternPool *prev;
+    };
+
+  private:
+    struct Hash
+    {
+      auto operator()(std::string_view) const -> size_t;
+    };
+    struct Slot
+    {
+      std::shared_ptr<const std::string> str;
+      bool used;
+    };
+
+    size_t capacity;
+    size_t maxLen;
+    std::unordered_map<std::string_view, size_t, Hash> index;
+    std::vector<Slot> slots;
+    size_t hand = 0;
+  };
+} // namespace msgpack
+
+template <>
+struct std::hash<msgpack::Interned>
+{
+  auto operator()(const msgpack::Interned &v) const -> size_t
+  {
+    return static_cast<size_t>(msgpack::hashBytes(v.view()));
+  }
+};
@@ -0,0 +1,1138 @@
+// (c) 2025 Mika Pi
+
+#include "msgpack-json.hpp"
+#include "msgpack.hpp"
+#include <array>
+#include <bit>
+#include <charconv>
+#include <chrono>
+#include <cmath>
+#include <cstring>
+#include <string>
+#include <string_view>
+#include <vector>
+
+namespace msgpack
+{
+  namespace
+  {
+    constexpr auto TimestampExt = int8_t{-1};
+    constexpr auto Base64 = std::string_view{
+      "ABCDEFGHIJKLMNOPQRSTUVWXYZabcdefghijklmnopqrstuvwxyz0123456789+/"};
+
+    // Reader of a stream through a private buffer, throwing on a premature end. Reads ahead,
+    // so it is used for whole streams only.
+    class Input
+    {
+    public:
+      explicit Input(std::istream &st) : sb(st.rdbuf()) {}
+      Input(const Input &) = delete;
+      auto operator=(const Input &) -> Input & = delete;
+
+      auto atEnd() -> bool { return pos == end && !refill(); }
+      auto peek() -> int
+      {
+        if (pos == end && !refill())
+          return std::char_traits<char>::eof();
+        return static_cast<uint8_t>(buf[pos]);
+      }
+
+      auto get() -> uint8_t
+      {
+        if (pos == end && !refill())
+          throw ParsingError("Unexpected EOF");
+        return static_cast<uint8_t>(buf[pos++]);
+      }
+
+      // Up to max of the next bytes, at least one.
+      auto chunk(size_t max) -> std::string_view
+      {
+        if (pos == end && !refill())
+          throw ParsingError("Unexpected EOF");
+        const auto n = std::min(max, end - pos);
+        pos += n;
+        return std::string_view(buf.data() + pos - n, n);
+      }
+
+      // The buffered bytes, at least one, without consuming them.
+      auto buffered() -> std::string_view
+      {
+        if (pos == end && !refill())
+          throw ParsingError("Unexpected EOF");
+        return std::string_view(buf.data() + pos, end - pos);
+      }
+
+      auto skip(size_t n) -> void { pos += n; }
+
+      auto read(char *data, size_t size) -> void
+      {
+        while (size > 0)
+        {
+          const auto c = chunk(size);
+          std::memcpy(data, c.data(), c.size());
+          data += c.size();
+          size -= c.size();
+        }
+      }
+
+      template <typename U>
+      auto be() -> U
+      {
+        auto v = U{};
+        for (size_t i = 0; i < sizeof(U); ++i)
+          v = static_cast<U>((v << 8) | get());
+        return v;
+      }
+
+    private:
+      auto refill() -> bool
+      {
+        pos = 0;
+        const auto n = sb->sgetn(buf.data(), static_cast<std::streamsize>(buf.size()));
+        end = static_cast<size_t>(std::max(std::streamsize{0}, n));
+        return end > 0;
+      }
+
+      std::streambuf *sb;
+      std::array<char, 64 * 1024> buf;
+      size_t pos = 0;
+      size_t end = 0;
+    };
+
+    // Output buffered in chunks, to keep per-token writes off the stream.
+    class Output
+    {
+    public:
+      explicit Output(std::ostream &st) : os(st) {}
+      Output(const Output &) = delete;
+      auto operator=(const Output &) -> Output & = delete;
+      ~Output() { flush(); }
+
+      auto put(char c) -> void
+      {
+        if (used == buf.size())
+          flush();
+        buf[used++] = c;
+      }
+
+      auto write(std::string_view v) -> void
+      {
+        if (v.size() > buf.size() - used)
+        {
+          flush();
+          if (v.size() > buf.size())
+          {
+            os.write(v.data(), static_cast<std::streamsize>(v.size()));
+            return;
+          }
+        }
+        std::memcpy(buf.data() + used, v.data(), v.size());
+        used += v.size();
+      }
+
+      template <typename T>
+      auto number(T v) -> void
+      {
+        if (buf.size() - used < 32)
+          flush();
+        const auto r = std::to_chars(buf.data() + used, buf.data() + buf.size(), v);
+        used = static_cast<size_t>(r.ptr - buf.data());
+      }
+
+      auto flush() -> void
+      {
+        os.write(buf.data(), static_cast<std::streamsize>(used));
+        used = 0;
+      }
+
+    private:
+      std::ostream &os;
+      std::array<char, 64 * 1024> buf;
+      size_t used = 0;
+    };
+
+    // Checks UTF-8 a byte at a time, so a sequence may span chunks.
+    class Utf8Check
+    {
+    public:
+      // Returns false if c cannot come next.
+      auto next(uint8_t c) -> bool
+      {
+        if (need > 0)
+        {
+          if (c < lo || c > hi)
+            return false;
+          --need;
+          lo = 0x80;
+          hi = 0xbf;
+          return true;
+        }
+        if (c < 0x80)
+          return true;
+        if (c < 0xc2 || c > 0xf4)
+          return false;
+        need = c < 0xe0 ? 1 : c < 0xf0 ? 2 : 3;
+        // no overlong forms, surrogates or code points past U+10FFFF
+        lo = c == 0xe0 ? 0xa0 : c == 0xf0 ? 0x90 : 0x80;
+        hi = c == 0xed ? 0x9f : c == 0xf4 ? 0x8f : 0xbf;
+        return true;
+      }
+
+      auto complete() const -> bool { return need == 0; }
+
+    private:
+      int need = 0;
+      uint8_t lo = 0x80;
+      uint8_t hi = 0xbf;
+    };
+
+    // Copies len bytes of a msgpack str as the contents of a JSON string.
+    auto copyEscaped(Input &in, Output &out, size_t len) -> void
+    {
+      auto utf8 = Utf8Check{};
+      while (len > 0)
+      {
+        const auto chunk = in.chunk(len);
+        len -= chunk.size();
+        auto run = size_t{0};
+        for (size_t i = 0; i < chunk.size(); ++i)
+        {
+          const auto c = static_cast<uint8_t>(chunk[i]);
+          if (c >= 0x80 || !utf8.complete())
+          {
+            if (!utf8.next(c))
+              throw ParsingError("Invalid UTF-8 in str");
+            continue;
+          }
+          if (c >= 0x20 && c != '"' && c != '\\')
+            continue;
+          out.write(chunk.substr(run, i - run));
+          run = i + 1;
+          switch (c)
+          {
+          case '"':
+            out.write("\\\"");
+            break;
+          case '\\':
+            out.write("\\\\");
+            break;
+          case '\n':
+            out.write("\\n");
+            break;
+          case '\r':
+            out.write("\\r");
+            break;
+          case '\t':
+            out.write("\\t");
+            break;
+          case '\b':
+            out.write("\\b");
+            break;
+          case '\f':
+            out.write("\\f");
+            break;
+          default: {
+            constexpr auto hex = std::string_view{"0123456789abcdef"};
+            const char esc[] = {'\\', 'u', '0', '0', hex[c >> 4], hex[c & 0xf]};
+            out.write(std::string_view(esc, sizeof esc));
+          }
+          }
+        }
+        out.write(chunk.substr(run));
+      }
+      if (!utf8.complete())
+        throw ParsingError("Invalid UTF-8 in str");
+    }
+
+    // Copies len bytes as base64, without quotes.
+    auto copyBase64(Input &in, Output &out, size_t len) -> void
+    {
+      auto chunk = std::array<uint8_t, 3 * 1024>{};
+      auto text = std::array<char, 4 * 1024>{};
+      while (len > 0)
+      {
+        const auto n = std::min(len, chunk.size());
+        in.read(reinterpret_cast<char *>(chunk.data()), n);
+        len -= n;
+        auto t = size_t{0};
+        for (size_t i = 0; i < n; i += 3)
+        {
+          const auto rest = n - i;
+          const auto v = uint32_t{chunk[i]} << 16 | (rest > 1 ? uint32_t{chunk[i + 1]} << 8 : 0) |
+                         (rest > 2 ? uint32_t{chunk[i + 2]} : 0);
+          text[t++] = Base64[v >> 18];
+          text[t++] = Base64[(v >> 12) & 0x3f];
+          text[t++] = rest > 1 ? Base64[(v >> 6) & 0x3f] : '=';
+          text[t++] = rest > 2 ? Base64[v & 0x3f] : '=';
+        }
+        out.write(std::string_view(text.data(), t));
+      }
+    }
+
+    auto writeTimestamp(Output &out, int64_t sec, uint32_t nsec) -> void
+    {
+      using namespace std::chrono;
+      const auto tp = sys_seconds{seconds{sec}};
+      const auto day = floor<days>(tp);
+      const auto ymd = year_month_day{day};
+      const auto hms = hh_mm_ss{tp - day};
+      auto buf = std::array<char, 48>{};
+      auto p = buf.data();
+      const auto pad = [&p](long long v, int width) {
+        auto digits = std::array<char, 24>{};
+        const auto r = std::to_chars(digits.data(), digits.data() + digits.size(), v < 0 ? -v : v);
+        if (v < 0)
+          *p++ = '-';
+        for (auto n = r.ptr - digits.data(); n < width; ++n)
+          *p++ = '0';
+        p = std::copy(digits.data(), r.ptr, p);
+      };
+      pad(static_cast<int>(ymd.year()), 4);
+      *p++ = '-';
+      pad(static_cast<unsigned>(ymd.month()), 2);
+      *p++ = '-';
+      pad(static_cast<unsigned>(ymd.day()), 2);
+      *p++ = 'T';
+      pad(hms.hours().count(), 2);
+      *p++ = ':';
+      pad(hms.minutes().count(), 2);
+      *p++ = ':';
+      pad(hms.seconds().count(), 2);
+      if (nsec > 0)
+      {
+        *p++ = '.';
+        pad(nsec, 9);
+      }
+      *p++ = 'Z';
+      out.write("{\"$timestamp\":\"");
+      out.write(std::string_view(buf.data(), static_cast<size_t>(p - buf.data())));
+      out.write("\"}");
+    }
+
+    auto writeExt(Input &in, Output &out, size_t len) -> void
+    {
+      const auto type = static_cast<int8_t>(in.get());
+      if (type == TimestampExt && (len == 4 || len == 8 || len == 12))
+      {
+        if (len == 4)
+          return writeTimestamp(out, in.be<uint32_t>(), 0);
+        if (len == 8)
+        {
+          const auto v = in.be<uint64_t>();
+          return writeTimestamp(
+            out, static_cast<int64_t>(v & 0x3ffffffff), static_cast<uint32_t>(v >> 34));
+        }
+        const auto nsec = in.be<uint32_t>();
+        return writeTimestamp(out, static_cast<int64_t>(in.be<uint64_t>()), nsec);
+      }
+      out.write("{\"$ext\":[");
+      out.number(int{type});
+      out.write(",\"");
+      copyBase64(in, out, len);
+      out.write("\"]}");
+    }
+
+    template <typename F>
+    auto writeFloat(Output &out, F v) -> void
+    {
+      if (std::isfinite(v))
+        out.number(v);
+      else
+        out.write("null");
+    }
+
+    struct Level
+    {
+      uint64_t remaining; // elements, or key/value pairs of a map
+      bool map;
+      bool first = true;
+      bool key = true; // a map's next value is a key
+    };
+  } // namespace
+
+  auto toJson(std::istream &st, std::ostream &os) -> void
+  {
+    auto in = Input{st};
+    auto out = Output{os};
+    auto stack = std::vector<Level>{};
+    while (!stack.empty() || !in.atEnd())
+    {
+      auto isKey = false;
+      if (!stack.empty())
+      {
+        auto &l = stack.back();
+        isKey = l.map && l.key;
+        if (!l.map || l.key)
+        {
+          if (!l.first)
+            out.put(',');
+          l.first = false;
+        }
+        else
+          out.put(':');
+      }
+
+      const auto b = in.get();
+      // strings and bin are already quoted
+      const auto quoteKey = isKey && !((b & 0xe0) == 0xa0 || (b >= 0xd9 && b <= 0xdb) ||
+                                       (b >= 0xc4 && b <= 0xc6));
+      if (quoteKey)
+        out.put('"');
+      auto container = false;
+      if (b <= 0x7f)
+        out.number(int{b});
+      else if (b >= 0xe0)
+        out.number(int{static_cast<int8_t>(b)});
+      else if ((b & 0xe0) == 0xa0 || (b >= 0xd9 && b <= 0xdb))
+      {
+        const auto len = (b & 0xe0) == 0xa0 ? size_t{b & 0x1fu}
+                         : b == 0xd9        ? size_t{in.get()}
+                         : b == 0xda        ? size_t{in.be<uint16_t>()}
+                                            : size_t{in.be<uint32_t>()};
+        out.put('"');
+        copyEscaped(in, out, len);
+        out.put('"');
+      }
+      else if ((b & 0xf0) == 0x90 || (b & 0xf0) == 0x80 || b == 0xdc || b == 0xdd || b == 0xde ||
+               b == 0xdf)
+      {
+        if (isKey)
+          throw ParsingError("Map key must be a scalar");
+        const auto map = (b & 0xf0) == 0x80 || b == 0xde || b == 0xdf;
+        const auto n = b < 0xa0           ? uint64_t{b & 0x0fu}
+                       : b == 0xdc || b == 0xde ? uint64_t{in.be<uint16_t>()}
+                                                : uint64_t{in.be<uint32_t>()};
+        out.put(map ? '{' : '[');
+        if (n > 0)
+        {
+          stack.push_back(Level{n, map});
+          container = true;
+        }
+        else
+          out.put(map ? '}' : ']');
+      }
+      else
+        switch (b)
+        {
+        case 0xc0:
+          out.write("null");
+          break;
+        case 0xc2:
+          out.write("false");
+          break;
+        case 0xc3:
+          out.write("true");
+          break;
+        case 0xcc:
+          out.number(in.get());
+          break;
+        case 0xcd:
+          out.number(in.be<uint16_t>());
+          break;
+        case 0xce:
+          out.number(in.be<uint32_t>());
+          break;
+        case 0xcf:
+          out.number(in.be<uint64_t>());
+          break;
+        case 0xd0:
+          out.number(int{static_cast<int8_t>(in.get())});
+          break;
+        case 0xd1:
+          out.number(static_cast<int16_t>(in.be<uint16_t>()));
+          break;
+        case 0xd2:
+          out.number(static_cast<int32_t>(in.be<uint32_t>()));
+          break;
+        case 0xd3:
+          out.number(static_cast<int64_t>(in.be<uint64_t>()));
+          break;
+        case 0xca: {
+          const auto raw = in.be<uint32_t>();
+          auto f = float{};
+          std::memcpy(&f, &raw, sizeof f);
+          writeFloat(out, f);
+          break;
+        }
+        case 0xcb: {
+          const auto raw = in.be<uint64_t>();
+          auto d = double{};
+          std::memcpy(&d, &raw, sizeof d);
+          writeFloat(out, d);
+          break;
+        }
+        case 0xc4:
+        case 0xc5:
+        case 0xc6: {
+          const auto len = b == 0xc4   ? size_t{in.get()}
+                           : b == 0xc5 ? size_t{in.be<uint16_t>()}
+                                       : size_t{in.be<uint32_t>()};
+          out.put('"');
+          copyBase64(in, out, len);
+          out.put('"');
+          break;
+        }
+        case 0xd4:
+        case 0xd5:
+        case 0xd6:
+        case 0xd7:
+        case 0xd8:
+        case 0xc7:
+        case 0xc8:
+        case 0xc9: {
+          if (isKey)
+            throw ParsingError("Map key must be a scalar");
+          const auto len = b >= 0xd4   ? size_t{1} << (b - 0xd4)
+                           : b == 0xc7 ? size_t{in.get()}
+                           : b == 0xc8 ? size_t{in.be<uint16_t>()}
+                                       : size_t{in.be<uint32_t>()};
+          writeExt(in, out, len);
+          break;
+        }
+        default:
+          throw ParsingError("Unknown type byte " + std::to_string(b));
+        }
+      if (quoteKey)
+        out.put('"');
+      if (container)
+        continue;
+
+      // the value is complete: close the containers it completes
+      for (;;)
+      {
+        if (stack.empty())
+        {
+          out.put('\n');
+          break;
+        }
+        auto &l = stack.back();
+        if (l.map && l.key)
+        {
+          l.key = false;
+          break;
+        }
+        l.key = true;
+        if (--l.remaining > 0)
+          break;
+        out.put(l.map ? '}' : ']');
+        stack.pop_back();
+      }
+    }
+  }
+
+  namespace
+  {
+    // msgpack output staged in a buffer, so headers can be back-patched. On a seekable stream the
+    // buffer is flushed as it fills and headers already flushed are patched with seekp.
+    class Sink
+    {
+    public:
+      explicit Sink(std::ostream &st) : os(st), base(st.tellp()), seekable(base != -1) {}
+
+      auto put(uint8_t c) -> void { buf.push_back(static_cast<char>(c)); }
+      auto write(std::string_view v) -> void { buf.append(v); }
+
+      template <typename U>
+      auto be(U v) -> void
+      {
+        char bytes[sizeof(U)];
+        for (size_t i = 0; i < sizeof(U); ++i)
+          bytes[i] = static_cast<char>(v >> (8 * (sizeof(U) - 1 - i)));
+        buf.append(bytes, sizeof bytes);
+      }
+
+      auto header(uint8_t fix, uint8_t b8, uint8_t b16, uint8_t b32, uint8_t fixMax, size_t n)
+        -> void
+      {
+        if (n <= fixMax)
+          put(static_cast<uint8_t>(fix | n));
+        else if (b8 != 0 && n < 0x100)
+        {
+          put(b8);
+          be(static_cast<uint8_t>(n));
+        }
+        else if (n < 0x10000)
+        {
+          put(b16);
+          be(static_cast<uint16_t>(n));
+        }
+        else
+        {
+          put(b32);
+          be(static_cast<uint32_t>(n));
+        }
+      }
+
+      auto uint(uint64_t v) -> void
+      {
+        if (v < 0x80)
+          put(static_cast<uint8_t>(v));
+        else if (v < 0x100)
+        {
+          put(0xcc);
+          be(static_cast<uint8_t>(v));
+        }
+        else if (v < 0x10000)
+        {
+          put(0xcd);
+          be(static_cast<uint16_t>(v));
+        }
+        else if (v < 0x100000000)
+        {
+          put(0xce);
+          be(static_cast<uint32_t>(v));
+        }
+        else
+        {
+          put(0xcf);
+          be(v);
+        }
+      }
+
+      auto sint(int64_t v) -> void
+      {
+        if (v >= 0)
+          uint(static_cast<uint64_t>(v));
+        else if (v >= -32)
+          put(static_cast<uint8_t>(v));
+        else if (v >= INT8_MIN)
+        {
+          put(0xd0);
+          be(static_cast<uint8_t>(v));
+        }
+        else if (v >= INT16_MIN)
+        {
+          put(0xd1);
+          be(static_cast<uint16_t>(v));
+        }
+        else if (v >= INT32_MIN)
+        {
+          put(0xd2);
+          be(static_cast<uint32_t>(v));
+        }
+        else
+        {
+          put(0xd3);
+          be(static_cast<uint64_t>(v));
+        }
+      }
+
+      // Writes a 32-bit container header to be patched; returns its position.
+      auto placeholder(uint8_t b) -> uint64_t
+      {
+        const auto at = flushed + buf.size();
+        put(b);
+        be(uint32_t{0});
+        return at;
+      }
+
+      // Patches the header at at with n. A header still in the buffer is shrunk to the shortest
+      // form, as msgpackSer writes it; one already flushed keeps its 32-bit form.
+      auto patch(uint64_t at, uint32_t n) -> void
+      {
+        char bytes[4] = {static_cast<char>(n >> 24),
+                         static_cast<char>(n >> 16),
+                         static_cast<char>(n >> 8),
+                         static_cast<char>(n)};
+        if (at >= flushed)
+        {
+          const auto pos = static_cast<size_t>(at - flushed);
+          const auto map = static_cast<uint8_t>(buf[pos]) == 0xdf;
+          if (n <= 0x0f)
+            buf.replace(pos, 5, 1, static_cast<char>((map ? 0x80 : 0x90) | n));
+          else if (n < 0x10000)
+          {
+            const char h[] = {static_cast<char>(map ? 0xde : 0xdc), bytes[2], bytes[3]};
+            buf.replace(pos, 5, h, sizeof h);
+          }
+          else
+            std::memcpy(buf.data() + pos + 1, bytes, 4);
+          return;
+        }
+        os.seekp(base + static_cast<std::streamoff>(at + 1));
+        os.write(bytes, 4);
+        os.seekp(base + static_cast<std::streamoff>(flushed));
+      }
+
+      // Called between values; open tells whether containers are still open.
+      auto maybeFlush(bool open) -> void
+      {
+        constexpr auto Chunk = size_t{64 * 1024};
+        if ((!open && !buf.empty()) || (seekable && buf.size() >= Chunk))
+        {
+          os.write(buf.data(), static_cast<std::streamsize>(buf.size()));
+          flushed += buf.size();
+          buf.clear();
+        }
+      }
+
+    private:
+      std::ostream &os;
+      std::ostream::pos_type base;
+      bool seekable;
+      uint64_t flushed = 0;
+      std::string buf;
+    };
+
+    class JsonInput
+    {
+    public:
+      explicit JsonInput(std::istream &st) : in(st) {}
+
+      auto skipWs() -> int
+      {
+        for (;;)
+        {
+          const auto c = in.peek();
+          if (c != ' ' && c != '\n' && c != '\r' && c != '\t')
+            return c;
+          in.get();
+        }
+      }
+
+      auto atEnd() -> bool { return skipWs() == std::char_traits<char>::eof(); }
+
+      auto expect(char c) -> void
+      {
+        if (skipWs() != c)
+          fail();
+        in.get();
+      }
+
+      auto literal(std::string_view word) -> void
+      {
+        for (const auto c : word)
+          if (in.get() != static_cast<uint8_t>(c))
+            fail();
+      }
+
+      [[noreturn]] auto fail() -> void
+      {
+        const auto c = in.peek();
+        if (c == std::char_traits<char>::eof())
+          throw ParsingError("Unexpected EOF");
+        throw ParsingError("Unexpected character '" + std::string(1, static_cast<char>(c)) +
+                           "' in JSON");
+      }
+
+      // Reads a string after its opening quote, unescaped, into s.
+      auto string(std::string &s) -> void
+      {
+        s.clear();
+        for (;;)
+        {
+          const auto avail = in.buffered();
+          auto n = size_t{0};
+          while (n < avail.size() && static_cast<uint8_t>(avail[n]) >= 0x20 && avail[n] != '"' &&
+                 avail[n] != '\\')
+            ++n;
+          s.append(avail.substr(0, n));
+          in.skip(n);
+          if (n == avail.size())
+            continue;
+          const auto c = in.get();
+          if (c == '"')
+            return;
+          if (c < 0x20)
+            throw ParsingError("Control character in JSON string");
+          if (c != '\\')
+          {
+            s.push_back(static_cast<char>(c));
+            continue;
+          }
+          switch (const auto e = in.get())
+          {
+          case '"':
+          case '\\':
+          case '/':
+            s.push_back(static_cast<char>(e));
+            break;
+          case 'b':
+            s.push_back('\b');
+            break;
+          case 'f':
+            s.push_back('\f');
+            break;
+          case 'n':
+            s.push_back('\n');
+            break;
+          case 'r':
+            s.push_back('\r');
+            break;
+          case 't':
+            s.push_back('\t');
+            break;
+          case 'u': {
+            auto cp = hex4();
+            if (cp >= 0xd800 && cp < 0xdc00)
+            {
+              literal("\\u");
+              const auto lo = hex4();
+              if (lo < 0xdc00 || lo >= 0xe000)
+                throw ParsingError("Invalid surrogate pair in JSON string");
+              cp = 0x10000 + ((cp - 0xd800) << 10) + (lo - 0xdc00);
+            }
+            utf8(s, cp);
+            break;
+          }
+          default:
+            throw ParsingError("Invalid escape in JSON string");
+          }
+        }
+      }
+
+      // Reads the characters of a number into buf.
+      auto number(std::array<char, 64> &buf) -> std::string_view
+      {
+        auto n = size_t{0};
+        for (;;)
+        {
+          const auto c = in.peek();
+          if (!((c >= '0' && c <= '9') || c == '-' || c == '+' || c == '.' || c == 'e' ||
+                c == 'E'))
+            break;
+          if (n == buf.size())
+            throw ParsingError("JSON number too long");
+          buf[n++] = static_cast<char>(in.get());
+        }
+        return std::string_view(buf.data(), n);
+      }
+
+      auto get() -> uint8_t { return in.get(); }
+
+    private:
+      auto hex4() -> uint32_t
+      {
+        auto v = uint32_t{0};
+        for (auto i = 0; i < 4; ++i)
+        {
+          const auto c = in.get();
+          const auto d = c >= '0' && c <= '9'   ? c - '0'
+                         : c >= 'a' && c <= 'f' ? c - 'a' + 10
+                         : c >= 'A' && c <= 'F' ? c - 'A' + 10
+                                                : -1;
+          if (d < 0)
+            throw ParsingError("Invalid \\u escape in JSON string");
+          v = v << 4 | static_cast<uint32_t>(d);
+        }
+        return v;
+      }
+
+      static auto utf8(std::string &s, uint32_t cp) -> void
+      {
+        if (cp < 0x80)
+          s.push_back(static_cast<char>(cp));
+        else if (cp < 0x800)
+        {
+          s.push_back(static_cast<char>(0xc0 | cp >> 6));
+          s.push_back(static_cast<char>(0x80 | (cp & 0x3f)));
+        }
+        else if (cp < 0x10000)
+        {
+          s.push_back(static_cast<char>(0xe0 | cp >> 12));
+          s.push_back(static_cast<char>(0x80 | ((cp >> 6) & 0x3f)));
+          s.push_back(static_cast<char>(0x80 | (cp & 0x3f)));
+        }
+        else
+        {
+          s.push_back(static_cast<char>(0xf0 | cp >> 18));
+          s.push_back(static_cast<char>(0x80 | ((cp >> 12) & 0x3f)));
+          s.push_back(static_cast<char>(0x80 | ((cp >> 6) & 0x3f)));
+          s.push_back(static_cast<char>(0x80 | (cp & 0x3f)));
+        }
+      }
+
+      Input in;
+    };
+
+    auto writeStr(Sink &out, std::string_view s) -> void
+    {
+      out.header(0xa0, 0xd9, 0xda, 0xdb, 0x1f, s.size());
+      out.write(s);
+    }
+
+    auto writeNumber(Sink &out, std::string_view text) -> void
+    {
+      const auto isInt = text.find_first_of(".eE") == std::string_view::npos;
+      const auto first = text.data();
+      const auto last = text.data() + text.size();
+      if (isInt && !text.empty() && text[0] == '-')
+      {
+        auto v = int64_t{};
+        if (const auto r = std::from_chars(first, last, v); r.ec == std::errc{} && r.ptr == last)
+          return out.sint(v);
+      }
+      else if (isInt)
+      {
+        auto v = uint64_t{};
+        if (const auto r = std::from_chars(first, last, v); r.ec == std::errc{} && r.ptr == last)
+          return out.uint(v);
+      }
+      auto d = double{};
+      const auto r = std::from_chars(first, last, d);
+      if (r.ec != std::errc{} || r.ptr != last)
+        throw ParsingError("Invalid JSON number " + std::string{text});
+      auto raw = uint64_t{};
+      std::memcpy(&raw, &d, sizeof raw);
+      out.put(0xcb);
+      out.be(raw);
+    }
+
+    auto decodeBase64(std::string_view text) -> std::string
+    {
+      auto r = std::string{};
+      auto acc = uint32_t{0};
+      auto bits = 0;
+      for (const auto c : text)
+      {
+        if (c == '=')
+          break;
+        const auto d = Base64.find(c);
+        if (d == std::string_view::npos)
+          throw ParsingError("Invalid base64 in JSON");
+        acc = acc << 6 | static_cast<uint32_t>(d);
+        bits += 6;
+        if (bits >= 8)
+        {
+          bits -= 8;
+          r.push_back(static_cast<char>(acc >> bits));
+        }
+      }
+      return r;
+    }
+
+    auto writeExtHeader(Sink &out, int8_t type, size_t len) -> void
+    {
+      switch (len)
+      {
+      case 1:
+      case 2:
+      case 4:
+      case 8:
+      case 16:
+        out.put(static_cast<uint8_t>(0xd4 + std::countr_zero(len)));
+        break;
+      default:
+        if (len < 0x100)
+        {
+          out.put(0xc7);
+          out.be(static_cast<uint8_t>(len));
+        }
+        else if (len < 0x10000)
+        {
+          out.put(0xc8);
+          out.be(static_cast<uint16_t>(len));
+        }
+        else
+        {
+          out.put(0xc9);
+          out.be(static_cast<uint32_t>(len));
+        }
+      }
+      out.put(static_cast<uint8_t>(type));
+    }
+
+    // Parses "YYYY-MM-DDTHH:MM:SS[.fraction]Z".
+    auto writeTimestamp(Sink &out, std::string_view text) -> void
+    {
+      using namespace std::chrono;
+      const auto fail = [&text]() -> void {
+        throw ParsingError("Invalid timestamp " + std::string{text});
+      };
+      auto pos = size_t{0};
+      const auto field = [&](size_t width, char sep) {
+        if (pos + width >= text.size())
+          fail();
+        auto v = 0;
+        const auto r = std::from_chars(text.data() + pos, text.data() + pos + width, v);
+        if (r.ptr != text.data() + pos + width || text[pos + width] != sep)
+          fail();
+        pos += width + 1;
+        return v;
+      };
+      auto yearWidth = text.find('-', 1);
+      if (yearWidth == std::string_view::npos)
+        fail();
+      const auto y = field(yearWidth, '-');
+      const auto mo = field(2, '-');
+      const auto d = field(2, 'T');
+      const auto h = field(2, ':');
+      const auto mi = field(2, ':');
+      const auto s = field(2, text.find('.', pos) == pos + 2 ? '.' : 'Z');
+      auto nsec = uint32_t{0};
+      if (text[pos - 1] == '.')
+      {
+        auto digits = 0;
+        for (; pos < text.size() && text[pos] >= '0' && text[pos] <= '9'; ++pos, ++digits)
+          if (digits < 9)
+            nsec = nsec * 10 + static_cast<uint32_t>(text[pos] - '0');
+        for (; digits < 9; ++digits)
+          nsec *= 10;
+        if (pos + 1 != text.size() || text[pos] != 'Z')
+          fail();
+      }
+      else if (pos != text.size())
+        fail();
+      const auto ymd = year{y} / month{static_cast<unsigned>(mo)} / day{static_cast<unsigned>(d)};
+      if (!ymd.ok() || h > 23 || mi > 59 || s > 60)
+        fail();
+      const auto tp = sys_days{ymd} + hours{h} + minutes{mi} + seconds{s};
+      const auto sec = tp.time_since_epoch().count();
+      if (nsec == 0 && sec >= 0 && sec <= UINT32_MAX)
+      {
+        writeExtHeader(out, TimestampExt, 4);
+        out.be(static_cast<uint32_t>(sec));
+      }
+      else if (sec >= 0 && sec < (int64_t{1} << 34))
+      {
+        writeExtHeader(out, TimestampExt, 8);
+        out.be(uint64_t{nsec} << 34 | static_cast<uint64_t>(sec));
+      }
+      else
+      {
+        writeExtHeader(out, TimestampExt, 12);
+        out.be(nsec);
+        out.be(static_cast<uint64_t>(sec));
+      }
+    }
+
+    // The value of {"$timestamp": ...} or {"$ext": ...} after its key.
+    auto writeSpecial(JsonInput &in, Sink &out, std::string_view key, std::string &scratch)
+      -> void
+    {
+      in.expect(':');
+      if (key == "$timestamp")
+      {
+        in.expect('"');
+        in.string(scratch);
+        writeTimestamp(out, scratch);
+      }
+      else
+      {
+        in.expect('[');
+        in.skipWs();
+        auto digits = std::array<char, 64>{};
+        auto type = 0;
+        const auto text = in.number(digits);
+        const auto r = std::from_chars(text.data(), text.data() + text.size(), type);
+        if (r.ptr != text.data() + text.size() || type < -128 || type > 127)
+          throw ParsingError("Invalid ext type " + std::string{text});
+        in.expect(',');
+        in.expect('"');
+        in.string(scratch);
+        const auto data = decodeBase64(scratch);
+        in.expect(']');
+        writeExtHeader(out, static_cast<int8_t>(type), data.size());
+        out.write(data);
+      }
+      in.expect('}');
+    }
+
+    struct Open
+    {
+      uint64_t header;
+      uint32_t count;
+      bool map;
+    };
+  } // namespace
+
+  auto fromJson(std::istream &st, std::ostream &os) -> void
+  {
+    auto in = JsonInput{st};
+    auto out = Sink{os};
+    auto stack = std::vector<Open>{};
+    auto scratch = std::string{};
+    auto digits = std::array<char, 64>{};
+    while (!stack.empty() || !in.atEnd())
+    {
+      auto container = false;
+      switch (in.skipWs())
+      {
+      case '{':
+        in.get();
+        if (in.skipWs() == '}')
+        {
+          in.get();
+          out.put(0x80);
+          break;
+        }
+        in.expect('"');
+        in.string(scratch);
+        if (scratch == "$timestamp" || scratch == "$ext")
+        {
+          writeSpecial(in, out, std::string{scratch}, scratch);
+          break;
+        }
+        stack.push_back(Open{out.placeholder(0xdf), 1, true});
+        writeStr(out, scratch);
+        in.expect(':');
+        container = true;
+        break;
+      case '[':
+        in.get();
+        if (in.skipWs() == ']')
+        {
+          in.get();
+          out.put(0x90);
+          break;
+        }
+        stack.push_back(Open{out.placeholder(0xdd), 0, false});
+        container = true;
+        break;
+      case '"':
+        in.get();
+        in.string(scratch);
+        writeStr(out, scratch);
+        break;
+      case 't':
+        in.literal("true");
+        out.put(0xc3);
+        break;
+      case 'f':
+        in.literal("false");
+        out.put(0xc2);
+        break;
+      case 'n':
+        in.literal("null");
+        out.put(0xc0);
+        break;
+      default: {
+        const auto text = in.number(digits);
+        if (text.empty())
+          in.fail();
+        writeNumber(out, text);
+      }
+      }
+      if (container)
+        continue;
+
+      // the value is complete: read what follows it in the enclosing containers
+      while (!stack.empty())
+      {
+        auto &o = stack.back();
+        if (!o.map)
+          ++o.count;
+        const auto c = in.skipWs();
+        in.get();
+        if (c == ',')
+        {
+          if (o.map)
+          {
+            in.expect('"');
+            in.string(scratch);
+            writeStr(out, scratch);
+            in.expect(':');
+            ++o.count;
+          }
+          break;
+        }
+        if (c != (o.map ? '}' : ']'))
+          throw ParsingError("Unexpected character '" + std::string(1, static_cast<char>(c)) +
+                             "' in JSON");
+        out.patch(o.header, o.count);
+        stack.pop_back();
+      }
+      out.maybeFlush(!stack.empty());
+    }
+  }
+} // namespace msgpack
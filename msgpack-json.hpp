@@ -0,0 +1,27 @@
+// (c) 2025 Mika Pi
+
+#pragma once
+#include <istream>
+#include <ostream>
+
+namespace msgpack
+{
+  // Streaming transcoders between a sequence of msgpack objects and newline-separated JSON
+  // values, working directly on the bytes with memory bounded by nesting depth and the longest
+  // JSON string. Both read `in` to its end.
+  //
+  // Mapping: bin is a base64 string; the timestamp ext (type -1) is {"$timestamp": "<RFC 3339
+  // UTC time>"} and other ext values are {"$ext": [type, "<base64 data>"]}; non-finite floats are
+  // null. Non-string map keys are written as the JSON text of the key in quotes; arrays, maps
+  // and ext are not allowed as keys. Strings are copied as UTF-8 with JSON escapes; a str that
+  // is not valid UTF-8 throws ParsingError.
+  //
+  // fromJson reverses the mapping, writing the shortest encoding of each value. Arrays and
+  // objects get 32-bit headers patched when they end, shrunk to the shortest form if the
+  // container is still staged in memory. A seekable stream is flushed every 64 KiB and a header
+  // already flushed is patched in place, so only containers that large keep the 32-bit form;
+  // otherwise each top-level value is staged until it is complete. Numbers with a fraction or
+  // exponent become float64.
+  auto toJson(std::istream &in, std::ostream &out) -> void;
+  auto fromJson(std::istream &in, std::ostream &out) -> void;
+} // namespace msgpack
@@ -0,0 +1,107 @@
+// (c) 2025 Mika Pi
+
+#include "msgpack-keydict.hpp"
+#include "msgpack.hpp"
+
+namespace msgpack
+{
+  namespace
+  {
+    auto dictSlot(std::ios_base &st) -> void *&
+    {
+      static const auto index = std::ios_base::xalloc();
+      return st.pword(index);
+    }
+  } // namespace
+
+  KeyDict::KeyDict(size_t aMaxKeys) : maxKeys(aMaxKeys) {}
+
+  auto KeyDict::write(std::ostream &st, std::string_view name, std::string_view encoded) -> void
+  {
+    if (const auto it = ids.find(name); it != ids.end())
+    {
+      const auto id = it->second;
+      char ref[6];
+      auto n = size_t{};
+      if (id < 0x100)
+      {
+        ref[0] = static_cast<char>(0xd4);
+        ref[1] = static_cast<char>(ReferenceExt);
+        ref[2] = static_cast<char>(id);
+        n = 3;
+      }
+      else if (id < 0x10000)
+      {
+        ref[0] = static_cast<char>(0xd5);
+        ref[1] = static_cast<char>(ReferenceExt);
+        ref[2] = static_cast<char>(id >> 8);
+        ref[3] = static_cast<char>(id);
+        n = 4;
+      }
+      else
+      {
+        ref[0] = static_cast<char>(0xd6);
+        ref[1] = static_cast<char>(ReferenceExt);
+        ref[2] = static_cast<char>(id >> 24);
+        ref[3] = static_cast<char>(id >> 16);
+        ref[4] = static_cast<char>(id >> 8);
+        ref[5] = static_cast<char>(id);
+        n = 6;
+      }
+      st.write(ref, static_cast<std::streamsize>(n));
+      return;
+    }
+    if (names.size() >= maxKeys || name.size() > 0xff)
+    {
+      st.write(encoded.data(), static_cast<std::streamsize>(encoded.size()));
+      return;
+    }
+    const auto id = static_cast<uint32_t>(names.size());
+    ids.emplace(names.emplace_back(name), id);
+    st.put(static_cast<char>(0xc7));
+    st.put(static_cast<char>(name.size()));
+    st.put(static_cast<char>(DefinitionExt));
+    st.write(name.data(), static_cast<std::streamsize>(name.size()));
+  }
+
+  auto KeyDict::define(std::string_view name) -> std::string_view
+  {
+    if (names.size() >= maxKeys)
+      throw ParsingError("Key dictionary overflow");
+    return names.emplace_back(name);
+  }
+
+  auto KeyDict::lookup(uint32_t id) const -> std::string_view
+  {
+    if (id >= names.size())
+      throw ParsingError("Undefined key dictionary id " + std::to_string(id));
+    return names[id];
+  }
+
+  auto KeyDict::size() const -> size_t
+  {
+    return names.size();
+  }
+
+  auto keyDict(KeyDict &d) -> KeyDictManip
+  {
+    return KeyDictManip{&d};
+  }
+
+  auto noKeyDict(std::ios_base &st) -> std::ios_base &
+  {
+    dictSlot(st) = nullptr;
+    return st;
+  }
+
+  auto operator<<(std::ostream &st, KeyDictManip m) -> std::ostream &
+  {
+    dictSlot(st) = m.dict;
+    return st;
+  }
+
+  auto keyDictOf(std::ios_base &st) -> KeyDict *
+  {
+    return static_cast<KeyDict *>(dictSlot(st));
+  }
+} // namespace msgpack
@@ -0,0 +1,57 @@
+// (c) 2025 Mika Pi
+
+#pragma once
+#include <cstdint>
+#include <deque>
+#include <ostream>
+#include <string>
+#include <string_view>
+#include <unordered_map>
+
+namespace msgpack
+{
+  // Dictionary of struct field names shared by the two ends of a stream. The encoder defines a
+  // name the first time it writes it, as an ext8 of type DefinitionExt holding the name, and
+  // refers to it afterwards by id, as a fixext 1, 2 or 4 of type ReferenceExt holding the id in
+  // big endian. Ids count definitions from 0. Both decode to the plain name. Use one KeyDict
+  // per direction and stream, on each end, for the lifetime of the stream.
+  class KeyDict
+  {
+  public:
+    static constexpr int8_t DefinitionExt = 0x4b;
+    static constexpr int8_t ReferenceExt = 0x6b;
+
+    // Names beyond maxKeys are written as plain strings; a decoding dictionary needs at least the
+    // maxKeys of the encoding one.
+    explicit KeyDict(size_t maxKeys = 4096);
+    KeyDict(const KeyDict &) = delete;
+    auto operator=(const KeyDict &) -> KeyDict & = delete;
+
+    // Writes name as a definition or reference; encoded is name as a plain msgpack str.
+    auto write(std::ostream &st, std::string_view name, std::string_view encoded) -> void;
+    // Decoding: adds a definition, resolves a reference. The views stay valid while the
+    // dictionary lives.
+    auto define(std::string_view name) -> std::string_view;
+    auto lookup(uint32_t id) const -> std::string_view;
+    auto size() const -> size_t;
+
+  private:
+    size_t maxKeys;
+    std::deque<std::string> names;
+    std::unordered_map<std::string_view, uint32_t> ids;
+  };
+
+  struct KeyDictManip
+  {
+    KeyDict *dict;
+  };
+
+  // st << msgpack::keyDict(d) encodes the field names of SER_PROPS structs written to st through
+  // d; st << msgpack::noKeyDict goes back to plain names. Decode with msgpack::Blob{bytes, d'}.
+  // Streams using a dictionary are encoded serially by msgpackSerParallel.
+  auto keyDict(KeyDict &) -> KeyDictManip;
+  auto noKeyDict(std::ios_base &st) -> std::ios_base &;
+  auto operator<<(std::ostream &st, KeyDictManip) -> std::ostream &;
+  // Dictionary attached to st, or nullptr.
+  auto keyDictOf(std::ios_base &st) -> KeyDict *;
+} // namespace msgpack
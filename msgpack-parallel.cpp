@@ -0,0 +1,112 @@
+// (c) 2025 Mika Pi
+
+#include "msgpack-parallel.hpp"
+#include <algorithm>
+#include <atomic>
+#include <exception>
+#include <mutex>
+#include <thread>
+
+namespace msgpack
+{
+  auto parallelFor(size_t n, size_t threads, const std::function<void(size_t, size_t)> &fn)
+    -> void
+  {
+    if (threads == 0)
+      threads = std::max(1u, std::thread::hardware_concurrency());
+    threads = std::min(threads, n);
+    if (threads <= 1)
+    {
+      if (n > 0)
+        fn(0, n);
+      return;
+    }
+
+    // several chunks per worker for load balancing, but not so small that the counter is hot
+    const auto chunk = std::max<size_t>(1, n / (threads * 8));
+    auto next = std::atomic<size_t>{0};
+    auto error = std::exception_ptr{};
+    auto errorMutex = std::mutex{};
+    const auto worker = [&]() {
+      for (;;)
+      {
+        const auto begin = next.fetch_add(chunk, std::memory_order_relaxed);
+        if (begin >= n)
+          return;
+        try
+        {
+          fn(begin, std::min(n, begin + chunk));
+        }
+        catch (...)
+        {
+          auto lock = std::lock_guard{errorMutex};
+          if (!error)
+            error = std::current_exception();
+          next.store(n, std::memory_order_relaxed);
+          return;
+        }
+      }
+    };
+    {
+      auto pool = std::vector<std::jthread>{};
+      pool.reserve(threads - 1);
+      for (size_t i = 1; i < threads; ++i)
+        pool.emplace_back(worker);
+      worker();
+    }
+    if (error)
+      std::rethrow_exception(error);
+  }
+
+  auto arrayElements(std::span<const std::byte> in) -> std::vector<std::span<const std::byte>>
+  {
+    if (in.empty())
+      throw ParsingError("Unexpected EOF");
+    const auto b = static_cast<uint8_t>(in[0]);
+    auto n = size_t{0};
+    auto hdr = size_t{1};
+    if ((b & 0xf0) == 0x90)
+      n = b & 0x0f;
+    else if (b == 0xdc)
+    {
+      if (in.size() < 3)
+        throw ParsingError("Unexpected EOF");
+      n = static_cast<size_t>(in[1]) << 8 | static_cast<size_t>(in[2]);
+      hdr = 3;
+    }
+    else if (b == 0xdd)
+    {
+      if (in.size() < 5)
+        throw ParsingError("Unexpected EOF");
+      n = static_cast<size_t>(in[1]) << 24 | static_cast<size_t>(in[2]) << 16 |
+          static_cast<size_t>(in[3]) << 8 | static_cast<size_t>(in[4]);
+      hdr = 5;
+    }
+    else
+      throw ParsingError("Expected a top-level array");
+
+    auto r = std::vector<std::span<const std::byte>>{};
+    r.reserve(std::min(n, in.size()));
+    auto cur = in.subspan(hdr);
+    for (size_t i = 0; i < n; ++i)
+    {
+      const auto rem = skip(cur);
+      r.push_back(cur.first(cur.size() - rem.size()));
+      cur = rem;
+    }
+    if (!cur.empty())
+      throw ParsingError("Extra bytes after top-level object");
+    return r;
+  }
+
+  auto parallelParse(std::span<const std::byte> in, size_t threads) -> Array
+  {
+    const auto elems = arrayElements(in);
+    auto r = Array(elems.size());
+    parallelFor(elems.size(), threads, [&](size_t begin, size_t end) {
+      for (auto i = begin; i < end; ++i)
+        r[i] = std::move(Blob{elems[i]}.val);
+    });
+    return r;
+  }
+} // namespace msgpack
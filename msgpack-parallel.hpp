@@ -0,0 +1,99 @@
+// (c) 2025 Mika Pi
+
+#pragma once
+#include <functional>
+#include <iterator>
+#include <span>
+#include <sstream>
+#include <thread>
+#include <vector>
+
+#include "msgpack-ser.hpp"
+#include "msgpack.hpp"
+
+namespace msgpack
+{
+  // Calls fn(begin, end) for contiguous chunks covering [0, n). Chunks are handed out on demand
+  // to up to `threads` workers (0 means one per hardware thread), so a slow chunk does not hold
+  // up the others. The first exception thrown by fn is rethrown after all workers are done.
+  auto parallelFor(size_t n, size_t threads, const std::function<void(size_t, size_t)> &fn)
+    -> void;
+
+  // Byte ranges of the elements of the top-level array in `in`, found by skip-scanning.
+  auto arrayElements(std::span<const std::byte> in) -> std::vector<std::span<const std::byte>>;
+
+  // Decodes the top-level array in `in` on multiple threads. Strings and bins in the result point
+  // into `in`.
+  auto parallelParse(std::span<const std::byte> in, size_t threads = 0) -> Array;
+} // namespace msgpack
+
+// Decodes the top-level array in `in` straight into v on multiple threads, preserving order.
+template <typename T>
+auto msgpackDeserParallel(std::span<const std::byte> in, std::vector<T> &v, size_t threads = 0)
+  -> void
+{
+  const auto elems = msgpack::arrayElements(in);
+  v.resize(elems.size());
+  msgpack::parallelFor(elems.size(), threads, [&](size_t begin, size_t end) {
+    for (auto i = begin; i < end; ++i)
+      msgpackDeser(msgpack::Blob{elems[i]}.val, v[i]);
+  });
+}
+
+// Serializes a vector or a map with elements encoded by up to `threads` workers (0 means one per
+// hardware thread) into per-chunk buffers, which are then written to st in order. The output is
+// byte-identical to msgpackSer(st, v).
+template <typename C>
+auto msgpackSerParallel(std::ostream &st, const C &v, size_t threads = 0) -> void
+{
+  constexpr auto IsMap = requires { typename C::mapped_type; };
+  constexpr auto MinParallel = size_t{1024};
+  // dictionary definitions depend on encoding order, canonical maps are sorted as a whole
+  if (v.size() < MinParallel || msgpack::keyDictOf(st) ||
+      (IsMap && (InternalMsgPack::serFlags(st) & InternalMsgPack::Canonical)))
+  {
+    msgpackSer(st, v);
+    return;
+  }
+
+  if (threads == 0)
+    threads = std::max(1u, std::thread::hardware_concurrency());
+  const auto chunks = std::min(v.size() / (MinParallel / 4), threads * 4);
+  auto starts = std::vector<typename C::const_iterator>{};
+  starts.reserve(chunks + 1);
+  // one pass over the container: advancing from begin() per chunk is quadratic for maps
+  auto cursor = std::begin(v);
+  auto at = size_t{0};
+  for (size_t c = 0; c <= chunks; ++c)
+  {
+    const auto next = c * v.size() / chunks;
+    std::advance(cursor, static_cast<ptrdiff_t>(next - at));
+    at = next;
+    starts.push_back(cursor);
+  }
+
+  auto bufs = std::vector<std::string>(chunks);
+  msgpack::parallelFor(chunks, threads, [&](size_t begin, size_t end) {
+    for (auto c = begin; c < end; ++c)
+    {
+      auto sst = std::ostringstream{};
+      sst.copyfmt(st);
+      for (auto it = starts[c]; it != starts[c + 1]; ++it)
+        if constexpr (IsMap)
+        {
+          InternalMsgPack::msgpackSerVal(sst, it->first);
+          msgpackSer(sst, it->second);
+        }
+        else
+          msgpackSer(sst, *it);
+      bufs[c] = std::move(sst).str();
+    }
+  });
+
+  if constexpr (IsMap)
+    InternalMsgPack::msgpackSerMapHeader(st, v.size());
+  else
+    InternalMsgPack::msgpackSerArrayHeader(st, v.size());
+  for (const auto &b : bufs)
+    st.write(b.data(), static_cast<std::streamsize>(b.size()));
+}
@@ -0,0 +1,198 @@
+// (c) 2025 Mika Pi
+
+#include "msgpack-record.hpp"
+#include "msgpack-parallel.hpp"
+#include <algorithm>
+#include <cerrno>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <system_error>
+#include <unistd.h>
+
+namespace msgpack
+{
+  namespace
+  {
+    constexpr auto TrailerSize = size_t{9};
+
+    auto getUInt(const Map &m, std::string_view key) -> uint64_t
+    {
+      for (const auto &e : m)
+        if (std::holds_alternative<std::string_view>(e.first) &&
+            std::get<std::string_view>(e.first) == key)
+        {
+          auto r = uint64_t{};
+          InternalMsgPack::msgpackDeserVal(e.second, r);
+          return r;
+        }
+      throw ParsingError("Record index has no " + std::string{key});
+    }
+  } // namespace
+
+  RecordWriter::RecordWriter(const std::string &path, size_t aStride)
+    : st(&buf), stride(std::max<size_t>(1, aStride))
+  {
+    if (!buf.file.open(path, std::ios::out | std::ios::binary | std::ios::trunc))
+      throw std::system_error(errno, std::generic_category(), "Cannot open " + path);
+  }
+
+  RecordWriter::~RecordWriter()
+  {
+    try
+    {
+      close();
+    }
+    catch (...)
+    {
+    }
+  }
+
+  auto RecordWriter::close() -> void
+  {
+    if (closed)
+      return;
+    closed = true;
+    const auto indexPos = buf.pos;
+    InternalMsgPack::msgpackSerMapHeader(st, 4);
+    InternalMsgPack::msgpackSerVal(st, "msgpackRecordIndex");
+    msgpackSer(st, 1);
+    InternalMsgPack::msgpackSerVal(st, "count");
+    msgpackSer(st, count);
+    InternalMsgPack::msgpackSerVal(st, "stride");
+    msgpackSer(st, stride);
+    InternalMsgPack::msgpackSerVal(st, "offsets");
+    msgpackSer(st, offsets);
+    st.put(static_cast<char>(0xcf));
+    for (int i = 56; i >= 0; i -= 8)
+      st.put(static_cast<char>(indexPos >> i));
+    if (!st || !buf.file.close())
+      throw std::runtime_error("Cannot write record index");
+  }
+
+  RecordWriter::Buf::~Buf() = default;
+
+  auto RecordWriter::Buf::overflow(int_type ch) -> int_type
+  {
+    if (traits_type::eq_int_type(ch, traits_type::eof()))
+      return traits_type::not_eof(ch);
+    if (traits_type::eq_int_type(file.sputc(traits_type::to_char_type(ch)), traits_type::eof()))
+      return traits_type::eof();
+    ++pos;
+    return ch;
+  }
+
+  auto RecordWriter::Buf::xsputn(const char *s, std::streamsize n) -> std::streamsize
+  {
+    const auto r = file.sputn(s, n);
+    pos += static_cast<uint64_t>(r);
+    return r;
+  }
+
+  RecordReader::RecordReader(const std::string &path)
+  {
+    const auto fd = ::open(path.c_str(), O_RDONLY | O_CLOEXEC);
+    if (fd < 0)
+      throw std::system_error(errno, std::generic_category(), "Cannot open " + path);
+    struct stat sb;
+    if (::fstat(fd, &sb) != 0)
+    {
+      const auto err = errno;
+      ::close(fd);
+      throw std::system_error(err, std::generic_category(), "Cannot stat " + path);
+    }
+    const auto size = static_cast<size_t>(sb.st_size);
+    if (size < TrailerSize)
+    {
+      ::close(fd);
+      throw ParsingError("Record file is too short");
+    }
+    const auto p = ::mmap(nullptr, size, PROT_READ, MAP_PRIVATE, fd, 0);
+    ::close(fd);
+    if (p == MAP_FAILED)
+      throw std::system_error(errno, std::generic_category(), "Cannot map " + path);
+    data = std::span{static_cast<const std::byte *>(p), size};
+
+    try
+    {
+      const auto trailer = Blob{data.last(TrailerSize)};
+      auto indexPos = uint64_t{};
+      InternalMsgPack::msgpackDeserVal(trailer.val, indexPos);
+      if (indexPos > size - TrailerSize)
+        throw ParsingError("Record index offset is out of range");
+      records = data.first(indexPos);
+      const auto index = Blob{data.subspan(indexPos, size - TrailerSize - indexPos)};
+      if (!std::holds_alternative<Map>(index.val))
+        throw ParsingError("Record index is not a map");
+      const auto &m = std::get<Map>(index.val);
+      if (getUInt(m, "msgpackRecordIndex") != 1)
+        throw ParsingError("Unsupported record index version");
+      count = getUInt(m, "count");
+      stride = getUInt(m, "stride");
+      for (const auto &e : m)
+        if (std::holds_alternative<std::string_view>(e.first) &&
+            std::get<std::string_view>(e.first) == "offsets")
+          InternalMsgPack::msgpackDeserVal(e.second, offsets);
+      if (stride == 0 || offsets.size() != (count + stride - 1) / stride)
+        throw ParsingError("Record index is inconsistent");
+      for (const auto o : offsets)
+        if (o >= indexPos)
+          throw ParsingError("Record offset is out of range");
+    }
+    catch (...)
+    {
+      ::munmap(const_cast<std::byte *>(data.data()), data.size());
+      throw;
+    }
+  }
+
+  RecordReader::~RecordReader()
+  {
+    ::munmap(const_cast<std::byte *>(data.data()), data.size());
+  }
+
+  auto RecordReader::size() const -> size_t
+  {
+    return count;
+  }
+
+  auto RecordReader::record(size_t i) const -> std::span<const std::byte>
+  {
+    if (i >= count)
+      throw std::out_of_range("Record " + std::to_string(i) + " of " + std::to_string(count));
+    auto cur = records.subspan(offsets[i / stride]);
+    for (auto k = i % stride; k > 0; --k)
+      cur = skip(cur);
+    return cur.first(cur.size() - skip(cur).size());
+  }
+
+  auto RecordReader::blob(size_t i) const -> Blob
+  {
+    return Blob{record(i)};
+  }
+
+  auto RecordReader::scan(size_t first,
+                          size_t last,
+                          const std::function<void(size_t, std::span<const std::byte>)> &fn,
+                          size_t threads) const -> void
+  {
+    last = std::min(last, count);
+    if (first >= last)
+      return;
+    const auto firstBlock = first / stride;
+    const auto lastBlock = (last - 1) / stride + 1;
+    parallelFor(lastBlock - firstBlock, threads, [&](size_t begin, size_t end) {
+      for (auto b = firstBlock + begin; b < firstBlock + end; ++b)
+      {
+        auto cur = records.subspan(offsets[b]);
+        for (auto i = b * stride; i < std::min(last, (b + 1) * stride); ++i)
+        {
+          const auto rem = skip(cur);
+          if (i >= first)
+            fn(i, cur.first(cur.size() - rem.size()));
+          cur = rem;
+        }
+      }
+    });
+  }
+} // namespace msgpack
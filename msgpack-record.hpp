@@ -0,0 +1,93 @@
+// (c) 2025 Mika Pi
+
+#pragma once
+#include <cstdint>
+#include <fstream>
+#include <functional>
+#include <span>
+#include <string>
+#include <vector>
+
+#include "msgpack-ser.hpp"
+#include "msgpack.hpp"
+
+namespace msgpack
+{
+  // Record file layout: the records as plain back-to-back msgpack objects, followed by an index
+  // map {"msgpackRecordIndex": 1, "count": N, "stride": K, "offsets": [...]} holding the byte
+  // offset of every K-th record, followed by a uint64 (0xcf + 8 bytes) with the offset of the
+  // index map. Tools that read a msgpack stream see the records, then the index and the offset.
+  class RecordWriter
+  {
+  public:
+    explicit RecordWriter(const std::string &path, size_t stride = 1);
+    ~RecordWriter();
+    RecordWriter(const RecordWriter &) = delete;
+    auto operator=(const RecordWriter &) -> RecordWriter & = delete;
+
+    template <typename T>
+    auto write(const T &v) -> void
+    {
+      if (count % stride == 0)
+        offsets.push_back(buf.pos);
+      msgpackSer(st, v);
+      ++count;
+    }
+    // Writes the index. Called by the destructor if not called explicitly.
+    auto close() -> void;
+
+  private:
+    class Buf final : public std::streambuf
+    {
+    public:
+      ~Buf() final;
+      std::filebuf file;
+      uint64_t pos = 0;
+
+    protected:
+      auto overflow(int_type ch) -> int_type final;
+      auto xsputn(const char *s, std::streamsize n) -> std::streamsize final;
+    };
+
+    Buf buf;
+    std::ostream st;
+    size_t stride;
+    uint64_t count = 0;
+    std::vector<uint64_t> offsets;
+    bool closed = false;
+  };
+
+  // Memory-maps a record file. Records are located in O(1) for a stride of 1, otherwise by
+  // skipping at most stride - 1 records from the nearest indexed one.
+  class RecordReader
+  {
+  public:
+    explicit RecordReader(const std::string &path);
+    ~RecordReader();
+    RecordReader(const RecordReader &) = delete;
+    auto operator=(const RecordReader &) -> RecordReader & = delete;
+
+    auto size() const -> size_t;
+    auto record(size_t i) const -> std::span<const std::byte>;
+    auto blob(size_t i) const -> Blob;
+    // Borrowing members of v point into the mapping and stay valid while the reader is alive.
+    template <typename T>
+    auto read(size_t i, T &v) const -> void
+    {
+      msgpackDeser(blob(i).val, v);
+    }
+    // Calls fn(index, bytes) for every record in [first, last) on up to `threads` workers
+    // (0 means one per hardware thread). Calls may come in any order.
+    auto scan(size_t first,
+              size_t last,
+              const std::function<void(size_t, std::span<const std::byte>)> &fn,
+              size_t threads = 0) const -> void;
+
+  private:
+    std::span<const std::byte> data;
+    std::span<const std::byte> records;
+    size_t count = 0;
+    size_t stride = 1;
+    std::vector<uint64_t> offsets;
+  };
+} // namespace msgpack
@@ -0,0 +1,295 @@
+// (c) 2025 Mika Pi
+
+#include "msgpack-ring.hpp"
+#include <algorithm>
+#include <atomic>
+#include <bit>
+#include <cerrno>
+#include <cstring>
+#include <fcntl.h>
+#include <linux/futex.h>
+#include <stdexcept>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <sys/syscall.h>
+#include <system_error>
+#include <unistd.h>
+
+namespace msgpack
+{
+  namespace
+  {
+    constexpr auto Magic = uint64_t{0x6d73677072696e67}; // "msgpring"
+    // Bytes before each message: its size, padded to keep messages 8-byte aligned.
+    constexpr auto FrameHeader = uint64_t{8};
+    // Size of a frame telling the consumer to continue at the start of the buffer.
+    constexpr auto WrapMarker = UINT32_MAX;
+    constexpr auto MaxCapacity = size_t{1} << 31;
+    // Polls before a waiting side goes to sleep. A pause takes up to about 140 cycles on recent
+    // x86, so this is some tens of microseconds.
+    constexpr auto SpinCount = 1000;
+
+    auto throwErrno(const char *what) -> void
+    {
+      throw std::system_error{errno, std::generic_category(), what};
+    }
+
+    auto align(uint64_t n) -> uint64_t
+    {
+      return (n + FrameHeader - 1) & ~(FrameHeader - 1);
+    }
+
+    auto pause() -> void
+    {
+#if defined(__x86_64__) || defined(__i386__)
+      __builtin_ia32_pause();
+#endif
+    }
+
+    // The futexes are shared between processes, which std::atomic::wait() does not support.
+    auto futexWait(std::atomic<uint32_t> &word, uint32_t seen) -> void
+    {
+      const auto p = reinterpret_cast<uint32_t *>(&word);
+      syscall(SYS_futex, p, FUTEX_WAIT, seen, nullptr, nullptr, 0);
+    }
+
+    auto futexWake(std::atomic<uint32_t> &word) -> void
+    {
+      const auto p = reinterpret_cast<uint32_t *>(&word);
+      syscall(SYS_futex, p, FUTEX_WAKE, 1, nullptr, nullptr, 0);
+    }
+  } // namespace
+
+  // One side waits for `ready` by reading seq, announcing itself in waiting and checking ready
+  // again before sleeping; the other side changes the state ready checks, bumps seq and wakes
+  // it if it announced itself. Everything is sequentially consistent, so either the waiting
+  // side sees the change or the other side sees it waiting.
+  struct Ring::Shared
+  {
+    struct Event
+    {
+      template <typename F>
+      auto wait(F ready) -> void
+      {
+        for (auto i = 0; i < SpinCount; ++i)
+        {
+          if (ready())
+            return;
+          pause();
+        }
+        for (;;)
+        {
+          const auto seen = seq.load();
+          waiting.store(1);
+          if (ready())
+            break;
+          futexWait(seq, seen);
+        }
+        waiting.store(0);
+      }
+
+      auto notify() -> void
+      {
+        seq.fetch_add(1);
+        if (waiting.load() != 0)
+          futexWake(seq);
+      }
+
+      std::atomic<uint32_t> seq{0};
+      std::atomic<uint32_t> waiting{0};
+    };
+
+    // Messages start on the next cache line.
+    static constexpr auto dataOffset() -> size_t { return (sizeof(Shared) + 63) & ~size_t{63}; }
+
+    std::atomic<uint64_t> magic{0};
+    uint64_t capacity;
+    alignas(64) std::atomic<uint64_t> head{0};
+    Event space; // the consumer freed space
+    alignas(64) std::atomic<uint64_t> tail{0};
+    Event data; // the producer published a message
+  };
+
+  static_assert(std::atomic<uint64_t>::is_always_lock_free);
+  static_assert(std::atomic<uint32_t>::is_always_lock_free);
+
+  auto Ring::create(const std::string &name, size_t capacity) -> Ring
+  {
+    return Ring{name, capacity, true};
+  }
+
+  auto Ring::open(const std::string &name) -> Ring
+  {
+    return Ring{name, 0, false};
+  }
+
+  auto Ring::unlink(const std::string &name) -> void
+  {
+    if (shm_unlink(name.c_str()) != 0)
+      throwErrno("shm_unlink");
+  }
+
+  Ring::Ring(const std::string &name, size_t capacity, bool create)
+  {
+    if (create && (capacity == 0 || capacity > MaxCapacity))
+      throw std::invalid_argument("Ring capacity must be between 1 and 2^31 bytes");
+    const auto fd = shm_open(name.c_str(), create ? O_RDWR | O_CREAT | O_EXCL : O_RDWR, 0600);
+    if (fd == -1)
+      throwErrno("shm_open");
+    try
+    {
+      if (create)
+      {
+        capacity = std::bit_ceil(std::max(capacity, size_t{64}));
+        mapped = Shared::dataOffset() + capacity;
+        if (ftruncate(fd, static_cast<off_t>(mapped)) != 0)
+          throwErrno("ftruncate");
+      }
+      else
+      {
+        struct stat s;
+        if (fstat(fd, &s) != 0)
+          throwErrno("fstat");
+        mapped = static_cast<size_t>(s.st_size);
+        if (mapped < Shared::dataOffset())
+          throw std::runtime_error("Not a msgpack ring: " + name);
+      }
+      auto *p = mmap(nullptr, mapped, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+      if (p == MAP_FAILED)
+        throwErrno("mmap");
+      close(fd);
+      shared = static_cast<Shared *>(p);
+    }
+    catch (...)
+    {
+      close(fd);
+      if (create)
+        shm_unlink(name.c_str());
+      throw;
+    }
+
+    if (create)
+    {
+      new (shared) Shared{};
+      shared->capacity = capacity;
+      shared->magic.store(Magic);
+    }
+    else if (shared->magic.load() != Magic || shared->capacity + Shared::dataOffset() != mapped)
+    {
+      munmap(shared, mapped);
+      throw std::runtime_error("Not a msgpack ring: " + name);
+    }
+    data = reinterpret_cast<std::byte *>(shared) + Shared::dataOffset();
+    mask = shared->capacity - 1;
+    head = shared->head.load();
+    tail = shared->tail.load();
+  }
+
+  Ring::~Ring()
+  {
+    munmap(shared, mapped);
+  }
+
+  auto Ring::front() -> std::span<const std::byte>
+  {
+    for (;;)
+    {
+      if (const auto r = tryFront(); !r.empty())
+        return r;
+      shared->data.wait([this] { return shared->tail.load() != head; });
+    }
+  }
+
+  auto Ring::tryFront() -> std::span<const std::byte>
+  {
+    while (shared->tail.load() != head)
+    {
+      const auto at = head & mask;
+      auto size = uint32_t{};
+      std::memcpy(&size, data + at, sizeof(size));
+      if (size != WrapMarker)
+        return {data + at + FrameHeader, size};
+      head += mask + 1 - at;
+      shared->head.store(head);
+      shared->space.notify();
+    }
+    return {};
+  }
+
+  auto Ring::pop() -> void
+  {
+    const auto msg = tryFront();
+    if (msg.empty())
+      throw std::logic_error("Ring::pop() on an empty ring");
+    head += FrameHeader + align(msg.size());
+    shared->head.store(head);
+    shared->space.notify();
+  }
+
+  auto Ring::space() -> std::span<std::byte>
+  {
+    const auto at = tail & mask;
+    const auto free = mask + 1 - (tail - shared->head.load());
+    const auto n = std::min(mask + 1 - at, free);
+    if (n <= FrameHeader)
+      return {};
+    return {data + at + FrameHeader, static_cast<size_t>(n - FrameHeader)};
+  }
+
+  auto Ring::commit(size_t size) -> void
+  {
+    const auto n = static_cast<uint32_t>(size);
+    std::memcpy(data + (tail & mask), &n, sizeof(n));
+    tail += FrameHeader + align(size);
+    shared->tail.store(tail);
+    shared->data.notify();
+  }
+
+  auto Ring::copy(std::string_view msg, bool wait) -> bool
+  {
+    if (!makeRoom(msg.size(), wait))
+      return false;
+    std::memcpy(space().data(), msg.data(), msg.size());
+    commit(msg.size());
+    return true;
+  }
+
+  auto Ring::makeRoom(size_t size, bool wait) -> bool
+  {
+    const auto needed = FrameHeader + align(size);
+    if (needed > mask + 1)
+      throw std::length_error("Message larger than the ring");
+    for (;;)
+    {
+      const auto at = tail & mask;
+      const auto free = mask + 1 - (tail - shared->head.load());
+      if (std::min(mask + 1 - at, free) >= needed)
+        return true;
+      if (at != 0 && free >= mask + 1 - at)
+      {
+        // the rest of the buffer is free but too small; the message goes at the start
+        std::memcpy(data + at, &WrapMarker, sizeof(WrapMarker));
+        tail += mask + 1 - at;
+        shared->tail.store(tail);
+        shared->data.notify();
+        continue;
+      }
+      if (!wait)
+        return false;
+      // room for the message here, or for wrapping around first
+      const auto target = std::min(needed, mask + 1 - at);
+      shared->space.wait([&] { return mask + 1 - (tail - shared->head.load()) >= target; });
+    }
+  }
+
+  auto Ring::Buf::reset(std::span<std::byte> area) -> void
+  {
+    auto *p = reinterpret_cast<char *>(area.data());
+    setp(p, p + area.size());
+  }
+
+  auto Ring::Buf::used() const -> size_t
+  {
+    return static_cast<size_t>(pptr() - pbase());
+  }
+} // namespace msgpack
@@ -0,0 +1,115 @@
+// (c) 2025 Mika Pi
+
+#pragma once
+#include "msgpack-ser.hpp"
+#include <cstddef>
+#include <cstdint>
+#include <ostream>
+#include <span>
+#include <sstream>
+#include <streambuf>
+#include <string>
+#include <string_view>
+
+namespace msgpack
+{
+  // Queue of messages in a POSIX shared memory segment, between one producer and one consumer
+  // process on the same host. The producer serializes straight into the ring and the consumer
+  // parses messages where they lie, so a message is never copied:
+  //   auto out = msgpack::Ring::create("/quotes", 1 << 20);
+  //   out.push(quote);
+  //
+  //   auto in = msgpack::Ring::open("/quotes");
+  //   msgpackDeser(msgpack::Blob{in.front()}.val, quote);
+  //   in.pop();
+  // A message that does not fit in the free space is serialized once more into a local buffer and
+  // copied in when the consumer has made room for it. The two sides only share atomic positions.
+  // A side that has to wait spins for a moment and then sleeps on a futex, so no system call is
+  // made while the other side keeps up.
+  class Ring
+  {
+  public:
+    // Creates the segment `name` (see shm_open) with room for `capacity` bytes of messages,
+    // rounded up to a power of two. Each message takes 8 more bytes, rounded up to 8.
+    static auto create(const std::string &name, size_t capacity) -> Ring;
+    // Maps a segment made by create().
+    static auto open(const std::string &name) -> Ring;
+    // Removes the name of a segment; rings that have it open are not affected.
+    static auto unlink(const std::string &name) -> void;
+
+    ~Ring();
+    Ring(const Ring &) = delete;
+    auto operator=(const Ring &) -> Ring & = delete;
+
+    // Producer side. Serializes v into the ring, waiting for room if it is full. A message that
+    // does not fit in the empty ring throws std::length_error.
+    template <typename T>
+    auto push(const T &v) -> void
+    {
+      write(v, true);
+    }
+
+    // As push(), returning false instead of waiting.
+    template <typename T>
+    auto tryPush(const T &v) -> bool
+    {
+      return write(v, false);
+    }
+
+    // Consumer side. The oldest message, waiting for one if the ring is empty. It stays valid
+    // until pop().
+    auto front() -> std::span<const std::byte>;
+    // The oldest message, or an empty span if the ring is empty.
+    auto tryFront() -> std::span<const std::byte>;
+    auto pop() -> void;
+
+  private:
+    struct Shared;
+
+    // Put area over the free space of the ring; overflows fail instead of growing.
+    class Buf final : public std::streambuf
+    {
+    public:
+      auto reset(std::span<std::byte>) -> void;
+      auto used() const -> size_t;
+    };
+
+    Ring(const std::string &name, size_t capacity, bool create);
+
+    template <typename T>
+    auto write(const T &v, bool wait) -> bool
+    {
+      buf.reset(space());
+      st.clear();
+      msgpackSer(st, v);
+      if (st)
+      {
+        commit(buf.used());
+        return true;
+      }
+      // the size is known only once the message is written out
+      spill.str({});
+      msgpackSer(spill, v);
+      return copy(spill.view(), wait);
+    }
+
+    // Room for the next message, up to the end of the buffer.
+    auto space() -> std::span<std::byte>;
+    auto commit(size_t size) -> void;
+    // Writes a serialized message once there is room for it.
+    auto copy(std::string_view msg, bool wait) -> bool;
+    // Makes space() hold at least size bytes, wrapping around to the start of the buffer and
+    // waiting for the consumer as needed. False if that would wait and wait is false.
+    auto makeRoom(size_t size, bool wait) -> bool;
+
+    Shared *shared = nullptr;
+    size_t mapped = 0;
+    std::byte *data = nullptr;
+    uint64_t mask = 0;
+    uint64_t head = 0; // the consumer's position
+    uint64_t tail = 0; // the producer's position
+    Buf buf;
+    std::ostream st{&buf};
+    std::ostringstream spill; // messages larger than the free space
+  };
+} // namespace msgpack
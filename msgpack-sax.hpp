@@ -0,0 +1,336 @@
+// (c) 2025 Mika Pi
+
+#pragma once
+#include "msgpack.hpp"
+#include <cstdint>
+#include <cstring>
+#include <span>
+#include <string>
+#include <string_view>
+#include <type_traits>
+#include <vector>
+
+namespace msgpack
+{
+  // Parses the first object in `in` and reports it to v as a sequence of events, without
+  // building a Val. Returns the bytes after the object. Handlers are found at compile time; any
+  // of them may be left out, which drops its events:
+  //   onNil()   onBool(bool)   onInt(int64_t)   onUInt(uint64_t)   onFloat(double)
+  //   onStr(std::string_view)   onBin(std::span<const std::byte>)
+  //   onExt(int8_t type, std::span<const std::byte> data)
+  //   onArrayBegin(size_t n) ... onArrayEnd()   onMapBegin(size_t n) ... onMapEnd()
+  //   onKey(std::string_view)
+  // As in Val, positive fixints are onInt and the uint formats onUInt; without an onUInt handler
+  // they go to onInt. float32 and float64 are both onFloat. String keys of maps go to onKey if v
+  // has it, other keys to the usual handlers. onArrayBegin and onMapBegin may return false to
+  // skip the container's elements (and its end event), and onKey may return false to skip the
+  // value. Strings and bins point into `in`. Memory use is O(depth); malformed input throws
+  // ParsingError.
+  template <typename V>
+  auto sax(std::span<const std::byte> in, V &v) -> std::span<const std::byte>;
+} // namespace msgpack
+
+namespace InternalMsgPack
+{
+  template <typename U>
+  auto saxBe(const std::byte *p) -> U
+  {
+    auto r = U{};
+    std::memcpy(&r, p, sizeof(r));
+    if constexpr (sizeof(U) == 2)
+      r = __builtin_bswap16(r);
+    else if constexpr (sizeof(U) == 4)
+      r = __builtin_bswap32(r);
+    else if constexpr (sizeof(U) == 8)
+      r = __builtin_bswap64(r);
+    return r;
+  }
+
+  // Result of a begin or key handler: true unless it returned false.
+  template <typename F>
+  auto saxKeep(F &&f) -> bool
+  {
+    if constexpr (std::is_void_v<decltype(f())>)
+    {
+      f();
+      return true;
+    }
+    else
+      return static_cast<bool>(f());
+  }
+
+  class SaxParser
+  {
+  public:
+    explicit SaxParser(std::span<const std::byte> aIn) : in(aIn) {}
+
+    template <typename V>
+    auto run(V &v) -> std::span<const std::byte>
+    {
+      for (;;)
+      {
+        if (skipNext)
+        {
+          skipNext = false;
+          skipValue();
+        }
+        else if (!item(v))
+          continue; // entered a container
+        // an item is complete: close every container it completes
+        while (!stack.empty())
+        {
+          auto &f = stack.back();
+          if (--f.left > 0)
+            break;
+          const auto map = f.map;
+          stack.pop_back();
+          if (map)
+          {
+            if constexpr (requires { v.onMapEnd(); })
+              v.onMapEnd();
+          }
+          else if constexpr (requires { v.onArrayEnd(); })
+            v.onArrayEnd();
+        }
+        if (stack.empty())
+          return in.subspan(pos);
+      }
+    }
+
+  private:
+    struct Frame
+    {
+      uint64_t left; // items left: elements of an array, keys and values of a map
+      bool map;
+    };
+
+    auto need(size_t n) const -> void
+    {
+      if (n > in.size() - pos)
+        throw msgpack::ParsingError("Unexpected EOF");
+    }
+
+    template <typename U>
+    auto read(size_t at) const -> U
+    {
+      need(at + sizeof(U));
+      return saxBe<U>(in.data() + pos + at);
+    }
+
+    auto bytes(size_t head, uint64_t len) -> std::span<const std::byte>
+    {
+      need(head);
+      if (len > in.size() - pos - head)
+        throw msgpack::ParsingError("Unexpected EOF");
+      const auto r = in.subspan(pos + head, static_cast<size_t>(len));
+      pos += head + static_cast<size_t>(len);
+      return r;
+    }
+
+    auto skipValue() -> void
+    {
+      pos = in.size() - msgpack::skip(in.subspan(pos)).size();
+    }
+
+    // Reports the next item; false if it opened a container that still has elements.
+    template <typename V>
+    auto item(V &v) -> bool
+    {
+      const auto isKey = !stack.empty() && stack.back().map && stack.back().left % 2 == 0;
+      need(1);
+      const auto b = static_cast<uint8_t>(in[pos]);
+      if (b <= 0x7f)
+        return integer<int64_t>(v, b, 1);
+      if (b >= 0xe0)
+        return integer<int64_t>(v, static_cast<int8_t>(b), 1);
+      if ((b & 0xe0) == 0xa0)
+        return string(v, bytes(1, b & 0x1f), isKey);
+      if ((b & 0xf0) == 0x90)
+        return container(v, false, b & 0x0f, 1);
+      if ((b & 0xf0) == 0x80)
+        return container(v, true, b & 0x0f, 1);
+      switch (b)
+      {
+      case 0xc0:
+        ++pos;
+        if constexpr (requires { v.onNil(); })
+          v.onNil();
+        return true;
+      case 0xc2:
+      case 0xc3:
+        ++pos;
+        if constexpr (requires { v.onBool(true); })
+          v.onBool(b == 0xc3);
+        return true;
+      case 0xcc:
+        return integer<uint64_t>(v, read<uint8_t>(1), 2);
+      case 0xcd:
+        return integer<uint64_t>(v, read<uint16_t>(1), 3);
+      case 0xce:
+        return integer<uint64_t>(v, read<uint32_t>(1), 5);
+      case 0xcf:
+        return integer<uint64_t>(v, read<uint64_t>(1), 9);
+      case 0xd0:
+        return integer<int64_t>(v, static_cast<int8_t>(read<uint8_t>(1)), 2);
+      case 0xd1:
+        return integer<int64_t>(v, static_cast<int16_t>(read<uint16_t>(1)), 3);
+      case 0xd2:
+        return integer<int64_t>(v, static_cast<int32_t>(read<uint32_t>(1)), 5);
+      case 0xd3:
+        return integer<int64_t>(v, static_cast<int64_t>(read<uint64_t>(1)), 9);
+      case 0xca:
+      {
+        const auto raw = read<uint32_t>(1);
+        auto f = float{};
+        std::memcpy(&f, &raw, sizeof(f));
+        return real(v, f, 5);
+      }
+      case 0xcb:
+      {
+        const auto raw = read<uint64_t>(1);
+        auto d = double{};
+        std::memcpy(&d, &raw, sizeof(d));
+        return real(v, d, 9);
+      }
+      case 0xd9:
+        return string(v, bytes(2, read<uint8_t>(1)), isKey);
+      case 0xda:
+        return string(v, bytes(3, read<uint16_t>(1)), isKey);
+      case 0xdb:
+        return string(v, bytes(5, read<uint32_t>(1)), isKey);
+      case 0xc4:
+        return bin(v, bytes(2, read<uint8_t>(1)));
+      case 0xc5:
+        return bin(v, bytes(3, read<uint16_t>(1)));
+      case 0xc6:
+        return bin(v, bytes(5, read<uint32_t>(1)));
+      case 0xdc:
+        return container(v, false, read<uint16_t>(1), 3);
+      case 0xdd:
+        return container(v, false, read<uint32_t>(1), 5);
+      case 0xde:
+        return container(v, true, read<uint16_t>(1), 3);
+      case 0xdf:
+        return container(v, true, read<uint32_t>(1), 5);
+      case 0xd4:
+        return ext(v, 1, 1);
+      case 0xd5:
+        return ext(v, 2, 1);
+      case 0xd6:
+        return ext(v, 4, 1);
+      case 0xd7:
+        return ext(v, 8, 1);
+      case 0xd8:
+        return ext(v, 16, 1);
+      case 0xc7:
+        return ext(v, read<uint8_t>(1), 2);
+      case 0xc8:
+        return ext(v, read<uint16_t>(1), 3);
+      case 0xc9:
+        return ext(v, read<uint32_t>(1), 5);
+      default:
+        throw msgpack::ParsingError("Unknown type byte " + std::to_string(b));
+      }
+    }
+
+    template <typename I, typename V>
+    auto integer(V &v, I i, size_t size) -> bool
+    {
+      pos += size;
+      if constexpr (std::is_same_v<I, uint64_t> && requires { v.onUInt(i); })
+        v.onUInt(i);
+      else if constexpr (requires { v.onInt(int64_t{}); })
+        v.onInt(static_cast<int64_t>(i));
+      return true;
+    }
+
+    template <typename V>
+    auto real(V &v, double d, size_t size) -> bool
+    {
+      pos += size;
+      if constexpr (requires { v.onFloat(d); })
+        v.onFloat(d);
+      return true;
+    }
+
+    template <typename V>
+    auto string(V &v, std::span<const std::byte> s, bool isKey) -> bool
+    {
+      const auto sv = std::string_view{reinterpret_cast<const char *>(s.data()), s.size()};
+      if constexpr (requires { v.onKey(sv); })
+        if (isKey)
+        {
+          skipNext = !saxKeep([&] { return v.onKey(sv); });
+          return true;
+        }
+      if constexpr (requires { v.onStr(sv); })
+        v.onStr(sv);
+      return true;
+    }
+
+    template <typename V>
+    auto bin(V &v, std::span<const std::byte> s) -> bool
+    {
+      if constexpr (requires { v.onBin(s); })
+        v.onBin(s);
+      return true;
+    }
+
+    template <typename V>
+    auto ext(V &v, uint32_t len, size_t typeAt) -> bool
+    {
+      need(typeAt + 1);
+      const auto type = static_cast<int8_t>(in[pos + typeAt]);
+      const auto data = bytes(typeAt + 1, len);
+      if constexpr (requires { v.onExt(type, data); })
+        v.onExt(type, data);
+      return true;
+    }
+
+    template <typename V>
+    auto container(V &v, bool map, uint64_t n, size_t head) -> bool
+    {
+      const auto start = pos;
+      need(head);
+      pos += head;
+      auto keep = true;
+      if (map)
+      {
+        if constexpr (requires { v.onMapBegin(size_t{}); })
+          keep = saxKeep([&] { return v.onMapBegin(static_cast<size_t>(n)); });
+      }
+      else if constexpr (requires { v.onArrayBegin(size_t{}); })
+        keep = saxKeep([&] { return v.onArrayBegin(static_cast<size_t>(n)); });
+      if (!keep)
+      {
+        pos = start;
+        skipValue();
+        return true;
+      }
+      if (n > 0)
+      {
+        stack.push_back(Frame{map ? 2 * n : n, map});
+        return false;
+      }
+      if (map)
+      {
+        if constexpr (requires { v.onMapEnd(); })
+          v.onMapEnd();
+      }
+      else if constexpr (requires { v.onArrayEnd(); })
+        v.onArrayEnd();
+      return true;
+    }
+
+    std::span<const std::byte> in;
+    size_t pos = 0;
+    bool skipNext = false;
+    std::vector<Frame> stack;
+  };
+} // namespace InternalMsgPack
+
+template <typename V>
+auto msgpack::sax(std::span<const std::byte> in, V &v) -> std::span<const std::byte>
+{
+  return InternalMsgPack::SaxParser{in}.run(v);
+}
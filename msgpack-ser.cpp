@@ -1,49 +1,261 @@
 // (c) 2025 Mika Pi
 
 #include "msgpack-ser.hpp"
+#include "msgpack-gather.hpp"
+#include <cmath>
+#include <limits>
+
+namespace msgpack
+{
+  auto structAsArray(std::ios_base &st) -> std::ios_base &
+  {
+    InternalMsgPack::serFlags(st) |= InternalMsgPack::StructAsArray;
+    return st;
+  }
+
+  auto structAsMap(std::ios_base &st) -> std::ios_base &
+  {
+    InternalMsgPack::serFlags(st) &= ~long{InternalMsgPack::StructAsArray};
+    return st;
+  }
+
+  auto omitDefaults(std::ios_base &st) -> std::ios_base &
+  {
+    InternalMsgPack::serFlags(st) |= InternalMsgPack::OmitDefaults;
+    return st;
+  }
+
+  auto keepDefaults(std::ios_base &st) -> std::ios_base &
+  {
+    InternalMsgPack::serFlags(st) &= ~long{InternalMsgPack::OmitDefaults};
+    return st;
+  }
+
+  auto canonical(std::ios_base &st) -> std::ios_base &
+  {
+    InternalMsgPack::serFlags(st) |= InternalMsgPack::Canonical;
+    return st;
+  }
+
+  auto noCanonical(std::ios_base &st) -> std::ios_base &
+  {
+    InternalMsgPack::serFlags(st) &= ~long{InternalMsgPack::Canonical};
+    return st;
+  }
+} // namespace msgpack
 
 namespace InternalMsgPack
 {
-  auto msgpackSerVal(std::ostream &st, std::string v) -> void
+  auto serFlags(std::ios_base &st) -> long &
   {
-    if (v.size() < 32)
+    static const auto index = std::ios_base::xalloc();
+    return st.iword(index);
+  }
+
+  auto msgpackSerArrayHeader(std::ostream &st, size_t size) -> void
+  {
+    msgpack::stats::written(msgpack::NodeType::Array);
+    if (size < 16)
     {
-      st.put(static_cast<char>(0xa0 | v.size()));
+      st.put(static_cast<char>(0x90 | size));
     }
-    else if (v.size() < 256)
+    else if (size < 65536)
+    {
+      st.put(static_cast<char>(0xdc));
+      st.put(static_cast<char>(size >> 8));
+      st.put(static_cast<char>(size));
+    }
+    else
+    {
+      st.put(static_cast<char>(0xdd));
+      st.put(static_cast<char>(size >> 24));
+      st.put(static_cast<char>(size >> 16));
+      st.put(static_cast<char>(size >> 8));
+      st.put(static_cast<char>(size));
+    }
+  }
+
+  auto msgpackSerMapHeader(std::ostream &st, size_t size) -> void
+  {
+    msgpack::stats::written(msgpack::NodeType::Map);
+    if (size < 16)
+    {
+      st.put(static_cast<char>(0x80 | size));
+    }
+    else if (size < 65536)
+    {
+      st.put(static_cast<char>(0xde));
+      st.put(static_cast<char>(size >> 8));
+      st.put(static_cast<char>(size));
+    }
+    else
+    {
+      st.put(static_cast<char>(0xdf));
+      st.put(static_cast<char>(size >> 24));
+      st.put(static_cast<char>(size >> 16));
+      st.put(static_cast<char>(size >> 8));
+      st.put(static_cast<char>(size));
+    }
+  }
+
+  auto msgpackSerStrHeader(std::ostream &st, size_t size) -> void
+  {
+    msgpack::stats::written(msgpack::NodeType::Str);
+    if (size < 32)
+    {
+      st.put(static_cast<char>(0xa0 | size));
+    }
+    else if (size < 256)
     {
       st.put(static_cast<char>(0xd9));
-      st.put(static_cast<char>(v.size()));
+      st.put(static_cast<char>(size));
     }
-    else if (v.size() < 65536)
+    else if (size < 65536)
     {
       st.put(static_cast<char>(0xda));
-      st.put(static_cast<char>(v.size() >> 8));
-      st.put(static_cast<char>(v.size()));
+      st.put(static_cast<char>(size >> 8));
+      st.put(static_cast<char>(size));
     }
     else
     {
       st.put(static_cast<char>(0xdb));
-      st.put(static_cast<char>(v.size() >> 24));
-      st.put(static_cast<char>(v.size() >> 16));
-      st.put(static_cast<char>(v.size() >> 8));
-      st.put(static_cast<char>(v.size()));
+      st.put(static_cast<char>(size >> 24));
+      st.put(static_cast<char>(size >> 16));
+      st.put(static_cast<char>(size >> 8));
+      st.put(static_cast<char>(size));
+    }
+  }
+
+  auto msgpackSerBinHeader(std::ostream &st, size_t size) -> void
+  {
+    msgpack::stats::written(msgpack::NodeType::Bin);
+    if (size < 256)
+    {
+      st.put(static_cast<char>(0xc4));
+      st.put(static_cast<char>(size));
+    }
+    else if (size < 65536)
+    {
+      st.put(static_cast<char>(0xc5));
+      st.put(static_cast<char>(size >> 8));
+      st.put(static_cast<char>(size));
+    }
+    else
+    {
+      st.put(static_cast<char>(0xc6));
+      st.put(static_cast<char>(size >> 24));
+      st.put(static_cast<char>(size >> 16));
+      st.put(static_cast<char>(size >> 8));
+      st.put(static_cast<char>(size));
     }
-    st.write(v.data(), static_cast<std::streamsize>(v.size()));
+  }
+
+  auto msgpackSerRaw(std::ostream &st, const char *data, size_t size) -> void
+  {
+    if (size >= msgpack::GatherStream::RefThreshold)
+      if (auto gather = dynamic_cast<msgpack::GatherStream *>(&st))
+      {
+        gather->ref(data, size);
+        return;
+      }
+    st.write(data, static_cast<std::streamsize>(size));
+  }
+
+  auto msgpackSerVal(std::ostream &st, std::string_view v) -> void
+  {
+    msgpackSerStrHeader(st, v.size());
+    msgpackSerRaw(st, v.data(), v.size());
+  }
+
+  auto msgpackSerVal(std::ostream &st, const char *v) -> void
+  {
+    msgpackSerVal(st, std::string_view{v});
+  }
+
+  auto msgpackSerVal(std::ostream &st, const msgpack::Interned &v) -> void
+  {
+    msgpackSerVal(st, v.view());
+  }
+
+  auto msgpackSerVal(std::ostream &st, std::span<const std::byte> v) -> void
+  {
+    msgpackSerBinHeader(st, v.size());
+    msgpackSerRaw(st, reinterpret_cast<const char *>(v.data()), v.size());
+  }
+
+  auto msgpackSerVal(std::ostream &st, std::nullptr_t) -> void
+  {
+    msgpack::stats::written(msgpack::NodeType::Nil);
+    st.put(static_cast<char>(0xc0));
   }
 
   auto msgpackSerVal(std::ostream &st, bool v) -> void
   {
+    msgpack::stats::written(msgpack::NodeType::Bool);
     st.put(static_cast<char>(v ? 0xc3 : 0xc2));
   }
 
+  auto msgpackSerNarrow(std::ostream &st, double v) -> bool
+  {
+    auto raw = uint32_t{0x7fc00000};
+    if (!std::isnan(v))
+    {
+      if (std::isfinite(v) && std::abs(v) > std::numeric_limits<float>::max())
+        return false;
+      const auto f = static_cast<float>(v);
+      if (static_cast<double>(f) != v)
+        return false;
+      std::memcpy(&raw, &f, sizeof(f));
+    }
+    msgpack::stats::written(msgpack::NodeType::Float);
+    st.put(static_cast<char>(0xca));
+    st.put(static_cast<char>(raw >> 24));
+    st.put(static_cast<char>(raw >> 16));
+    st.put(static_cast<char>(raw >> 8));
+    st.put(static_cast<char>(raw));
+    return true;
+  }
+
   auto msgpackDeserVal(const msgpack::Val &j, std::string &v) -> void
   {
     if (!std::holds_alternative<std::string_view>(j))
       return;
+    msgpack::stats::reserve(v.capacity(), std::get<std::string_view>(j).size());
+    v = std::get<std::string_view>(j);
+  }
+
+  auto msgpackDeserVal(const msgpack::Val &j, std::string_view &v) -> void
+  {
+    if (!std::holds_alternative<std::string_view>(j))
+      throw msgpack::ParsingError{"Type mismatch. Expected string_view, got " + get_type_name(j)};
     v = std::get<std::string_view>(j);
   }
 
+  auto msgpackDeserVal(const msgpack::Val &j, msgpack::Interned &v) -> void
+  {
+    if (!std::holds_alternative<std::string_view>(j))
+      throw msgpack::ParsingError{"Type mismatch. Expected string_view, got " + get_type_name(j)};
+    v = msgpack::Interned{std::get<std::string_view>(j)};
+  }
+
+  auto msgpackDeserVal(const msgpack::Val &j, std::span<const std::byte> &v) -> void
+  {
+    if (!std::holds_alternative<std::span<const std::byte>>(j))
+      throw msgpack::ParsingError{"Type mismatch. Expected bin, got " + get_type_name(j)};
+    v = std::get<std::span<const std::byte>>(j);
+  }
+
+  auto getArray(const msgpack::Val &j, size_t n) -> const msgpack::Array &
+  {
+    if (!std::holds_alternative<msgpack::Array>(j))
+      throw msgpack::ParsingError{"Type mismatch. Expected Array, got " + get_type_name(j)};
+    const auto &arr = std::get<msgpack::Array>(j);
+    if (arr.size() != n)
+      throw msgpack::ParsingError{"Size mismatch. Expected Array of " + std::to_string(n) +
+                                  " elements, got " + std::to_string(arr.size())};
+    return arr;
+  }
+
   auto msgpackDeserVal(const msgpack::Val &j, bool &v) -> void
   {
     if (!std::holds_alternative<bool>(j))
@@ -1,41 +1,130 @@
 // (c) 2025 Mika Pi
 
 #pragma once
+#include <algorithm>
+#include <array>
+#include <cmath>
 #include <cstring>
+#include <deque>
 #include <iostream>
 #include <map>
+#include <optional>
 #include <ser/is_serializable.hpp>
+#include <set>
+#include <span>
 #include <sstream>
+#include <string_view>
+#include <tuple>
 #include <unordered_map>
+#include <unordered_set>
+#include <utility>
+#include <variant>
 
+#include "msgpack-intern.hpp"
+#include "msgpack-keydict.hpp"
+#include "msgpack-stats.hpp"
 #include "msgpack.hpp"
 
 template <typename T>
-auto msgpackSer(std::ostream &st, T v) -> void;
+auto msgpackSer(std::ostream &st, const T &v) -> void;
 
+// std::string_view and std::span<const std::byte> members are decoded by borrowing: they point
+// into the buffer jv was parsed from (the span given to msgpack::Blob, or the Blob's own buffer
+// when it was read from a stream), which must outlive the decoded object. Types with borrowing
+// members cannot be decoded with msgpackDeser(std::istream &, T &), its buffer is discarded on
+// return.
 template <typename T>
 auto msgpackDeser(const msgpack::Val &jv, T &v) -> void;
 
+namespace msgpack
+{
+  // Element types whose std::vector and std::array are encoded as bin instead of an array of
+  // integers. Specialize to opt in, in a header seen by every translation unit that serializes
+  // the type, e.g.
+  //   template <> struct msgpack::IsBinElement<uint8_t> : std::true_type {};
+  template <typename T>
+  struct IsBinElement : std::is_same<T, std::byte>
+  {
+  };
+
+  // SER_PROPS structs whose fields are encoded as an array in declaration order instead of a map
+  // keyed by field name. Specialize to opt in per type, e.g.
+  //   template <> struct msgpack::SerAsArray<Point> : std::true_type {};
+  template <typename T>
+  struct SerAsArray : std::false_type
+  {
+  };
+
+  // Stream manipulators selecting the struct encoding for every SER_PROPS struct written to the
+  // stream afterwards: st << msgpack::structAsArray writes positional arrays, st <<
+  // msgpack::structAsMap restores the default maps. Both forms decode with msgpackDeser.
+  auto structAsArray(std::ios_base &st) -> std::ios_base &;
+  auto structAsMap(std::ios_base &st) -> std::ios_base &;
+
+  // Stream manipulators for sparse structs: after st << msgpack::omitDefaults, struct fields that
+  // are an empty std::optional, an empty string or container, zero or false are left out of
+  // struct maps (not of structs written as arrays); st << msgpack::keepDefaults restores writing
+  // every field. msgpackDeser resets fields missing from a map to T{}.
+  auto omitDefaults(std::ios_base &st) -> std::ios_base &;
+  auto keepDefaults(std::ios_base &st) -> std::ios_base &;
+
+  // Stream manipulators for deterministic output: after st << msgpack::canonical, equal values are
+  // always written as the same bytes. Map entries and std::unordered_set elements are sorted by
+  // their encoded bytes, a double that converts to float without loss is written as float32 and
+  // every NaN as the float32 quiet NaN 0x7fc00000. Integers and lengths always get their shortest
+  // encoding and struct fields keep declaration order in either mode. st << msgpack::noCanonical
+  // restores the default. msgpackDeser accepts float32 for double fields.
+  auto canonical(std::ios_base &st) -> std::ios_base &;
+  auto noCanonical(std::ios_base &st) -> std::ios_base &;
+} // namespace msgpack
+
 namespace InternalMsgPack
 {
   template <typename T>
-  struct IsVariant : std::false_type
+  struct IsStringKey : std::bool_constant<std::is_same_v<T, std::string> ||
+                                          std::is_same_v<T, std::string_view> ||
+                                          std::is_same_v<T, msgpack::Interned>>
   {
   };
 
-  template <typename... Args>
-  struct IsVariant<std::variant<Args...>> : std::true_type
+  enum SerFlag : long
   {
+    StructAsArray = 1 << 0,
+    OmitDefaults = 1 << 1,
+    Canonical = 1 << 2,
   };
 
-  auto msgpackSerVal(std::ostream &st, std::string v) -> void;
+  // Encoding mode flags attached to a stream with the manipulators in namespace msgpack.
+  auto serFlags(std::ios_base &st) -> long &;
+
+  auto msgpackSerVal(std::ostream &st, std::string_view v) -> void;
+  auto msgpackSerVal(std::ostream &st, const char *v) -> void;
+  auto msgpackSerVal(std::ostream &st, const msgpack::Interned &v) -> void;
+
+  auto msgpackSerArrayHeader(std::ostream &st, size_t size) -> void;
+  auto msgpackSerMapHeader(std::ostream &st, size_t size) -> void;
+  auto msgpackSerStrHeader(std::ostream &st, size_t size) -> void;
+  auto msgpackSerBinHeader(std::ostream &st, size_t size) -> void;
+
+  // Writes the payload of a str/bin. Large payloads are referenced in place instead of copied
+  // when st is a msgpack::GatherStream.
+  auto msgpackSerRaw(std::ostream &st, const char *data, size_t size) -> void;
 
   auto get_type_name(const msgpack::Val &v) -> std::string;
 
+  // Canonical float encoding: writes v as float32 if that is lossless, any NaN as the quiet NaN.
+  // Returns false without writing when v needs float64.
+  auto msgpackSerNarrow(std::ostream &st, double v) -> bool;
+
   template <typename T>
   auto msgpackSerVal(std::ostream &st, T v)
     -> std::enable_if_t<std::is_integral_v<T> || std::is_floating_point_v<T> || std::is_enum_v<T>>
   {
+    if constexpr (std::is_floating_point_v<T>)
+      if ((serFlags(st) & Canonical) && msgpackSerNarrow(st, static_cast<double>(v)))
+        return;
+    msgpack::stats::written(std::is_floating_point_v<T> ? msgpack::NodeType::Float
+                                                        : msgpack::NodeType::Int);
     if constexpr (std::is_floating_point_v<T>)
     {
       if constexpr (sizeof(T) == 4)
@@ -184,156 +273,233 @@ namespace InternalMsgPack
     }
   }
 
+  auto msgpackSerVal(std::ostream &st, std::span<const std::byte> v) -> void;
+
   template <typename T>
-  auto msgpackSerVal(std::ostream &st, std::vector<T> v) -> void
+  auto msgpackSerVal(std::ostream &st, const std::vector<T> &v) -> void
   {
-    if (v.size() < 16)
-    {
-      st.put(static_cast<char>(0x90 | v.size()));
-    }
-    else if (v.size() < 65536)
-    {
-      st.put(static_cast<char>(0xdc));
-      st.put(static_cast<char>(v.size() >> 8));
-      st.put(static_cast<char>(v.size()));
-    }
+    if constexpr (msgpack::IsBinElement<T>::value)
+      msgpackSerVal(st, std::as_bytes(std::span{v}));
     else
     {
-      st.put(static_cast<char>(0xdd));
-      st.put(static_cast<char>(v.size() >> 24));
-      st.put(static_cast<char>(v.size() >> 16));
-      st.put(static_cast<char>(v.size() >> 8));
-      st.put(static_cast<char>(v.size()));
+      msgpackSerArrayHeader(st, v.size());
+      for (const auto &e : v)
+        msgpackSer(st, e);
     }
-    for (auto &&e : v)
+  }
+
+  // Array header for a size known at compile time.
+  template <size_t N>
+  constexpr auto arrayHeader()
+  {
+    if constexpr (N < 16)
+      return std::array<char, 1>{static_cast<char>(0x90 | N)};
+    else if constexpr (N < 65536)
+      return std::array<char, 3>{
+        static_cast<char>(0xdc), static_cast<char>(N >> 8), static_cast<char>(N)};
+    else
+      return std::array<char, 5>{static_cast<char>(0xdd),
+                                 static_cast<char>(N >> 24),
+                                 static_cast<char>(N >> 16),
+                                 static_cast<char>(N >> 8),
+                                 static_cast<char>(N)};
+  }
+
+  template <size_t N>
+  auto msgpackSerArrayHeader(std::ostream &st) -> void
+  {
+    static constexpr auto header = arrayHeader<N>();
+    msgpack::stats::written(msgpack::NodeType::Array);
+    st.write(header.data(), header.size());
+  }
+
+  template <typename T, size_t N>
+  auto msgpackSerVal(std::ostream &st, const std::array<T, N> &v) -> void
+  {
+    if constexpr (msgpack::IsBinElement<T>::value)
+      msgpackSerVal(st, std::as_bytes(std::span{v}));
+    else
     {
-      msgpackSer(st, std::move(e));
+      msgpackSerArrayHeader<N>(st);
+      for (const auto &e : v)
+        msgpackSer(st, e);
     }
   }
 
-  auto msgpackSerVal(std::ostream &st, bool v) -> void;
+  template <typename T, typename U>
+  auto msgpackSerVal(std::ostream &st, const std::pair<T, U> &v) -> void
+  {
+    msgpackSerArrayHeader<2>(st);
+    msgpackSer(st, v.first);
+    msgpackSer(st, v.second);
+  }
 
   template <typename... Ts>
-  auto msgpackSerVal(std::ostream &st, std::variant<Ts...> v) -> void
+  auto msgpackSerVal(std::ostream &st, const std::tuple<Ts...> &v) -> void
+  {
+    msgpackSerArrayHeader<sizeof...(Ts)>(st);
+    std::apply([&st](const auto &...vv) { (msgpackSer(st, vv), ...); }, v);
+  }
+
+  template <typename C>
+  auto msgpackSerSeq(std::ostream &st, const C &v) -> void
   {
-    std::visit([&](auto vv) { msgpackSer(st, std::move(vv)); }, v);
+    msgpackSerArrayHeader(st, v.size());
+    for (const auto &e : v)
+      msgpackSer(st, e);
   }
 
   template <typename T>
-  auto msgpackSerVal(std::ostream &st, std::unordered_map<std::string, T> v) -> void
+  auto msgpackSerVal(std::ostream &st, const std::deque<T> &v) -> void
   {
-    if (v.size() < 16)
-    {
-      st.put(static_cast<char>(0x80 | v.size()));
-    }
-    else if (v.size() < 65536)
+    msgpackSerSeq(st, v);
+  }
+
+  template <typename T>
+  auto msgpackSerVal(std::ostream &st, const std::set<T> &v) -> void
+  {
+    msgpackSerSeq(st, v);
+  }
+
+  // Canonical order of an unordered container: elements sorted by their encoded bytes. Elements
+  // are encoded with st's mode flags but without its key dictionary, whose definitions would
+  // otherwise be emitted out of order.
+  template <typename C>
+  auto msgpackSerSorted(std::ostream &st, const C &v) -> void
+  {
+    auto items = std::vector<std::string>{};
+    items.reserve(v.size());
+    auto sst = std::ostringstream{};
+    serFlags(sst) = serFlags(st);
+    for (const auto &e : v)
     {
-      st.put(static_cast<char>(0xde));
-      st.put(static_cast<char>(v.size() >> 8));
-      st.put(static_cast<char>(v.size()));
+      msgpackSer(sst, e);
+      items.push_back(std::move(sst).str());
+      sst.str({});
     }
+    std::sort(items.begin(), items.end());
+    msgpackSerArrayHeader(st, v.size());
+    for (const auto &e : items)
+      st.write(e.data(), static_cast<std::streamsize>(e.size()));
+  }
+
+  template <typename T>
+  auto msgpackSerVal(std::ostream &st, const std::unordered_set<T> &v) -> void
+  {
+    if (serFlags(st) & Canonical)
+      msgpackSerSorted(st, v);
     else
+      msgpackSerSeq(st, v);
+  }
+
+  auto msgpackSerVal(std::ostream &st, bool v) -> void;
+
+  // Variants are encoded as [index, value] wherever they appear.
+  template <typename... Ts>
+  auto msgpackSerVal(std::ostream &st, const std::variant<Ts...> &v) -> void
+  {
+    msgpackSerArrayHeader<2>(st);
+    msgpackSerVal(st, v.index());
+    std::visit([&](const auto &vv) { msgpackSer(st, vv); }, v);
+  }
+
+  // Map entries in canonical order: sorted by the encoded bytes of their keys.
+  template <typename M>
+  auto msgpackSerSortedMap(std::ostream &st, const M &v) -> void
+  {
+    auto entries = std::vector<std::pair<std::string, const typename M::mapped_type *>>{};
+    entries.reserve(v.size());
+    auto key = std::ostringstream{};
+    for (const auto &e : v)
     {
-      st.put(static_cast<char>(0xdf));
-      st.put(static_cast<char>(v.size() >> 24));
-      st.put(static_cast<char>(v.size() >> 16));
-      st.put(static_cast<char>(v.size() >> 8));
-      st.put(static_cast<char>(v.size()));
+      InternalMsgPack::msgpackSerVal(key, e.first);
+      entries.emplace_back(std::move(key).str(), &e.second);
+      key.str({});
     }
-    for (auto &&e : v)
+    std::sort(entries.begin(), entries.end(), [](const auto &a, const auto &b) {
+      return a.first < b.first;
+    });
+    msgpackSerMapHeader(st, v.size());
+    for (const auto &e : entries)
     {
-      InternalMsgPack::msgpackSerVal(st, e.first);
-      msgpackSer(st, std::move(e.second));
+      st.write(e.first.data(), static_cast<std::streamsize>(e.first.size()));
+      msgpackSer(st, *e.second);
     }
   }
 
-  template <typename T>
-  auto msgpackSerVal(std::ostream &st, std::map<std::string, T> v) -> void
+  template <typename K, typename T, typename H, typename E, typename A>
+  auto msgpackSerVal(std::ostream &st, const std::unordered_map<K, T, H, E, A> &v)
+    -> std::enable_if_t<IsStringKey<K>::value>
   {
-    if (v.size() < 16)
+    if (serFlags(st) & Canonical)
     {
-      st.put(static_cast<char>(0x80 | v.size()));
+      msgpackSerSortedMap(st, v);
+      return;
     }
-    else if (v.size() < 65536)
+    msgpackSerMapHeader(st, v.size());
+    for (const auto &e : v)
     {
-      st.put(static_cast<char>(0xde));
-      st.put(static_cast<char>(v.size() >> 8));
-      st.put(static_cast<char>(v.size()));
+      InternalMsgPack::msgpackSerVal(st, e.first);
+      msgpackSer(st, e.second);
     }
-    else
+  }
+
+  template <typename K, typename T, typename C, typename A>
+  auto msgpackSerVal(std::ostream &st, const std::map<K, T, C, A> &v)
+    -> std::enable_if_t<IsStringKey<K>::value>
+  {
+    if (serFlags(st) & Canonical)
     {
-      st.put(static_cast<char>(0xdf));
-      st.put(static_cast<char>(v.size() >> 24));
-      st.put(static_cast<char>(v.size() >> 16));
-      st.put(static_cast<char>(v.size() >> 8));
-      st.put(static_cast<char>(v.size()));
+      msgpackSerSortedMap(st, v);
+      return;
     }
-    for (auto &&e : v)
+    msgpackSerMapHeader(st, v.size());
+    for (const auto &e : v)
     {
       InternalMsgPack::msgpackSerVal(st, e.first);
-      msgpackSer(st, std::move(e.second));
+      msgpackSer(st, e.second);
     }
   }
 
-  template <typename U, typename T>
-  auto msgpackSerVal(std::ostream &st, std::unordered_map<U, T> v)
+  template <typename U, typename T, typename H, typename E, typename A>
+  auto msgpackSerVal(std::ostream &st, const std::unordered_map<U, T, H, E, A> &v)
     -> std::enable_if_t<std::is_integral_v<U> || std::is_enum_v<U>>
   {
-    if (v.size() < 16)
-    {
-      st.put(static_cast<char>(0x80 | v.size()));
-    }
-    else if (v.size() < 65536)
-    {
-      st.put(static_cast<char>(0xde));
-      st.put(static_cast<char>(v.size() >> 8));
-      st.put(static_cast<char>(v.size()));
-    }
-    else
+    if (serFlags(st) & Canonical)
     {
-      st.put(static_cast<char>(0xdf));
-      st.put(static_cast<char>(v.size() >> 24));
-      st.put(static_cast<char>(v.size() >> 16));
-      st.put(static_cast<char>(v.size() >> 8));
-      st.put(static_cast<char>(v.size()));
+      msgpackSerSortedMap(st, v);
+      return;
     }
-    for (auto &&e : v)
+    msgpackSerMapHeader(st, v.size());
+    for (const auto &e : v)
     {
       InternalMsgPack::msgpackSerVal(st, e.first);
-      msgpackSer(st, std::move(e.second));
+      msgpackSer(st, e.second);
     }
   }
 
-  template <typename U, typename T>
-  auto msgpackSerVal(std::ostream &st, std::map<U, T> v)
+  template <typename U, typename T, typename C, typename A>
+  auto msgpackSerVal(std::ostream &st, const std::map<U, T, C, A> &v)
     -> std::enable_if_t<std::is_integral_v<U> || std::is_enum_v<U>>
   {
-    if (v.size() < 16)
+    if (serFlags(st) & Canonical)
     {
-      st.put(static_cast<char>(0x80 | v.size()));
-    }
-    else if (v.size() < 65536)
-    {
-      st.put(static_cast<char>(0xde));
-      st.put(static_cast<char>(v.size() >> 8));
-      st.put(static_cast<char>(v.size()));
-    }
-    else
-    {
-      st.put(static_cast<char>(0xdf));
-      st.put(static_cast<char>(v.size() >> 24));
-      st.put(static_cast<char>(v.size() >> 16));
-      st.put(static_cast<char>(v.size() >> 8));
-      st.put(static_cast<char>(v.size()));
+      msgpackSerSortedMap(st, v);
+      return;
     }
-    for (auto &&e : v)
+    msgpackSerMapHeader(st, v.size());
+    for (const auto &e : v)
     {
       InternalMsgPack::msgpackSerVal(st, e.first);
-      msgpackSer(st, std::move(e.second));
+      msgpackSer(st, e.second);
     }
   }
 
   auto msgpackDeserVal(const msgpack::Val &j, std::string &v) -> void;
+  // Borrows the characters: v points into the buffer j was parsed from.
+  auto msgpackDeserVal(const msgpack::Val &j, std::string_view &v) -> void;
+  // Interns the characters in the current thread's msgpack::InternPool, if any.
+  auto msgpackDeserVal(const msgpack::Val &j, msgpack::Interned &v) -> void;
 
   template <typename T>
   auto msgpackDeserVal(const msgpack::Val &j, T &v)
@@ -349,9 +515,12 @@ namespace InternalMsgPack
       }
       else
       {
-        if (!std::holds_alternative<double>(j))
+        if (std::holds_alternative<float>(j))
+          v = std::get<float>(j);
+        else if (std::holds_alternative<double>(j))
+          v = std::get<double>(j);
+        else
           throw msgpack::ParsingError{"Type mismatch. Expected double, got " + get_type_name(j)};
-        v = std::get<double>(j);
       }
     }
     else
@@ -365,195 +534,487 @@ namespace InternalMsgPack
     }
   }
 
+  // Borrows the bytes: v points into the buffer j was parsed from.
+  auto msgpackDeserVal(const msgpack::Val &j, std::span<const std::byte> &v) -> void;
+
   template <typename T>
   auto msgpackDeserVal(const msgpack::Val &j, std::vector<T> &v) -> void
   {
-    if (!std::holds_alternative<msgpack::Array>(j))
-      throw msgpack::ParsingError{"Type mismatch. Expected Array, got " + get_type_name(j)};
-    const auto &arr = std::get<msgpack::Array>(j);
-    v.clear();
-    for (const auto &e : arr)
-      msgpackDeser(e, v.emplace_back());
+    if constexpr (msgpack::IsBinElement<T>::value)
+    {
+      if (!std::holds_alternative<std::span<const std::byte>>(j))
+        throw msgpack::ParsingError{"Type mismatch. Expected bin, got " + get_type_name(j)};
+      const auto bin = std::get<std::span<const std::byte>>(j);
+      msgpack::stats::reserve(v.capacity(), bin.size());
+      v.resize(bin.size());
+      if (!bin.empty())
+        std::memcpy(v.data(), bin.data(), bin.size());
+    }
+    else
+    {
+      if (!std::holds_alternative<msgpack::Array>(j))
+        throw msgpack::ParsingError{"Type mismatch. Expected Array, got " + get_type_name(j)};
+      const auto &arr = std::get<msgpack::Array>(j);
+      msgpack::stats::reserve(v.capacity(), arr.size());
+      v.resize(arr.size());
+      for (size_t i = 0; i < arr.size(); ++i)
+        msgpackDeser(arr[i], v[i]);
+    }
   }
 
-  auto msgpackDeserVal(const msgpack::Val &j, bool &v) -> void;
+  // The Array in j, which must have n elements.
+  auto getArray(const msgpack::Val &j, size_t n) -> const msgpack::Array &;
 
-  template <auto N = 0, typename... Ts>
-  auto msgpackDeserVal(const msgpack::Val &j, size_t idx, std::variant<Ts...> &v) -> void
+  template <typename T, size_t N>
+  auto msgpackDeserVal(const msgpack::Val &j, std::array<T, N> &v) -> void
   {
-    if constexpr (N >= sizeof...(Ts))
-      return;
+    if constexpr (msgpack::IsBinElement<T>::value)
+    {
+      if (!std::holds_alternative<std::span<const std::byte>>(j))
+        throw msgpack::ParsingError{"Type mismatch. Expected bin, got " + get_type_name(j)};
+      const auto bin = std::get<std::span<const std::byte>>(j);
+      if (bin.size() != N)
+        throw msgpack::ParsingError{"Size mismatch. Expected bin of " + std::to_string(N) +
+                                    " bytes, got " + std::to_string(bin.size())};
+      if constexpr (N > 0)
+        std::memcpy(v.data(), bin.data(), N);
+    }
     else
     {
-      if (idx == N)
-        msgpackDeser(j, v.template emplace<N>());
-      else
-        msgpackDeserVal<N + 1, Ts...>(j, idx, v);
+      const auto &arr = getArray(j, N);
+      for (size_t i = 0; i < N; ++i)
+        msgpackDeser(arr[i], v[i]);
+    }
+  }
+
+  template <typename T, typename U>
+  auto msgpackDeserVal(const msgpack::Val &j, std::pair<T, U> &v) -> void
+  {
+    const auto &arr = getArray(j, 2);
+    msgpackDeser(arr[0], v.first);
+    msgpackDeser(arr[1], v.second);
+  }
+
+  template <typename... Ts>
+  auto msgpackDeserVal(const msgpack::Val &j, std::tuple<Ts...> &v) -> void
+  {
+    const auto &arr = getArray(j, sizeof...(Ts));
+    [&]<size_t... Ns>(std::index_sequence<Ns...>)
+    {
+      (msgpackDeser(arr[Ns], std::get<Ns>(v)), ...);
     }
+    (std::index_sequence_for<Ts...>{});
   }
 
   template <typename T>
-  auto msgpackDeserVal(const msgpack::Val &j, std::unordered_map<std::string, T> &v) -> void
+  auto msgpackDeserVal(const msgpack::Val &j, std::deque<T> &v) -> void
   {
-    if (!std::holds_alternative<msgpack::Map>(j))
-      throw msgpack::ParsingError{"Type mismatch. Expected Map, got " + get_type_name(j)};
-    const auto &map = std::get<msgpack::Map>(j);
-    for (const auto &e : map)
+    if (!std::holds_alternative<msgpack::Array>(j))
+      throw msgpack::ParsingError{"Type mismatch. Expected Array, got " + get_type_name(j)};
+    const auto &arr = std::get<msgpack::Array>(j);
+    v.resize(arr.size());
+    for (size_t i = 0; i < arr.size(); ++i)
+      msgpackDeser(arr[i], v[i]);
+  }
+
+  template <typename T>
+  auto msgpackDeserVal(const msgpack::Val &j, std::set<T> &v) -> void
+  {
+    if (!std::holds_alternative<msgpack::Array>(j))
+      throw msgpack::ParsingError{"Type mismatch. Expected Array, got " + get_type_name(j)};
+    v.clear();
+    for (const auto &e : std::get<msgpack::Array>(j))
     {
-      if (!std::holds_alternative<std::string_view>(e.first))
-        throw msgpack::ParsingError{"Type mismatch. Expected string_view, got " +
-                                    get_type_name(e.first)};
-      auto key = std::string{std::get<std::string_view>(e.first)};
-      auto tmp = v.emplace(key, T{});
-      msgpackDeser(e.second, tmp.first->second);
+      auto tmp = T{};
+      msgpackDeser(e, tmp);
+      // encoded sets are sorted, so the end is the right hint
+      v.emplace_hint(v.end(), std::move(tmp));
     }
   }
 
   template <typename T>
-  auto msgpackDeserVal(const msgpack::Val &j, std::map<std::string, T> &v) -> void
+  auto msgpackDeserVal(const msgpack::Val &j, std::unordered_set<T> &v) -> void
   {
-    if (!std::holds_alternative<msgpack::Map>(j))
-      throw msgpack::ParsingError{"Type mismatch. Expected Map, got " + get_type_name(j)};
-    const auto &map = std::get<msgpack::Map>(j);
-    for (const auto &e : map)
+    if (!std::holds_alternative<msgpack::Array>(j))
+      throw msgpack::ParsingError{"Type mismatch. Expected Array, got " + get_type_name(j)};
+    const auto &arr = std::get<msgpack::Array>(j);
+    v.clear();
+    v.reserve(arr.size());
+    for (const auto &e : arr)
     {
-      if (!std::holds_alternative<std::string_view>(e.first))
-        throw msgpack::ParsingError{"Type mismatch. Expected string_view, got " +
-                                    get_type_name(e.first)};
-      auto key = std::string{std::get<std::string_view>(e.first)};
-      auto tmp = v.emplace(key, T{});
-      msgpackDeser(e.second, tmp.first->second);
+      auto tmp = T{};
+      msgpackDeser(e, tmp);
+      v.emplace(std::move(tmp));
     }
   }
 
-  template <typename U, typename T>
-  auto msgpackDeserVal(const msgpack::Val &j, std::unordered_map<U, T> &v)
-    -> std::enable_if_t<std::is_integral_v<U> || std::is_enum_v<U>>
+  auto msgpackDeserVal(const msgpack::Val &j, bool &v) -> void;
+
+  template <size_t N, typename V>
+  auto msgpackDeserAlt(const msgpack::Val &j, V &v) -> void
   {
-    if (!std::holds_alternative<msgpack::Map>(j))
-      throw msgpack::ParsingError{"Type mismatch. Expected Map, got " + get_type_name(j)};
-    const auto &map = std::get<msgpack::Map>(j);
-    for (const auto &e : map)
+    if (v.index() == N)
+      msgpackDeser(j, *std::get_if<N>(&v));
+    else
+      msgpackDeser(j, v.template emplace<N>());
+  }
+
+  template <typename V, size_t... Ns>
+  constexpr auto variantDeserTable(std::index_sequence<Ns...>)
+  {
+    using Fn = void (*)(const msgpack::Val &, V &);
+    return std::array<Fn, sizeof...(Ns)>{&msgpackDeserAlt<Ns, V>...};
+  }
+
+  template <typename... Ts>
+  auto msgpackDeserVal(const msgpack::Val &j, std::variant<Ts...> &v) -> void
+  {
+    static constexpr auto table =
+      variantDeserTable<std::variant<Ts...>>(std::index_sequence_for<Ts...>{});
+    const auto &arr = getArray(j, 2);
+    auto idx = size_t{};
+    msgpackDeserVal(arr[0], idx);
+    if (idx >= table.size())
+      throw msgpack::ParsingError{"Variant index " + std::to_string(idx) + " out of range"};
+    table[idx](arr[1], v);
+  }
+
+  // Finds a string key without building a key string: by heterogeneous lookup when the map
+  // supports it, through a reused scratch string otherwise. Interned keys are probed with a
+  // handle aliasing the scratch string, since interning the key could evict live pool entries.
+  template <typename M>
+  auto findStringKey(M &v, std::string_view key)
+  {
+    using K = typename M::key_type;
+    if constexpr (requires { v.find(key); })
+      return v.find(key);
+    else if constexpr (requires(K & k) { k.assign(key); })
+    {
+      thread_local auto scratch = K{};
+      scratch.assign(key);
+      return v.find(scratch);
+    }
+    else if constexpr (std::is_same_v<K, msgpack::Interned>)
     {
-      U key;
-      msgpackDeserVal(e.first, key);
-      auto tmp = v.emplace(key, T{});
-      msgpackDeser(e.second, tmp.first->second);
+      thread_local auto scratch = std::string{};
+      scratch.assign(key);
+      return v.find(K{std::shared_ptr<const std::string>{std::shared_ptr<void>{}, &scratch}});
     }
+    else
+      return v.find(K{key});
   }
 
-  template <typename U, typename T>
-  auto msgpackDeserVal(const msgpack::Val &j, std::map<U, T> &v)
-    -> std::enable_if_t<std::is_integral_v<U> || std::is_enum_v<U>>
+  // Decodes into an existing map: entries that are already present are updated in place, new ones
+  // are added and entries missing from the message are erased afterwards.
+  template <typename M>
+  auto msgpackDeserMap(const msgpack::Val &j, M &v) -> void
   {
+    using K = typename M::key_type;
     if (!std::holds_alternative<msgpack::Map>(j))
       throw msgpack::ParsingError{"Type mismatch. Expected Map, got " + get_type_name(j)};
     const auto &map = std::get<msgpack::Map>(j);
+    if constexpr (requires { v.reserve(map.size()); })
+      v.reserve(map.size());
+    // Entries the message decoded into, to tell how many distinct keys it has. Nested maps of the
+    // same type push and pop their own entries above ours.
+    thread_local auto seen = std::vector<const void *>{};
+    struct Pop
+    {
+      ~Pop() { seen.resize(first); }
+      size_t first;
+    } const pop{seen.size()};
     for (const auto &e : map)
     {
-      U key;
-      msgpackDeserVal(e.first, key);
-      auto tmp = v.emplace(key, T{});
-      msgpackDeser(e.second, tmp.first->second);
+      auto it = v.end();
+      if constexpr (IsStringKey<K>::value)
+      {
+        if (!std::holds_alternative<std::string_view>(e.first))
+          throw msgpack::ParsingError{"Type mismatch. Expected string_view, got " +
+                                      get_type_name(e.first)};
+        const auto key = std::get<std::string_view>(e.first);
+        it = findStringKey(v, key);
+        if (it == v.end())
+        {
+          msgpack::stats::grew();
+          it = v.emplace(K{key}, typename M::mapped_type{}).first;
+        }
+      }
+      else
+      {
+        auto key = K{};
+        msgpackDeserVal(e.first, key);
+        it = v.find(key);
+        if (it == v.end())
+        {
+          msgpack::stats::grew();
+          it = v.emplace(key, typename M::mapped_type{}).first;
+        }
+      }
+      seen.push_back(&*it);
+      msgpackDeser(e.second, it->second);
+    }
+
+    // a key repeated in the message decodes into the same entry twice
+    auto sweep = v.size() > map.size();
+    if (!sweep)
+    {
+      const auto ours = seen.begin() + static_cast<ptrdiff_t>(pop.first);
+      std::sort(ours, seen.end(), std::less<>{});
+      sweep = v.size() > static_cast<size_t>(std::unique(ours, seen.end()) - ours);
     }
+    if (sweep)
+    {
+      using Key = std::conditional_t<IsStringKey<K>::value, std::string_view, K>;
+      auto keys = std::unordered_set<Key>{};
+      for (const auto &e : map)
+        if constexpr (IsStringKey<K>::value)
+          keys.insert(std::get<std::string_view>(e.first));
+        else
+        {
+          auto key = K{};
+          msgpackDeserVal(e.first, key);
+          keys.insert(key);
+        }
+      std::erase_if(v, [&keys](const auto &kv) { return !keys.contains(Key{kv.first}); });
+    }
+  }
+
+  template <typename K, typename T, typename H, typename E, typename A>
+  auto msgpackDeserVal(const msgpack::Val &j, std::unordered_map<K, T, H, E, A> &v)
+    -> std::enable_if_t<IsStringKey<K>::value>
+  {
+    msgpackDeserMap(j, v);
+  }
+
+  template <typename K, typename T, typename C, typename A>
+  auto msgpackDeserVal(const msgpack::Val &j, std::map<K, T, C, A> &v)
+    -> std::enable_if_t<IsStringKey<K>::value>
+  {
+    msgpackDeserMap(j, v);
+  }
+
+  template <typename U, typename T, typename H, typename E, typename A>
+  auto msgpackDeserVal(const msgpack::Val &j, std::unordered_map<U, T, H, E, A> &v)
+    -> std::enable_if_t<std::is_integral_v<U> || std::is_enum_v<U>>
+  {
+    msgpackDeserMap(j, v);
+  }
+
+  template <typename U, typename T, typename C, typename A>
+  auto msgpackDeserVal(const msgpack::Val &j, std::map<U, T, C, A> &v)
+    -> std::enable_if_t<std::is_integral_v<U> || std::is_enum_v<U>>
+  {
+    msgpackDeserMap(j, v);
   }
 
-  // null
-  // optional
+  auto msgpackSerVal(std::ostream &st, std::nullptr_t) -> void;
+
+  template <typename T>
+  auto msgpackSerVal(std::ostream &st, const std::optional<T> &v) -> void
+  {
+    if (v)
+      msgpackSer(st, *v);
+    else
+      msgpackSerVal(st, nullptr);
+  }
+
+  template <typename T>
+  auto msgpackDeserVal(const msgpack::Val &j, std::optional<T> &v) -> void
+  {
+    if (std::holds_alternative<std::nullptr_t>(j))
+      v.reset();
+    else if (v)
+      msgpackDeser(j, *v);
+    else
+      msgpackDeser(j, v.emplace());
+  }
+
+  template <typename T>
+  auto isDefault(const T &v) -> bool
+  {
+    if constexpr (requires { v.has_value(); })
+      return !v.has_value();
+    else if constexpr (requires { v.empty(); })
+      return v.empty();
+    else if constexpr (std::is_floating_point_v<T>)
+      return v == 0 && !std::signbit(v); // -0.0 must be written to keep its sign
+    else if constexpr (std::is_arithmetic_v<T> || std::is_enum_v<T>)
+      return v == T{};
+    else
+      return false;
+  }
+
+  // Encoded field names (str header and bytes) of a SER_PROPS struct in ser() call order. The
+  // names reach us only at run time, so they are encoded once per type on first use.
+  struct FieldKeys
+  {
+    std::string bytes;
+    std::vector<std::string_view> keys;
+  };
+
+  template <typename T>
+  auto fieldKeys(const T &v) -> const FieldKeys &
+  {
+    static const auto r = [&v]() {
+      auto sst = std::ostringstream{};
+      auto ends = std::vector<size_t>{};
+      auto l = [&](const char *name, const auto &) {
+        msgpackSerVal(sst, name);
+        ends.push_back(static_cast<size_t>(sst.tellp()));
+      };
+      v.ser(l);
+      auto keys = FieldKeys{std::move(sst).str(), {}};
+      auto begin = size_t{0};
+      for (const auto end : ends)
+      {
+        keys.keys.push_back(std::string_view{keys.bytes}.substr(begin, end - begin));
+        begin = end;
+      }
+      return keys;
+    }();
+    return r;
+  }
+
+  // Writes a precomputed field-name key, through the stream's key dictionary if it has one.
+  inline auto msgpackSerKey(std::ostream &st,
+                            msgpack::KeyDict *dict,
+                            const char *name,
+                            std::string_view key) -> void
+  {
+    if (dict)
+      dict->write(st, name, key);
+    else
+      st.write(key.data(), static_cast<std::streamsize>(key.size()));
+  }
 
   struct MsgpackArch
   {
-    MsgpackArch(const msgpack::Map &aMap) : map(aMap), index(0) {}
+    MsgpackArch(const msgpack::Map &aMap) : map(&aMap), arr(nullptr), index(0) {}
+    MsgpackArch(const msgpack::Array &aArr) : map(nullptr), arr(&aArr), index(0) {}
 
     template <typename T>
-    auto operator()([[maybe_unused]] const char *name, T &vv) -> void
+    auto operator()(const char *name, T &vv) -> void
     {
-      if (index >= map.size())
+      if (map && !findKey(name))
+      {
+        vv = T{};
+        return;
+      }
+      if (index >= size())
         return;
 
-      if constexpr (InternalMsgPack::IsVariant<T>::value)
+      const auto &val_to_deser = at(index);
+      if constexpr (IsSerializableClassV<T>)
       {
-        size_t type_idx = 0;
-        const auto &type_val = map[index++].second;
-        if (std::holds_alternative<uint64_t>(type_val))
-          type_idx = static_cast<size_t>(std::get<uint64_t>(type_val));
-        else if (std::holds_alternative<int64_t>(type_val))
-          type_idx = static_cast<size_t>(std::get<int64_t>(type_val));
-
-        const auto &val_to_deser = map[index].second;
-        InternalMsgPack::msgpackDeserVal(val_to_deser, type_idx, vv);
-        index++;
+        msgpackDeser(val_to_deser, vv);
       }
       else
       {
-        const auto &val_to_deser = map[index].second;
-        if constexpr (IsSerializableClassV<T>)
-        {
-          msgpackDeser(val_to_deser, vv);
-        }
-        else
+        msgpackDeserVal(val_to_deser, vv);
+      }
+      index++;
+    }
+
+    // Positions index at the entry for key name. Fields usually come in declaration order, so the
+    // entry at index is tried first.
+    auto findKey(std::string_view name) -> bool
+    {
+      const auto isKey = [&](size_t i) {
+        const auto &k = (*map)[i].first;
+        return std::holds_alternative<std::string_view>(k) && std::get<std::string_view>(k) == name;
+      };
+      if (index < map->size() && isKey(index))
+        return true;
+      for (size_t i = 0; i < map->size(); ++i)
+        if (isKey(i))
         {
-          msgpackDeserVal(val_to_deser, vv);
+          index = i;
+          return true;
         }
-        index++;
-      }
+      return false;
     }
-    const msgpack::Map &map;
+
+    auto size() const -> size_t { return map ? map->size() : arr->size(); }
+    auto at(size_t i) const -> const msgpack::Val & { return map ? (*map)[i].second : (*arr)[i]; }
+
+    const msgpack::Map *map;
+    const msgpack::Array *arr;
     size_t index;
   };
 } // namespace InternalMsgPack
 
 template <typename T>
-auto msgpackSer(std::ostream &st, T v) -> void
+auto msgpackSer(std::ostream &st, const T &v) -> void
 {
+  const auto timer = msgpack::StatsTimer{st};
   if constexpr (IsSerializableClassV<T>)
   {
-    std::stringstream sst;
-    size_t count = 0;
-    auto l = [&](const char *name, auto vv) mutable {
-      if constexpr (InternalMsgPack::IsVariant<decltype(vv)>::value)
-      {
-        InternalMsgPack::msgpackSerVal(sst, std::string(name) + "Type");
-        msgpackSer(sst, vv.index());
-        count++;
-      }
-      InternalMsgPack::msgpackSerVal(sst, name);
-      msgpackSer(sst, std::move(vv));
-      count++;
-    };
-    v.ser(l);
+    const auto &keys = InternalMsgPack::fieldKeys(v).keys;
+    const auto flags = InternalMsgPack::serFlags(st);
+    const auto dict = msgpack::keyDictOf(st);
 
-    if (count < 16)
-    {
-      st.put(static_cast<char>(0x80 | count));
-    }
-    else if (count < 65536)
+    if (msgpack::SerAsArray<T>::value || (flags & InternalMsgPack::StructAsArray))
     {
-      st.put(static_cast<char>(0xde));
-      st.put(static_cast<char>(count >> 8));
-      st.put(static_cast<char>(count));
+      InternalMsgPack::msgpackSerArrayHeader(st, keys.size());
+      auto l = [&st](const char *, const auto &vv) { msgpackSer(st, vv); };
+      v.ser(l);
+      return;
     }
-    else
+
+    if (flags & InternalMsgPack::OmitDefaults)
     {
-      st.put(static_cast<char>(0xdf));
-      st.put(static_cast<char>(count >> 24));
-      st.put(static_cast<char>(count >> 16));
-      st.put(static_cast<char>(count >> 8));
-      st.put(static_cast<char>(count));
+      size_t count = 0;
+      auto c = [&count](const char *, const auto &vv) {
+        if (!InternalMsgPack::isDefault(vv))
+          ++count;
+      };
+      v.ser(c);
+      InternalMsgPack::msgpackSerMapHeader(st, count);
+      auto key = keys.begin();
+      auto l = [&st, &key, dict](const char *name, const auto &vv) {
+        if (!InternalMsgPack::isDefault(vv))
+        {
+          InternalMsgPack::msgpackSerKey(st, dict, name, *key);
+          msgpackSer(st, vv);
+        }
+        ++key;
+      };
+      v.ser(l);
+      return;
     }
-    st << sst.rdbuf();
+
+    InternalMsgPack::msgpackSerMapHeader(st, keys.size());
+    auto key = keys.begin();
+    auto l = [&st, &key, dict](const char *name, const auto &vv) {
+      InternalMsgPack::msgpackSerKey(st, dict, name, *key);
+      ++key;
+      msgpackSer(st, vv);
+    };
+    v.ser(l);
   }
   else
-    InternalMsgPack::msgpackSerVal(st, std::move(v));
+    InternalMsgPack::msgpackSerVal(st, v);
 }
 
 template <typename T>
 auto msgpackDeser(const msgpack::Val &jv, T &v) -> void
 {
+  const auto timer = msgpack::StatsTimer{};
   if constexpr (IsSerializableClassV<T>)
   {
-    auto arch = InternalMsgPack::MsgpackArch{std::get<msgpack::Map>(jv)};
-    v.deser(arch);
+    if (std::holds_alternative<msgpack::Map>(jv))
+    {
+      auto arch = InternalMsgPack::MsgpackArch{std::get<msgpack::Map>(jv)};
+      v.deser(arch);
+    }
+    else if (std::holds_alternative<msgpack::Array>(jv))
+    {
+      auto arch = InternalMsgPack::MsgpackArch{std::get<msgpack::Array>(jv)};
+      v.deser(arch);
+    }
+    else
+      throw msgpack::ParsingError{"Type mismatch. Expected Map, got " +
+                                  InternalMsgPack::get_type_name(jv)};
   }
   else
     InternalMsgPack::msgpackDeserVal(jv, v);
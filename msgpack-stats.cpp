@@ -0,0 +1,153 @@
+// (c) 2025 Mika Pi
+
+#include "msgpack-stats.hpp"
+#include <algorithm>
+
+namespace msgpack
+{
+  namespace
+  {
+    thread_local StatsScope *currentScope = nullptr;
+  } // namespace
+
+  auto Stats::operator+=(const Stats &o) -> Stats &
+  {
+    bytes += o.bytes;
+    for (size_t i = 0; i < nodes.size(); ++i)
+      nodes[i] += o.nodes[i];
+    maxDepth = std::max(maxDepth, o.maxDepth);
+    maxContainer = std::max(maxContainer, o.maxContainer);
+    containerElements += o.containerElements;
+    growths += o.growths;
+    elapsed += o.elapsed;
+    return *this;
+  }
+
+  StatsScope::StatsScope(Stats &s) : out(s), prev(currentScope)
+  {
+    currentScope = this;
+  }
+
+  StatsScope::StatsScope(std::function<void(const Stats &)> f)
+    : out(own), cb(std::move(f)), prev(currentScope)
+  {
+    currentScope = this;
+  }
+
+  StatsScope::~StatsScope()
+  {
+    currentScope = prev;
+    if (cb)
+      cb(out);
+  }
+
+  auto StatsScope::current() -> StatsScope *
+  {
+    return currentScope;
+  }
+
+  auto StatsScope::stats() -> Stats &
+  {
+    return out;
+  }
+
+#ifdef MSGPACK_STATS
+  StatsTimer::StatsTimer() : scope(currentScope)
+  {
+    if (!scope || scope->timers++ > 0)
+      return;
+    scope->depth = 0;
+    t0 = std::chrono::steady_clock::now();
+  }
+
+  StatsTimer::StatsTimer(std::ostream &aSt) : StatsTimer()
+  {
+    if (!scope || scope->timers > 1)
+      return;
+    st = &aSt;
+    start = aSt.tellp();
+  }
+
+  StatsTimer::~StatsTimer()
+  {
+    if (!scope || --scope->timers > 0)
+      return;
+    scope->out.elapsed += std::chrono::steady_clock::now() - t0;
+    if (st && start != std::ostream::pos_type(-1))
+    {
+      const auto end = st->tellp();
+      if (end != std::ostream::pos_type(-1))
+        scope->out.bytes += static_cast<size_t>(end - start);
+    }
+  }
+
+  namespace stats
+  {
+    auto parsed(uint8_t b) -> void
+    {
+      if (!currentScope)
+        return;
+      auto t = NodeType::Int;
+      if (b == 0xc0)
+        t = NodeType::Nil;
+      else if (b == 0xc2 || b == 0xc3)
+        t = NodeType::Bool;
+      else if (b <= 0x7f || b >= 0xe0 || (b >= 0xcc && b <= 0xd3))
+        t = NodeType::Int;
+      else if (b == 0xca || b == 0xcb)
+        t = NodeType::Float;
+      else if ((b & 0xe0) == 0xa0 || (b >= 0xd9 && b <= 0xdb))
+        t = NodeType::Str;
+      else if (b >= 0xc4 && b <= 0xc6)
+        t = NodeType::Bin;
+      else if ((b & 0xf0) == 0x90 || b == 0xdc || b == 0xdd)
+        t = NodeType::Array;
+      else if ((b & 0xf0) == 0x80 || b == 0xde || b == 0xdf)
+        t = NodeType::Map;
+      else
+        t = NodeType::Ext;
+      ++currentScope->stats().nodes[static_cast<size_t>(t)];
+    }
+
+    auto written(NodeType t) -> void
+    {
+      if (currentScope)
+        ++currentScope->stats().nodes[static_cast<size_t>(t)];
+    }
+
+    auto bytes(size_t n) -> void
+    {
+      if (currentScope)
+        currentScope->stats().bytes += n;
+    }
+
+    auto enter(size_t n) -> void
+    {
+      if (!currentScope)
+        return;
+      auto &s = currentScope->stats();
+      s.maxDepth = std::max(s.maxDepth, ++currentScope->depth);
+      s.maxContainer = std::max(s.maxContainer, n);
+      s.containerElements += n;
+    }
+
+    auto leave() -> void
+    {
+      if (currentScope)
+        --currentScope->depth;
+    }
+
+    auto reserve(size_t capacity, size_t n) -> void
+    {
+      if (currentScope && n > capacity)
+        ++currentScope->stats().growths;
+    }
+
+    auto grew() -> void
+    {
+      if (currentScope)
+        ++currentScope->stats().growths;
+    }
+  } // namespace stats
+#endif
+} // namespace msgpack
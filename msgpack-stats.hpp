@@ -0,0 +1,133 @@
+// (c) 2025 Mika Pi
+
+#pragma once
+#include <array>
+#include <chrono>
+#include <cstddef>
+#include <cstdint>
+#include <functional>
+#include <ostream>
+
+// Instrumentation of Blob parsing, msgpackSer and msgpackDeser. The hooks are only compiled in
+// when MSGPACK_STATS is defined, which must be consistent across the whole build; without it they
+// are empty inline functions and StatsScope collects nothing.
+
+namespace msgpack
+{
+  enum class NodeType : uint8_t
+  {
+    Nil,
+    Bool,
+    Int,
+    Float,
+    Str,
+    Bin,
+    Array,
+    Map,
+    Ext,
+    Count
+  };
+
+  struct Stats
+  {
+    // Bytes parsed, and bytes written by msgpackSer when the stream reports its position.
+    size_t bytes = 0;
+    // Values parsed by Blob plus values written by msgpackSer, not counting struct field names.
+    std::array<size_t, static_cast<size_t>(NodeType::Count)> nodes{};
+    // Deepest array/map nesting parsed.
+    size_t maxDepth = 0;
+    // Largest array/map element count parsed, and the total over all of them.
+    size_t maxContainer = 0;
+    size_t containerElements = 0;
+    // Times storage had to grow: parsed arrays/maps and decoded strings and vectors whose
+    // capacity was smaller than their new size, plus map entries added. This estimates heap
+    // allocations from capacities; the allocator itself is not observed. Storage reused from a
+    // previous decode is not counted.
+    size_t growths = 0;
+    // Time spent in the outermost Blob parse, msgpackSer or msgpackDeser calls.
+    std::chrono::nanoseconds elapsed{};
+
+    auto count(NodeType t) const -> size_t { return nodes[static_cast<size_t>(t)]; }
+    auto operator+=(const Stats &) -> Stats &;
+  };
+
+  namespace stats
+  {
+#ifdef MSGPACK_STATS
+    // A value starting with type byte b was parsed.
+    auto parsed(uint8_t b) -> void;
+    auto written(NodeType) -> void;
+    auto bytes(size_t) -> void;
+    // Entering and leaving a parsed container of n elements.
+    auto enter(size_t n) -> void;
+    auto leave() -> void;
+    // Storage of the given capacity is about to hold n elements.
+    auto reserve(size_t capacity, size_t n) -> void;
+    // Storage was added for a new element, such as a map entry.
+    auto grew() -> void;
+#else
+    inline auto parsed(uint8_t) -> void {}
+    inline auto written(NodeType) -> void {}
+    inline auto bytes(size_t) -> void {}
+    inline auto enter(size_t) -> void {}
+    inline auto leave() -> void {}
+    inline auto reserve(size_t, size_t) -> void {}
+    inline auto grew() -> void {}
+#endif
+  } // namespace stats
+
+  // Collects stats of the current thread into a Stats, or passes them to a callback when the
+  // scope ends. Scopes nest; only the innermost one collects. Worker threads, e.g. of
+  // parallelParse, are not covered.
+  class StatsScope
+  {
+  public:
+    explicit StatsScope(Stats &);
+    explicit StatsScope(std::function<void(const Stats &)>);
+    ~StatsScope();
+    StatsScope(const StatsScope &) = delete;
+    auto operator=(const StatsScope &) -> StatsScope & = delete;
+
+    static auto current() -> StatsScope *;
+    auto stats() -> Stats &;
+
+  private:
+    friend class StatsTimer;
+#ifdef MSGPACK_STATS
+    friend auto stats::enter(size_t) -> void;
+    friend auto stats::leave() -> void;
+#endif
+    Stats own;
+    Stats &out;
+    std::function<void(const Stats &)> cb;
+    StatsScope *prev;
+    size_t depth = 0;
+    size_t timers = 0;
+  };
+
+  // Times the outermost of nested instrumented calls; bytes written to st are counted on exit.
+  class StatsTimer
+  {
+  public:
+#ifdef MSGPACK_STATS
+    StatsTimer();
+    explicit StatsTimer(std::ostream &st);
+    ~StatsTimer();
+#else
+    StatsTimer() {}
+    explicit StatsTimer(std::ostream &) {}
+    ~StatsTimer() {}
+#endif
+    StatsTimer(const StatsTimer &) = delete;
+    auto operator=(const StatsTimer &) -> StatsTimer & = delete;
+
+#ifdef MSGPACK_STATS
+  private:
+    StatsScope *scope;
+    std::ostream *st = nullptr;
+    std::ostream::pos_type start;
+    std::chrono::steady_clock::time_point t0;
+#endif
+  };
+
+} // namespace msgpack
@@ -0,0 +1,293 @@
+// (c) 2025 Mika Pi
+
+#include "msgpack-try.hpp"
+
+namespace
+{
+  using InternalMsgPack::Kind;
+
+  // Type byte layout: `size` bytes before the payload (the whole value for fixed-size types) of
+  // which `width` hold the length or count. Fix types carry it in the type byte.
+  struct Head
+  {
+    Kind kind;
+    uint8_t size;
+    uint8_t width;
+  };
+
+  auto head(uint8_t b) -> Head
+  {
+    if (b <= 0x7f || b >= 0xe0)
+      return {Kind::Int, 1, 0};
+    if ((b & 0xe0) == 0xa0)
+      return {Kind::Str, 1, 0};
+    if ((b & 0xf0) == 0x90)
+      return {Kind::Array, 1, 0};
+    if ((b & 0xf0) == 0x80)
+      return {Kind::Map, 1, 0};
+    switch (b)
+    {
+    case 0xc0:
+      return {Kind::Nil, 1, 0};
+    case 0xc2:
+    case 0xc3:
+      return {Kind::Bool, 1, 0};
+    case 0xcc:
+    case 0xd0:
+      return {Kind::Int, 2, 0};
+    case 0xcd:
+    case 0xd1:
+      return {Kind::Int, 3, 0};
+    case 0xce:
+    case 0xd2:
+      return {Kind::Int, 5, 0};
+    case 0xcf:
+    case 0xd3:
+      return {Kind::Int, 9, 0};
+    case 0xca:
+      return {Kind::Float32, 5, 0};
+    case 0xcb:
+      return {Kind::Float64, 9, 0};
+    case 0xd9:
+      return {Kind::Str, 2, 1};
+    case 0xda:
+      return {Kind::Str, 3, 2};
+    case 0xdb:
+      return {Kind::Str, 5, 4};
+    case 0xc4:
+      return {Kind::Bin, 2, 1};
+    case 0xc5:
+      return {Kind::Bin, 3, 2};
+    case 0xc6:
+      return {Kind::Bin, 5, 4};
+    case 0xdc:
+      return {Kind::Array, 3, 2};
+    case 0xdd:
+      return {Kind::Array, 5, 4};
+    case 0xde:
+      return {Kind::Map, 3, 2};
+    case 0xdf:
+      return {Kind::Map, 5, 4};
+    default:
+      return {Kind::Other, 0, 0};
+    }
+  }
+
+  auto readBe(const std::byte *p, size_t width) -> uint64_t
+  {
+    auto v = uint64_t{0};
+    for (size_t i = 0; i < width; ++i)
+      v = v << 8 | static_cast<uint8_t>(p[i]);
+    return v;
+  }
+
+  // Length of a str/bin or element count of an array/map whose head is within bounds.
+  auto length(const std::byte *p, Head h) -> uint64_t
+  {
+    if (h.width > 0)
+      return readBe(p + 1, h.width);
+    const auto b = static_cast<uint8_t>(p[0]);
+    if (h.kind == Kind::Str)
+      return b & 0x1f;
+    if (h.kind == Kind::Array || h.kind == Kind::Map)
+      return b & 0x0f;
+    return 0;
+  }
+} // namespace
+
+namespace msgpack
+{
+  auto message(Errc code) -> const char *
+  {
+    switch (code)
+    {
+    case Errc::UnexpectedEof:
+      return "Unexpected EOF";
+    case Errc::UnknownType:
+      return "Unknown type byte";
+    case Errc::ExtraBytes:
+      return "Extra bytes after top-level object";
+    case Errc::TooDeep:
+      return "Nesting too deep";
+    case Errc::TypeMismatch:
+      return "Type mismatch";
+    case Errc::SizeMismatch:
+      return "Size mismatch";
+    case Errc::OutOfRange:
+      return "Variant index out of range";
+    }
+    return "Unknown error";
+  }
+
+  auto Error::pathString() const -> std::string
+  {
+    auto r = std::string{depth > MaxPath ? "$..." : "$"};
+    const auto p = path();
+    for (auto it = p.rbegin(); it != p.rend(); ++it)
+      if (it->isKey)
+        r.append(".").append(it->key);
+      else
+        r.append("[").append(std::to_string(it->index)).append("]");
+    return r;
+  }
+
+  auto raise(const Error &e) -> void
+  {
+    throw ParsingError{std::string{e.what()} + " at offset " + std::to_string(e.offset()) +
+                       " in " + e.pathString()};
+  }
+
+  auto Result<void>::value() const -> void
+  {
+    if (failed)
+      raise(err);
+  }
+
+  auto tryParse(std::span<const std::byte> in) -> Result<Blob>
+  {
+    auto r = InternalMsgPack::TryReader{in};
+    if (!r.skip())
+      return r.error();
+    if (!r.done())
+    {
+      r.fail(Errc::ExtraBytes);
+      return r.error();
+    }
+    return Blob{in};
+  }
+} // namespace msgpack
+
+namespace InternalMsgPack
+{
+  auto TryReader::kind() const -> Kind
+  {
+    return pos == in.size() ? Kind::Other : head(static_cast<uint8_t>(in[pos])).kind;
+  }
+
+  auto TryReader::mismatch() const -> msgpack::Errc
+  {
+    if (pos == in.size())
+      return msgpack::Errc::UnexpectedEof;
+    if (kind() == Kind::Other)
+      return msgpack::Errc::UnknownType;
+    return msgpack::Errc::TypeMismatch;
+  }
+
+  auto TryReader::skip() -> bool
+  {
+    // elements left in each open container
+    auto open = std::array<uint64_t, MaxDepth>{};
+    auto top = size_t{0};
+    for (;;)
+    {
+      if (pos == in.size())
+        return fail(msgpack::Errc::UnexpectedEof);
+      const auto h = head(static_cast<uint8_t>(in[pos]));
+      if (h.kind == Kind::Other)
+        return fail(msgpack::Errc::UnknownType);
+      const auto left = in.size() - pos;
+      if (h.size > left)
+        return fail(msgpack::Errc::UnexpectedEof);
+      const auto len = length(in.data() + pos, h);
+      auto elements = uint64_t{0};
+      if (h.kind == Kind::Array || h.kind == Kind::Map)
+      {
+        // every element takes at least one byte
+        elements = h.kind == Kind::Map ? 2 * len : len;
+        if (elements > left - h.size)
+          return fail(msgpack::Errc::UnexpectedEof);
+        pos += h.size;
+      }
+      else
+      {
+        if (len > left - h.size)
+          return fail(msgpack::Errc::UnexpectedEof);
+        pos += h.size + len;
+      }
+
+      if (elements > 0)
+      {
+        if (depth + top >= MaxDepth)
+          return fail(msgpack::Errc::TooDeep);
+        open[top++] = elements;
+        continue;
+      }
+      while (top > 0 && --open[top - 1] == 0)
+        --top;
+      if (top == 0)
+        return true;
+    }
+  }
+
+  auto TryReader::container(Kind k, size_t &n) -> bool
+  {
+    if (kind() != k)
+      return fail(mismatch());
+    const auto h = head(static_cast<uint8_t>(in[pos]));
+    const auto left = in.size() - pos;
+    if (h.size > left)
+      return fail(msgpack::Errc::UnexpectedEof);
+    const auto len = length(in.data() + pos, h);
+    if ((k == Kind::Map ? 2 * len : len) > left - h.size)
+      return fail(msgpack::Errc::UnexpectedEof);
+    if (depth >= MaxDepth)
+      return fail(msgpack::Errc::TooDeep);
+    ++depth;
+    n = static_cast<size_t>(len);
+    pos += h.size;
+    return true;
+  }
+
+  auto TryReader::arrayHeader(size_t &n) -> bool
+  {
+    return container(Kind::Array, n);
+  }
+
+  auto TryReader::mapHeader(size_t &n) -> bool
+  {
+    return container(Kind::Map, n);
+  }
+
+  auto TryReader::str(std::string_view &s) -> bool
+  {
+    if (kind() != Kind::Str)
+      return fail(mismatch());
+    const auto h = head(static_cast<uint8_t>(in[pos]));
+    const auto left = in.size() - pos;
+    if (h.size > left)
+      return fail(msgpack::Errc::UnexpectedEof);
+    const auto len = length(in.data() + pos, h);
+    if (len > left - h.size)
+      return fail(msgpack::Errc::UnexpectedEof);
+    s = std::string_view{reinterpret_cast<const char *>(in.data() + pos + h.size),
+                         static_cast<size_t>(len)};
+    pos += h.size + len;
+    return true;
+  }
+
+  auto TryReader::binSize(size_t &n) -> bool
+  {
+    if (kind() != Kind::Bin)
+      return fail(mismatch());
+    const auto h = head(static_cast<uint8_t>(in[pos]));
+    if (h.size > in.size() - pos)
+      return fail(msgpack::Errc::UnexpectedEof);
+    n = static_cast<size_t>(length(in.data() + pos, h));
+    return true;
+  }
+
+  auto TryReader::integer(uint64_t &v) -> bool
+  {
+    if (kind() != Kind::Int)
+      return fail(mismatch());
+    const auto b = static_cast<uint8_t>(in[pos]);
+    const auto h = head(b);
+    if (h.size > in.size() - pos)
+      return fail(msgpack::Errc::UnexpectedEof);
+    const auto negative =
+      b >= 0xe0 || (b >= 0xd0 && b <= 0xd3 && static_cast<int8_t>(in[pos + 1]) < 0);
+    v = negative ? UINT64_MAX : h.size == 1 ? b : readBe(in.data() + pos + 1, h.size - 1u);
+    pos += h.size;
+    return true;
+  }
+} // namespace InternalMsgPack
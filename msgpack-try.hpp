@@ -0,0 +1,538 @@
+// (c) 2025 Mika Pi
+
+#pragma once
+#include "msgpack-ser.hpp"
+#include "msgpack.hpp"
+#include <algorithm>
+#include <array>
+#include <cstdint>
+#include <span>
+#include <string>
+#include <string_view>
+#include <type_traits>
+#include <variant>
+
+namespace msgpack
+{
+  enum class Errc : uint8_t
+  {
+    UnexpectedEof = 1,
+    UnknownType,
+    ExtraBytes,
+    TooDeep,
+    TypeMismatch,
+    SizeMismatch,
+    OutOfRange,
+  };
+
+  // Static description of code.
+  auto message(Errc code) -> const char *;
+
+  // One step of the path to a value: a map key or struct field name, or an array index.
+  struct PathStep
+  {
+    std::string_view key;
+    size_t index = 0;
+    bool isKey = false;
+  };
+
+  // Decoding failure: what went wrong, the offset in the input of the value it was found in and
+  // the path to that value. Errors are built and copied without allocating; keys in the path
+  // point into the input or at field names.
+  class Error
+  {
+  public:
+    static constexpr size_t MaxPath = 8;
+
+    Error() = default;
+    Error(Errc code, size_t offset) : errc(code), off(offset) {}
+
+    auto code() const -> Errc { return errc; }
+    auto offset() const -> size_t { return off; }
+    auto what() const -> const char * { return message(errc); }
+    // Steps from the failing value outwards, at most MaxPath of them.
+    auto path() const -> std::span<const PathStep>
+    {
+      return {steps.data(), std::min(depth, MaxPath)};
+    }
+    // Full length of the path.
+    auto pathDepth() const -> size_t { return depth; }
+    // The path in the form $.items[3].name, with ... for steps beyond MaxPath.
+    auto pathString() const -> std::string;
+
+    // Adds the step into the enclosing value while the decoder unwinds.
+    auto enclose(PathStep step) -> void
+    {
+      if (depth < MaxPath)
+        steps[depth] = step;
+      ++depth;
+    }
+
+  private:
+    Errc errc = Errc::UnexpectedEof;
+    size_t off = 0;
+    std::array<PathStep, MaxPath> steps;
+    size_t depth = 0;
+  };
+
+  // A value or the Error that prevented it, in the manner of std::expected.
+  template <typename T>
+  class [[nodiscard]] Result
+  {
+  public:
+    Result(T value) : v(std::in_place_index<0>, std::move(value)) {}
+    Result(const Error &e) : v(std::in_place_index<1>, e) {}
+
+    explicit operator bool() const { return v.index() == 0; }
+    auto hasValue() const -> bool { return v.index() == 0; }
+    auto operator*() -> T & { return *std::get_if<0>(&v); }
+    auto operator*() const -> const T & { return *std::get_if<0>(&v); }
+    auto operator->() -> T * { return std::get_if<0>(&v); }
+    auto operator->() const -> const T * { return std::get_if<0>(&v); }
+    // The value, or throws ParsingError describing the error.
+    auto value() -> T &;
+    auto error() const -> const Error & { return *std::get_if<1>(&v); }
+
+  private:
+    std::variant<T, Error> v;
+  };
+
+  template <>
+  class [[nodiscard]] Result<void>
+  {
+  public:
+    Result() = default;
+    Result(const Error &e) : err(e), failed(true) {}
+
+    explicit operator bool() const { return !failed; }
+    auto hasValue() const -> bool { return !failed; }
+    // Throws ParsingError describing the error, if any.
+    auto value() const -> void;
+    auto error() const -> const Error & { return err; }
+
+  private:
+    Error err;
+    bool failed = false;
+  };
+
+  // Throws the ParsingError for e.
+  [[noreturn]] auto raise(const Error &e) -> void;
+
+  template <typename T>
+  auto Result<T>::value() -> T &
+  {
+    if (!hasValue())
+      raise(error());
+    return **this;
+  }
+
+  // Parses the message in `in` like Blob(in), reporting malformed input as an Error instead of
+  // throwing. Every length and fixed-width field is checked against the end of the input before
+  // it is read, and nesting is limited to 256 levels. Not for key dictionary streams.
+  auto tryParse(std::span<const std::byte> in) -> Result<Blob>;
+
+  // Specialize as std::true_type for a class whose deser() can reject a message of the right
+  // shape, e.g. by checking its fields against each other. msgpackTryDeser decodes messages that
+  // contain such a class into a copy of the target.
+  template <typename T>
+  struct ValidatingDeser : std::false_type
+  {
+  };
+} // namespace msgpack
+
+// Decodes the message in `in` into v like msgpackDeser(msgpack::Blob{in}.val, v), reporting
+// malformed input and values that do not match T as an Error instead of throwing. The message is
+// checked against T before anything is decoded, and v is left unchanged on error. The check
+// covers SER_PROPS structs, scalars, strings, bins and the standard containers, which are decoded
+// straight into v, reusing its storage. A message that reaches any other type or a class marked
+// with msgpack::ValidatingDeser can still be rejected by its decoder, so it is decoded into a
+// copy of v that replaces v on success, and a ParsingError from the decoder is returned as
+// TypeMismatch at offset 0. Borrowed members point into `in`.
+template <typename T>
+auto msgpackTryDeser(std::span<const std::byte> in, T &v) -> msgpack::Result<void>;
+
+namespace InternalMsgPack
+{
+  enum class Kind : uint8_t
+  {
+    Nil,
+    Bool,
+    Int,
+    Float32,
+    Float64,
+    Str,
+    Bin,
+    Array,
+    Map,
+    Other, // ext, unused type bytes and the end of the input
+  };
+
+  // Cursor checking the shape of a message without decoding it. Every read either succeeds or
+  // records an Error and returns false.
+  class TryReader
+  {
+  public:
+    static constexpr size_t MaxDepth = 256;
+
+    explicit TryReader(std::span<const std::byte> aIn) : in(aIn) {}
+
+    auto done() const -> bool { return pos == in.size(); }
+    auto error() -> msgpack::Error & { return err; }
+    // Whether a value was left to a decoder the check does not cover, which may still throw.
+    auto decoderChecks() const -> bool { return deferred; }
+    auto deferToDecoder() -> void { deferred = true; }
+
+    auto kind() const -> Kind;
+    // Checks that the next value is well-formed and moves past it.
+    auto skip() -> bool;
+    // Like skip(), for a value of kind k.
+    auto expect(Kind k) -> bool { return kind() == k ? skip() : fail(mismatch()); }
+    // Opens an array or map of n elements, which must be closed with leave() once checked.
+    auto arrayHeader(size_t &n) -> bool;
+    auto mapHeader(size_t &n) -> bool;
+    auto leave() -> void { --depth; }
+    auto str(std::string_view &s) -> bool;
+    // Length of the bin that comes next, without moving past it.
+    auto binSize(size_t &n) -> bool;
+    // An integer; negative values read as UINT64_MAX.
+    auto integer(uint64_t &v) -> bool;
+
+    auto fail(msgpack::Errc code) -> bool
+    {
+      err = msgpack::Error{code, pos};
+      return false;
+    }
+    // Adds a step to the path of the error and returns false.
+    auto enclose(std::string_view key) -> bool
+    {
+      err.enclose(msgpack::PathStep{key, 0, true});
+      return false;
+    }
+    auto enclose(size_t index) -> bool
+    {
+      err.enclose(msgpack::PathStep{{}, index, false});
+      return false;
+    }
+
+  private:
+    auto mismatch() const -> msgpack::Errc;
+    auto container(Kind k, size_t &n) -> bool;
+
+    std::span<const std::byte> in;
+    size_t pos = 0;
+    size_t depth = 0;
+    msgpack::Error err;
+    bool deferred = false;
+  };
+
+  template <typename T>
+  auto tryCheck(TryReader &r, std::type_identity<T>) -> bool;
+  template <typename T, typename A>
+  auto tryCheck(TryReader &r, std::type_identity<std::vector<T, A>>) -> bool;
+  template <typename T, size_t N>
+  auto tryCheck(TryReader &r, std::type_identity<std::array<T, N>>) -> bool;
+  template <typename T, typename U>
+  auto tryCheck(TryReader &r, std::type_identity<std::pair<T, U>>) -> bool;
+  template <typename... Ts>
+  auto tryCheck(TryReader &r, std::type_identity<std::tuple<Ts...>>) -> bool;
+  template <typename T>
+  auto tryCheck(TryReader &r, std::type_identity<std::deque<T>>) -> bool;
+  template <typename T>
+  auto tryCheck(TryReader &r, std::type_identity<std::set<T>>) -> bool;
+  template <typename T>
+  auto tryCheck(TryReader &r, std::type_identity<std::unordered_set<T>>) -> bool;
+  template <typename T>
+  auto tryCheck(TryReader &r, std::type_identity<std::optional<T>>) -> bool;
+  template <typename... Ts>
+  auto tryCheck(TryReader &r, std::type_identity<std::variant<Ts...>>) -> bool;
+  template <typename K, typename T, typename H, typename E, typename A>
+  auto tryCheck(TryReader &r, std::type_identity<std::unordered_map<K, T, H, E, A>>) -> bool;
+  template <typename K, typename T, typename C, typename A>
+  auto tryCheck(TryReader &r, std::type_identity<std::map<K, T, C, A>>) -> bool;
+
+  // An array of n elements of type T, or of exactly `size` elements if it is given.
+  template <typename T>
+  auto tryCheckArray(TryReader &r, size_t size = SIZE_MAX) -> bool
+  {
+    auto n = size_t{};
+    if (!r.arrayHeader(n))
+      return false;
+    if (size != SIZE_MAX && n != size)
+      return r.fail(msgpack::Errc::SizeMismatch);
+    for (size_t i = 0; i < n; ++i)
+      if (!tryCheck(r, std::type_identity<T>{}))
+        return r.enclose(i);
+    r.leave();
+    return true;
+  }
+
+  template <typename T>
+  auto tryCheck(TryReader &r, std::type_identity<T>) -> bool
+  {
+    if constexpr (IsSerializableClassV<T>)
+    {
+      if constexpr (msgpack::ValidatingDeser<T>::value)
+        r.deferToDecoder();
+      // field types are known only through deser(), which needs an object to visit
+      thread_local auto proto = T{};
+      // a deser() that throws here rejects every message, for reasons the check cannot see
+      const auto visit = [&r](auto &arch) {
+        try
+        {
+          proto.deser(arch);
+          return true;
+        }
+        catch (...)
+        {
+          return r.fail(msgpack::Errc::TypeMismatch);
+        }
+      };
+      auto n = size_t{};
+      auto ok = true;
+      if (r.kind() == Kind::Array)
+      {
+        if (!r.arrayHeader(n))
+          return false;
+        auto i = size_t{0};
+        auto arch = [&](const char *, auto &vv) {
+          if (ok && i < n && !tryCheck(r, std::type_identity<std::decay_t<decltype(vv)>>{}))
+            ok = r.enclose(i);
+          ++i;
+        };
+        if (!visit(arch))
+          return false;
+        for (; ok && i < n; ++i)
+          ok = r.skip() || r.enclose(i);
+      }
+      else
+      {
+        if (!r.mapHeader(n))
+          return false;
+        for (size_t i = 0; ok && i < n; ++i)
+        {
+          auto key = std::string_view{};
+          if (r.kind() != Kind::Str)
+          {
+            // not a field, decoding ignores it
+            ok = (r.skip() && r.skip()) || r.enclose(i);
+            continue;
+          }
+          if (!r.str(key))
+            return r.enclose(i);
+          auto found = false;
+          auto arch = [&](const char *name, auto &vv) {
+            if (found || key != name)
+              return;
+            found = true;
+            ok = tryCheck(r, std::type_identity<std::decay_t<decltype(vv)>>{});
+          };
+          if (!visit(arch))
+            return false;
+          if (!found)
+            ok = r.skip();
+          if (!ok)
+            return r.enclose(key);
+        }
+      }
+      if (ok)
+        r.leave();
+      return ok;
+    }
+    else if constexpr (std::is_same_v<T, bool> || std::is_same_v<T, std::string>)
+      return r.skip(); // decoding leaves these unchanged on a type mismatch
+    else if constexpr (std::is_integral_v<T> || std::is_enum_v<T>)
+      return r.expect(Kind::Int);
+    else if constexpr (std::is_floating_point_v<T>)
+    {
+      if (sizeof(T) > 4 && r.kind() == Kind::Float32)
+        return r.skip();
+      return r.expect(sizeof(T) == 4 ? Kind::Float32 : Kind::Float64);
+    }
+    else if constexpr (std::is_same_v<T, std::string_view> || std::is_same_v<T, msgpack::Interned>)
+      return r.expect(Kind::Str);
+    else if constexpr (std::is_same_v<T, std::span<const std::byte>>)
+      return r.expect(Kind::Bin);
+    else
+    {
+      r.deferToDecoder(); // other types are checked by their decoder
+      return r.skip();
+    }
+  }
+
+  template <typename T, typename A>
+  auto tryCheck(TryReader &r, std::type_identity<std::vector<T, A>>) -> bool
+  {
+    if constexpr (msgpack::IsBinElement<T>::value)
+      return r.expect(Kind::Bin);
+    else
+      return tryCheckArray<T>(r);
+  }
+
+  template <typename T, size_t N>
+  auto tryCheck(TryReader &r, std::type_identity<std::array<T, N>>) -> bool
+  {
+    if constexpr (msgpack::IsBinElement<T>::value)
+    {
+      auto n = size_t{};
+      if (!r.binSize(n))
+        return false;
+      if (n != N)
+        return r.fail(msgpack::Errc::SizeMismatch);
+      return r.skip();
+    }
+    else
+      return tryCheckArray<T>(r, N);
+  }
+
+  template <typename T, typename U>
+  auto tryCheck(TryReader &r, std::type_identity<std::pair<T, U>>) -> bool
+  {
+    auto n = size_t{};
+    if (!r.arrayHeader(n))
+      return false;
+    if (n != 2)
+      return r.fail(msgpack::Errc::SizeMismatch);
+    if (!tryCheck(r, std::type_identity<T>{}))
+      return r.enclose(size_t{0});
+    if (!tryCheck(r, std::type_identity<U>{}))
+      return r.enclose(size_t{1});
+    r.leave();
+    return true;
+  }
+
+  template <typename... Ts>
+  auto tryCheck(TryReader &r, std::type_identity<std::tuple<Ts...>>) -> bool
+  {
+    auto n = size_t{};
+    if (!r.arrayHeader(n))
+      return false;
+    if (n != sizeof...(Ts))
+      return r.fail(msgpack::Errc::SizeMismatch);
+    auto i = size_t{0};
+    const auto ok =
+      ((tryCheck(r, std::type_identity<Ts>{}) ? (++i, true) : r.enclose(i)) && ...);
+    if (ok)
+      r.leave();
+    return ok;
+  }
+
+  template <typename T>
+  auto tryCheck(TryReader &r, std::type_identity<std::deque<T>>) -> bool
+  {
+    return tryCheckArray<T>(r);
+  }
+
+  template <typename T>
+  auto tryCheck(TryReader &r, std::type_identity<std::set<T>>) -> bool
+  {
+    return tryCheckArray<T>(r);
+  }
+
+  template <typename T>
+  auto tryCheck(TryReader &r, std::type_identity<std::unordered_set<T>>) -> bool
+  {
+    return tryCheckArray<T>(r);
+  }
+
+  template <typename T>
+  auto tryCheck(TryReader &r, std::type_identity<std::optional<T>>) -> bool
+  {
+    return r.kind() == Kind::Nil ? r.skip() : tryCheck(r, std::type_identity<T>{});
+  }
+
+  template <typename T>
+  auto tryCheckAlt(TryReader &r) -> bool
+  {
+    return tryCheck(r, std::type_identity<T>{});
+  }
+
+  template <typename... Ts>
+  auto tryCheck(TryReader &r, std::type_identity<std::variant<Ts...>>) -> bool
+  {
+    static constexpr auto table = std::array<bool (*)(TryReader &), sizeof...(Ts)>{
+      &tryCheckAlt<Ts>...};
+    auto n = size_t{};
+    if (!r.arrayHeader(n))
+      return false;
+    if (n != 2)
+      return r.fail(msgpack::Errc::SizeMismatch);
+    auto idx = uint64_t{};
+    if (!r.integer(idx))
+      return r.enclose(size_t{0});
+    if (idx >= table.size())
+      return r.fail(msgpack::Errc::OutOfRange) || r.enclose(size_t{0});
+    if (!table[idx](r))
+      return r.enclose(size_t{1});
+    r.leave();
+    return true;
+  }
+
+  template <typename M>
+  auto tryCheckMap(TryReader &r) -> bool
+  {
+    using K = typename M::key_type;
+    auto n = size_t{};
+    if (!r.mapHeader(n))
+      return false;
+    for (size_t i = 0; i < n; ++i)
+    {
+      if constexpr (IsStringKey<K>::value)
+      {
+        auto key = std::string_view{};
+        if (!r.str(key))
+          return r.enclose(i);
+        if (!tryCheck(r, std::type_identity<typename M::mapped_type>{}))
+          return r.enclose(key);
+      }
+      else
+      {
+        if (!r.expect(Kind::Int) || !tryCheck(r, std::type_identity<typename M::mapped_type>{}))
+          return r.enclose(i);
+      }
+    }
+    r.leave();
+    return true;
+  }
+
+  template <typename K, typename T, typename H, typename E, typename A>
+  auto tryCheck(TryReader &r, std::type_identity<std::unordered_map<K, T, H, E, A>>) -> bool
+  {
+    return tryCheckMap<std::unordered_map<K, T, H, E, A>>(r);
+  }
+
+  template <typename K, typename T, typename C, typename A>
+  auto tryCheck(TryReader &r, std::type_identity<std::map<K, T, C, A>>) -> bool
+  {
+    return tryCheckMap<std::map<K, T, C, A>>(r);
+  }
+} // namespace InternalMsgPack
+
+template <typename T>
+auto msgpackTryDeser(std::span<const std::byte> in, T &v) -> msgpack::Result<void>
+{
+  auto r = InternalMsgPack::TryReader{in};
+  if (!InternalMsgPack::tryCheck(r, std::type_identity<T>{}))
+    return r.error();
+  if (!r.done())
+  {
+    r.fail(msgpack::Errc::ExtraBytes);
+    return r.error();
+  }
+  try
+  {
+    const auto blob = msgpack::Blob{in};
+    if (r.decoderChecks())
+    {
+      auto tmp = v;
+      msgpackDeser(blob.val, tmp);
+      v = std::move(tmp);
+    }
+    else
+      msgpackDeser(blob.val, v);
+  }
+  catch (const msgpack::ParsingError &)
+  {
+    return msgpack::Error{msgpack::Errc::TypeMismatch, 0};
+  }
+  return {};
+}
@@ -0,0 +1,154 @@
+// (c) 2025 Mika Pi
+
+#include "msgpack-writer.hpp"
+#include <algorithm>
+#include <stdexcept>
+#include <string_view>
+
+namespace msgpack
+{
+  Writer::Writer(std::ostream &aSt) : st(aSt) {}
+
+  auto Writer::beginArray(size_t n) -> Writer &
+  {
+    begin(false, n);
+    return *this;
+  }
+
+  auto Writer::beginMap(size_t n) -> Writer &
+  {
+    begin(true, n);
+    return *this;
+  }
+
+  auto Writer::beginArray() -> Writer &
+  {
+    begin(false, Unknown);
+    return *this;
+  }
+
+  auto Writer::beginMap() -> Writer &
+  {
+    begin(true, Unknown);
+    return *this;
+  }
+
+  auto Writer::begin(bool map, uint64_t n) -> void
+  {
+    auto &o = element();
+    auto f = Frame{map, n};
+    const auto canonical = (InternalMsgPack::serFlags(st) & InternalMsgPack::Canonical) != 0;
+    if ((canonical && map) || (n == Unknown && (canonical || (&o == &st && !seekable()))))
+    {
+      f.staging = std::make_unique<std::ostringstream>();
+      f.sort = canonical && map;
+      // sorting reorders entries, so they cannot use the key dictionary
+      if (f.sort)
+        InternalMsgPack::serFlags(*f.staging) = InternalMsgPack::serFlags(o);
+      else
+        f.staging->copyfmt(o);
+    }
+    else if (n != Unknown)
+    {
+      if (map)
+        InternalMsgPack::msgpackSerMapHeader(o, n);
+      else
+        InternalMsgPack::msgpackSerArrayHeader(o, n);
+    }
+    else
+    {
+      stats::written(map ? NodeType::Map : NodeType::Array);
+      f.header = o.tellp();
+      const char header[] = {static_cast<char>(map ? 0xdf : 0xdd), 0, 0, 0, 0};
+      o.write(header, sizeof(header));
+    }
+    frames.push_back(std::move(f));
+  }
+
+  auto Writer::end() -> Writer &
+  {
+    if (frames.empty())
+      throw std::logic_error("Writer::end() without an open container");
+    auto &back = frames.back();
+    if (back.map && back.count % 2 != 0)
+      throw std::logic_error("Map entry without a value");
+    const auto n = back.map ? back.count / 2 : back.count;
+    if (back.expected != Unknown && n != back.expected)
+      throw std::logic_error("Container of " + std::to_string(back.expected) + " elements got " +
+                             std::to_string(n));
+    const auto f = std::move(back);
+    frames.pop_back();
+
+    auto &o = out();
+    if (f.staging)
+    {
+      if (f.map)
+        InternalMsgPack::msgpackSerMapHeader(o, n);
+      else
+        InternalMsgPack::msgpackSerArrayHeader(o, n);
+      const auto body = f.staging->view();
+      if (f.sort)
+      {
+        // encoded keys are prefix-free, so sorting whole entries sorts them by key
+        auto sorted = std::vector<std::string_view>{};
+        sorted.reserve(f.entries.size());
+        for (size_t i = 0; i < f.entries.size(); ++i)
+        {
+          const auto next = i + 1 < f.entries.size() ? f.entries[i + 1] : body.size();
+          sorted.push_back(body.substr(f.entries[i], next - f.entries[i]));
+        }
+        std::sort(sorted.begin(), sorted.end());
+        for (const auto e : sorted)
+          o.write(e.data(), static_cast<std::streamsize>(e.size()));
+      }
+      else
+        o.write(body.data(), static_cast<std::streamsize>(body.size()));
+    }
+    else if (f.header != -1)
+    {
+      if (n > UINT32_MAX)
+        throw std::length_error("Container of more than 2^32-1 elements");
+      const auto pos = o.tellp();
+      const char size[] = {static_cast<char>(n >> 24),
+                           static_cast<char>(n >> 16),
+                           static_cast<char>(n >> 8),
+                           static_cast<char>(n)};
+      o.seekp(f.header + 1);
+      o.write(size, sizeof(size));
+      o.seekp(pos);
+    }
+    return *this;
+  }
+
+  auto Writer::element() -> std::ostream &
+  {
+    if (frames.empty())
+      return st;
+    auto &f = frames.back();
+    if (f.sort && f.count % 2 == 0)
+      f.entries.push_back(f.staging->view().size());
+    ++f.count;
+    return out();
+  }
+
+  auto Writer::out() -> std::ostream &
+  {
+    for (auto f = frames.rbegin(); f != frames.rend(); ++f)
+      if (f->staging)
+        return *f->staging;
+    return st;
+  }
+
+  auto Writer::seekable() -> bool
+  {
+    if (canSeek == -1)
+    {
+      // some streams report a position but cannot seek to it
+      const auto pos = st.tellp();
+      canSeek = pos != -1 && st.seekp(pos) ? 1 : 0;
+      if (pos != -1 && !canSeek)
+        st.clear();
+    }
+    return canSeek == 1;
+  }
+} // namespace msgpack
@@ -0,0 +1,106 @@
+// (c) 2025 Mika Pi
+
+#pragma once
+#include "msgpack-ser.hpp"
+#include <cstdint>
+#include <memory>
+#include <ostream>
+#include <ranges>
+#include <sstream>
+#include <vector>
+
+namespace msgpack
+{
+  // Writes arrays and maps element by element, for sequences that are generated as they are
+  // written:
+  //   auto w = msgpack::Writer{st};
+  //   w.beginArray();
+  //   while (cursor.next())
+  //     w.value(cursor.row());
+  //   w.end();
+  // A map takes a key and a value per entry. Containers nest, and every begin must be matched by
+  // end(), which checks that a container given a count got that many elements.
+  //
+  // Without a count, a container gets a 32-bit header that end() back-patches with seekp, so
+  // memory use does not depend on the length. If st cannot seek, the outermost such container is
+  // staged in memory instead and written with its shortest header at end(). If st is canonical,
+  // every container without a count and every map is staged, and map entries are sorted by their
+  // encoded bytes like msgpackSer sorts them.
+  class Writer
+  {
+  public:
+    explicit Writer(std::ostream &st);
+    Writer(const Writer &) = delete;
+    auto operator=(const Writer &) -> Writer & = delete;
+
+    auto beginArray(size_t n) -> Writer &;
+    auto beginMap(size_t n) -> Writer &;
+    auto beginArray() -> Writer &;
+    auto beginMap() -> Writer &;
+    auto end() -> Writer &;
+
+    template <typename T>
+    auto value(const T &v) -> Writer &
+    {
+      msgpackSer(element(), v);
+      return *this;
+    }
+
+  private:
+    static constexpr auto Unknown = UINT64_MAX;
+
+    struct Frame
+    {
+      bool map;
+      uint64_t expected;
+      uint64_t count = 0;
+      std::streamoff header = -1; // position of a header to back-patch
+      // Elements are written here until end(), which writes the header and then the elements.
+      std::unique_ptr<std::ostringstream> staging = nullptr;
+      bool sort = false;             // canonical map: entries are sorted at end()
+      std::vector<size_t> entries{}; // staging offset of each entry of a sorted map
+    };
+
+    auto begin(bool map, uint64_t n) -> void;
+    // Counts an element of the innermost container; returns the stream to write it to.
+    auto element() -> std::ostream &;
+    auto out() -> std::ostream &;
+    auto seekable() -> bool;
+
+    std::ostream &st;
+    std::vector<Frame> frames;
+    int canSeek = -1;
+  };
+} // namespace msgpack
+
+// Serializes an input range as an array, one element at a time: sized ranges get their header
+// up front, others are written with a back-patched or staged header (see msgpack::Writer).
+template <std::ranges::input_range R>
+auto msgpackSerRange(std::ostream &st, R &&r) -> void
+{
+  auto w = msgpack::Writer{st};
+  if constexpr (std::ranges::sized_range<R>)
+    w.beginArray(static_cast<size_t>(std::ranges::size(r)));
+  else
+    w.beginArray();
+  for (auto &&e : r)
+    w.value(e);
+  w.end();
+}
+
+// Like msgpackSerRange, writing a range of key-value pairs as a map.
+template <std::ranges::input_range R>
+auto msgpackSerMapRange(std::ostream &st, R &&r) -> void
+{
+  auto w = msgpack::Writer{st};
+  if constexpr (std::ranges::sized_range<R>)
+    w.beginMap(static_cast<size_t>(std::ranges::size(r)));
+  else
+    w.beginMap();
+  for (auto &&e : r)
+  {
+    const auto &[k, v] = e;
+    w.value(k).value(v);
+  }
+  w.end();
+}
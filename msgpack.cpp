@@ -1,4 +1,6 @@
 #include "msgpack.hpp"
+#include "msgpack-keydict.hpp"
+#include "msgpack-stats.hpp"
 #include <cstring>
 #include <stdexcept>
 
@@ -14,37 +16,247 @@ namespace msgpack
         v = static_cast<UInt>((v << 8) | static_cast<uint8_t>(d[off + i]));
       return v;
     }
+
+    // Size of fixed-size values other than fixint/fixstr/nil/bool, 0 for other types.
+    auto fixedSize(uint8_t b) -> size_t
+    {
+      switch (b)
+      {
+      case 0xcc:
+      case 0xd0:
+        return 2;
+      case 0xcd:
+      case 0xd1:
+        return 3;
+      case 0xce:
+      case 0xd2:
+      case 0xca:
+        return 5;
+      case 0xcf:
+      case 0xd3:
+      case 0xcb:
+        return 9;
+      // fixext 1/2/4/8/16
+      case 0xd4:
+        return 3;
+      case 0xd5:
+        return 4;
+      case 0xd6:
+        return 6;
+      case 0xd7:
+        return 10;
+      case 0xd8:
+        return 18;
+      default:
+        return 0;
+      }
+    }
+
+    // Width of the length or count field of str/bin/ext/array/map 8, 16 and 32.
+    auto lengthWidth(uint8_t b) -> size_t
+    {
+      switch (b)
+      {
+      case 0xd9:
+      case 0xc4:
+      case 0xc7:
+        return 1;
+      case 0xda:
+      case 0xc5:
+      case 0xc8:
+      case 0xdc:
+      case 0xde:
+        return 2;
+      case 0xdb:
+      case 0xc6:
+      case 0xc9:
+      case 0xdd:
+      case 0xdf:
+        return 4;
+      default:
+        throw ParsingError("Unknown type byte " + std::to_string(b));
+      }
+    }
+
+    // Bytes before the payload: the whole value for fixed-size types, the type byte and the
+    // length or count field for str/bin/array/map 8, 16 and 32.
+    auto headSize(uint8_t b) -> size_t
+    {
+      if (const auto fixed = fixedSize(b); fixed > 0)
+        return fixed;
+      switch (b)
+      {
+      case 0xd9:
+      case 0xc4:
+        return 2;
+      case 0xda:
+      case 0xc5:
+      case 0xdc:
+      case 0xde:
+        return 3;
+      case 0xdb:
+      case 0xc6:
+      case 0xdd:
+      case 0xdf:
+        return 5;
+      default:
+        return 1;
+      }
+    }
+
+    // Walks the object in `in`, parsed as v, until it reaches target, and sets found to the
+    // target's bytes. Returns the bytes after v, or after target once it is found.
+    auto locate(std::span<const std::byte> in,
+                const Val &v,
+                const Val *target,
+                std::span<const std::byte> &found) -> std::span<const std::byte>
+    {
+      const auto arr = std::get_if<Array>(&v);
+      const auto map = std::get_if<Map>(&v);
+      if (&v == target || (!arr && !map))
+      {
+        const auto rest = skip(in);
+        if (&v == target)
+          found = in.first(in.size() - rest.size());
+        return rest;
+      }
+      const auto b = static_cast<uint8_t>(in[0]);
+      const auto fix = (b & 0xf0) == 0x90 || (b & 0xf0) == 0x80;
+      in = in.subspan(fix ? 1 : 1 + lengthWidth(b));
+      if (arr)
+        for (const auto &e : *arr)
+        {
+          in = locate(in, e, target, found);
+          if (!found.empty())
+            return in;
+        }
+      else
+        for (const auto &[k, e] : *map)
+        {
+          in = locate(in, k, target, found);
+          if (!found.empty())
+            return in;
+          in = locate(in, e, target, found);
+          if (!found.empty())
+            return in;
+        }
+      return in;
+    }
   } // namespace
 
+  Slice::Slice(std::vector<std::byte> bytes)
+  {
+    const auto p = std::make_shared<const std::vector<std::byte>>(std::move(bytes));
+    span = *p;
+    owner = p;
+  }
+
+  Slice::Slice(std::shared_ptr<const void> aOwner, std::span<const std::byte> bytes)
+    : owner(std::move(aOwner)), span(bytes)
+  {
+  }
+
+  auto Slice::copy(std::span<const std::byte> bytes) -> Slice
+  {
+    return Slice{std::vector<std::byte>(bytes.begin(), bytes.end())};
+  }
+
+  auto Slice::sub(std::span<const std::byte> part) const -> Slice
+  {
+    if (part.empty())
+      return Slice{owner, {}};
+    if (part.data() < span.data() || part.data() + part.size() > span.data() + span.size())
+      throw std::out_of_range("Slice outside of the buffer");
+    return Slice{owner, part};
+  }
+
+  auto Slice::sub(std::string_view part) const -> Slice
+  {
+    return sub(std::as_bytes(std::span{part}));
+  }
+
   Blob::Blob(std::istream &st)
-    : blob([&st]() {
+    : buffer([&st]() {
         st.unsetf(std::ios::skipws);
         std::vector<std::byte> r;
         char c;
         while (st.get(c))
           r.push_back(static_cast<std::byte>(static_cast<unsigned char>(c)));
         return r;
-      }()),
-      span(blob)
+      }())
+  {
+    const auto timer = StatsTimer{};
+    stats::bytes(buffer.size());
+    auto rem = parse(buffer.bytes(), val);
+    if (!rem.empty())
+      throw std::runtime_error("Extra bytes after top‑level object");
+  }
+
+  Blob::Blob(std::span<const std::byte> s) : buffer(nullptr, s)
   {
-    auto rem = parse(span, val);
+    const auto timer = StatsTimer{};
+    stats::bytes(buffer.size());
+    auto rem = parse(buffer.bytes(), val);
     if (!rem.empty())
       throw std::runtime_error("Extra bytes after top‑level object");
   }
 
-  Blob::Blob(std::span<const std::byte> s) : span(s)
+  Blob::Blob(std::span<const std::byte> s, KeyDict &aDict) : buffer(nullptr, s), dict(&aDict)
   {
-    auto rem = parse(span, val);
+    const auto timer = StatsTimer{};
+    stats::bytes(buffer.size());
+    auto rem = parse(buffer.bytes(), val);
     if (!rem.empty())
       throw std::runtime_error("Extra bytes after top‑level object");
   }
 
+  Blob::Blob(Slice s) : buffer(std::move(s))
+  {
+    const auto timer = StatsTimer{};
+    stats::bytes(buffer.size());
+    auto rem = parse(buffer.bytes(), val);
+    if (!rem.empty())
+      throw std::runtime_error("Extra bytes after top‑level object");
+  }
+
+  auto Blob::assign(std::span<const std::byte> s) -> void
+  {
+    const auto timer = StatsTimer{};
+    buffer = Slice{nullptr, s};
+    stats::bytes(buffer.size());
+    auto rem = parse(buffer.bytes(), val);
+    if (!rem.empty())
+      throw std::runtime_error("Extra bytes after top‑level object");
+  }
+
+  auto Blob::slice(std::string_view s) const -> Slice
+  {
+    return buffer.sub(s);
+  }
+
+  auto Blob::slice(std::span<const std::byte> s) const -> Slice
+  {
+    return buffer.sub(s);
+  }
+
+  auto Blob::subtree(const Val &v) const -> Slice
+  {
+    auto found = std::span<const std::byte>{};
+    locate(buffer.bytes(), val, &v, found);
+    if (found.empty())
+      throw std::out_of_range("Value is not part of this Blob");
+    return buffer.sub(found);
+  }
+
   auto Blob::parse(std::span<const std::byte> in, Val &out) -> std::span<const std::byte>
   {
     if (in.empty())
       throw ParsingError("Unexpected EOF");
 
     const auto b = static_cast<uint8_t>(in[0]);
+    stats::parsed(b);
+    if (headSize(b) > in.size())
+      throw ParsingError("Unexpected EOF");
 
     // nil
     if (b == 0xc0)
@@ -207,99 +419,153 @@ namespace msgpack
     }
     // fixarray
     if ((b & 0xf0) == 0x90)
-    {
-      uint32_t n = b & 0x0f;
-      Array a;
-      auto cur = in.subspan(1);
-      for (uint32_t i = 0; i < n; ++i)
-      {
-        Val e;
-        cur = parse(cur, e);
-        a.push_back(std::move(e));
-      }
-      out = std::move(a);
-      return cur;
-    }
+      return parseArray(in.subspan(1), b & 0x0f, out);
     // array16
     if (b == 0xdc)
-    {
-      auto n = read_be<uint16_t>(in, 1);
-      auto cur = in.subspan(3);
-      Array a;
-      for (uint16_t i = 0; i < n; ++i)
-      {
-        Val e;
-        cur = parse(cur, e);
-        a.push_back(std::move(e));
-      }
-      out = std::move(a);
-      return cur;
-    }
+      return parseArray(in.subspan(3), read_be<uint16_t>(in, 1), out);
     // array32
     if (b == 0xdd)
-    {
-      auto n = read_be<uint32_t>(in, 1);
-      auto cur = in.subspan(5);
-      Array a;
-      for (uint32_t i = 0; i < n; ++i)
-      {
-        Val e;
-        cur = parse(cur, e);
-        a.push_back(std::move(e));
-      }
-      out = std::move(a);
-      return cur;
-    }
+      return parseArray(in.subspan(5), read_be<uint32_t>(in, 1), out);
     // fixmap
     if ((b & 0xf0) == 0x80)
-    {
-      uint32_t n = b & 0x0f;
-      Map m;
-      auto cur = in.subspan(1);
-      for (uint32_t i = 0; i < n; ++i)
-      {
-        Val k, v;
-        cur = parse(cur, k);
-        cur = parse(cur, v);
-        m.emplace_back(std::move(k), std::move(v));
-      }
-      out = std::move(m);
-      return cur;
-    }
+      return parseMap(in.subspan(1), b & 0x0f, out);
     // map16
     if (b == 0xde)
-    {
-      auto n = read_be<uint16_t>(in, 1);
-      auto cur = in.subspan(3);
-      Map m;
-      for (uint16_t i = 0; i < n; ++i)
-      {
-        Val k, v;
-        cur = parse(cur, k);
-        cur = parse(cur, v);
-        m.emplace_back(std::move(k), std::move(v));
-      }
-      out = std::move(m);
-      return cur;
-    }
+      return parseMap(in.subspan(3), read_be<uint16_t>(in, 1), out);
     // map32
     if (b == 0xdf)
+      return parseMap(in.subspan(5), read_be<uint32_t>(in, 1), out);
+    // key dictionary definition (ext8) and references (fixext 1/2/4)
+    if (dict && (b == 0xc7 || b == 0xd4 || b == 0xd5 || b == 0xd6))
+      return parseKey(in, out);
+
+    throw ParsingError("Unknown type byte " + std::to_string(b));
+  }
+
+  // Containers already held by out are reused, so parsing a message of the same shape into the
+  // same Val does not allocate.
+  auto Blob::parseArray(std::span<const std::byte> in, size_t n, Val &out)
+    -> std::span<const std::byte>
+  {
+    if (n > in.size())
+      throw ParsingError("Array overflow");
+    auto &a = std::holds_alternative<Array>(out) ? std::get<Array>(out) : out.emplace<Array>();
+    stats::reserve(a.capacity(), n);
+    stats::enter(n);
+    a.resize(n);
+    for (auto &e : a)
+      in = parse(in, e);
+    stats::leave();
+    return in;
+  }
+
+  auto Blob::parseMap(std::span<const std::byte> in, size_t n, Val &out)
+    -> std::span<const std::byte>
+  {
+    if (n > in.size() / 2)
+      throw ParsingError("Map overflow");
+    auto &m = std::holds_alternative<Map>(out) ? std::get<Map>(out) : out.emplace<Map>();
+    stats::reserve(m.capacity(), n);
+    stats::enter(n);
+    m.resize(n);
+    for (auto &e : m)
+    {
+      in = parse(in, e.first);
+      in = parse(in, e.second);
+    }
+    stats::leave();
+    return in;
+  }
+
+  auto Blob::parseKey(std::span<const std::byte> in, Val &out) -> std::span<const std::byte>
+  {
+    const auto n = objectSize(in);
+    if (n == 0)
+      throw ParsingError("Unexpected EOF");
+    const auto b = static_cast<uint8_t>(in[0]);
+    const auto type = static_cast<int8_t>(in[b == 0xc7 ? 2 : 1]);
+    if (b == 0xc7 && type == KeyDict::DefinitionExt)
+      out = dict->define(std::string_view(reinterpret_cast<const char *>(in.data() + 3), n - 3));
+    else if (b != 0xc7 && type == KeyDict::ReferenceExt)
+      out = dict->lookup(b == 0xd4   ? read_be<uint8_t>(in, 2)
+                         : b == 0xd5 ? read_be<uint16_t>(in, 2)
+                                     : read_be<uint32_t>(in, 2));
+    else
+      throw ParsingError("Unknown ext type " + std::to_string(type));
+    return in.subspan(n);
+  }
+
+  auto objectSize(std::span<const std::byte> in) -> size_t
+  {
+    auto scan = ObjectScan{};
+    return objectSize(in, scan);
+  }
+
+  auto objectSize(std::span<const std::byte> in, ObjectScan &scan) -> size_t
+  {
+    auto &pos = scan.pos;
+    auto &pending = scan.pending;
+    while (pending > 0)
     {
-      auto n = read_be<uint32_t>(in, 1);
-      auto cur = in.subspan(5);
-      Map m;
-      for (uint32_t i = 0; i < n; ++i)
+      if (pos == in.size())
+        return 0;
+      const auto b = static_cast<uint8_t>(in[pos]);
+      // bytes of this value, not counting the elements of a container
+      auto n = size_t{1};
+      auto elements = uint64_t{0};
+      if (b <= 0x7f || b >= 0xe0 || b == 0xc0 || b == 0xc2 || b == 0xc3)
+        n = 1;
+      else if ((b & 0xf0) == 0x80)
+        elements = 2 * (b & 0x0f);
+      else if ((b & 0xf0) == 0x90)
+        elements = b & 0x0f;
+      else if ((b & 0xe0) == 0xa0)
+        n = 1 + (b & 0x1f);
+      else if (const auto fixed = fixedSize(b); fixed > 0)
+        n = fixed;
+      else
       {
-        Val k, v;
-        cur = parse(cur, k);
-        cur = parse(cur, v);
-        m.emplace_back(std::move(k), std::move(v));
+        const auto width = lengthWidth(b);
+        if (in.size() - pos < 1 + width)
+          return 0;
+        const auto len = width == 1   ? size_t{read_be<uint8_t>(in, pos + 1)}
+                         : width == 2 ? size_t{read_be<uint16_t>(in, pos + 1)}
+                                      : size_t{read_be<uint32_t>(in, pos + 1)};
+        n = 1 + width;
+        switch (b)
+        {
+        case 0xdc:
+        case 0xdd:
+          elements = len;
+          break;
+        case 0xde:
+        case 0xdf:
+          elements = 2 * uint64_t{len};
+          break;
+        // ext8/16/32: length, type, data
+        case 0xc7:
+        case 0xc8:
+        case 0xc9:
+          n += 1 + len;
+          break;
+        default:
+          n += len;
+        }
       }
-      out = std::move(m);
-      return cur;
+      if (n > in.size() - pos)
+        return 0;
+      pos += n;
+      pending += elements - 1;
     }
+    return pos;
+  }
 
-    throw ParsingError("Unknown type byte " + std::to_string(b));
+  auto skip(std::span<const std::byte> in) -> std::span<const std::byte>
+  {
+    const auto n = objectSize(in);
+    if (n == 0)
+      throw ParsingError("Unexpected EOF");
+    return in.subspan(n);
   }
 
   ParsingError::~ParsingError() = default;
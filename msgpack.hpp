@@ -1,6 +1,7 @@
 #pragma once
 #include <cstddef>
 #include <iostream>
+#include <memory>
 #include <span>
 #include <stdexcept>
 #include <string_view>
@@ -18,6 +19,7 @@ namespace msgpack
 
   class Map;
   class Array;
+  class KeyDict;
   using Val = std::variant<int64_t,
                            uint64_t,
                            std::nullptr_t,
@@ -40,16 +42,85 @@ namespace msgpack
     using std::vector<std::pair<Val, Val>>::vector;
   };
 
-  class Blob
+  // Immutable bytes shared by reference count with every copy and sub-slice, so parts of a
+  // buffer can be handed to other threads without copying. A slice made from a borrowed span
+  // (no owner) does not keep the bytes alive.
+  class Slice
   {
+  public:
+    Slice() = default;
+    explicit Slice(std::vector<std::byte> bytes);
+    // Bytes kept alive by owner, which may be any shared object, e.g. a mapped file.
+    Slice(std::shared_ptr<const void> owner, std::span<const std::byte> bytes);
+    static auto copy(std::span<const std::byte> bytes) -> Slice;
+
+    auto bytes() const -> std::span<const std::byte> { return span; }
+    auto str() const -> std::string_view
+    {
+      return {reinterpret_cast<const char *>(span.data()), span.size()};
+    }
+    auto size() const -> size_t { return span.size(); }
+    auto empty() const -> bool { return span.empty(); }
+    auto owned() const -> bool { return owner != nullptr; }
+    // Slice of part, which must lie within bytes(), sharing this slice's owner.
+    auto sub(std::span<const std::byte> part) const -> Slice;
+    auto sub(std::string_view part) const -> Slice;
+
   private:
-    std::vector<std::byte> blob;
+    std::shared_ptr<const void> owner;
     std::span<const std::byte> span;
+  };
+
+  // Size in bytes of the first object in `in`, or 0 if `in` ends before the object does. Throws
+  // ParsingError on an unknown type byte.
+  auto objectSize(std::span<const std::byte> in) -> size_t;
+  // Where an objectSize() scan stopped: the offset of the next value and the number of values
+  // still to be read.
+  struct ObjectScan
+  {
+    size_t pos = 0;
+    uint64_t pending = 1;
+  };
+  // As objectSize(), resuming from scan and leaving it where the data ran out, so a buffer that
+  // keeps growing is scanned once. Start with a default ObjectScan for each object.
+  auto objectSize(std::span<const std::byte> in, ObjectScan &scan) -> size_t;
+  // Returns the bytes following the first object in `in` without decoding it.
+  auto skip(std::span<const std::byte> in) -> std::span<const std::byte>;
+
+  // Parsed message. Strings and bins in val point into the buffer the message was parsed from:
+  // the span given to the constructor, or a buffer shared by the Blob's copies when the message
+  // is read from a stream or given as a Slice.
+  class Blob
+  {
+  private:
+    Slice buffer;
     auto parse(std::span<const std::byte> in, Val &out) -> std::span<const std::byte>;
+    auto parseArray(std::span<const std::byte> in, size_t n, Val &out)
+      -> std::span<const std::byte>;
+    auto parseMap(std::span<const std::byte> in, size_t n, Val &out) -> std::span<const std::byte>;
+    auto parseKey(std::span<const std::byte> in, Val &out) -> std::span<const std::byte>;
+    KeyDict *dict = nullptr;
 
   public:
     Blob(std::istream &);
     Blob(std::span<const std::byte>);
+    // Resolves key dictionary definitions and references (see msgpack::KeyDict) to strings,
+    // which stay valid while dict lives.
+    Blob(std::span<const std::byte>, KeyDict &dict);
+    // Keeps a reference to the bytes, which stay valid while the Blob, its copies or slices
+    // taken from it live.
+    Blob(Slice);
+    // Parses another message from s into val, reusing the arrays and maps val already holds.
+    auto assign(std::span<const std::byte>) -> void;
+
+    // The bytes of a string or bin in val, sharing the buffer.
+    auto slice(std::string_view) const -> Slice;
+    auto slice(std::span<const std::byte>) const -> Slice;
+    // The encoded bytes of v, which must be val or one of its elements, sharing the buffer. They
+    // can be parsed again with Blob(Slice), e.g. on another thread. Walks the message up to v.
+    auto subtree(const Val &v) const -> Slice;
+    auto bytes() const -> const Slice & { return buffer; }
+
     Val val;
   };
 } // namespace msgpack
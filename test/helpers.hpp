@@ -0,0 +1,22 @@
+// (c) 2025 Mika Pi
+
+#pragma once
+#include "../msgpack-ser.hpp"
+#include <span>
+#include <sstream>
+#include <string>
+
+// Helpers shared by the tests.
+
+inline auto toBytes(const std::string &s) -> std::span<const std::byte>
+{
+  return std::as_bytes(std::span{s});
+}
+
+// The default msgpackSer encoding of v.
+inline auto encode(const auto &v) -> std::string
+{
+  auto ss = std::ostringstream{};
+  msgpackSer(ss, v);
+  return ss.str();
+}
@@ -0,0 +1,166 @@
+#include "../../msgpack-fast.hpp"
+#include "../../msgpack-ser.hpp"
+#include "../../msgpack-stats.hpp"
+#include "../helpers.hpp"
+#include <catch2/catch.hpp>
+#include <cstdlib>
+#include <new>
+#include <optional>
+#include <ser/macro.hpp>
+#include <sstream>
+
+// This binary is built with MSGPACK_STATS and counts the heap allocations of each thread, to check
+// Stats::growths against.
+
+namespace
+{
+  thread_local size_t heapAllocations = 0;
+} // namespace
+
+auto operator new(size_t size) -> void *
+{
+  ++heapAllocations;
+  if (auto p = std::malloc(size > 0 ? size : 1))
+    return p;
+  throw std::bad_alloc{};
+}
+
+auto operator new[](size_t size) -> void *
+{
+  return operator new(size);
+}
+
+auto operator delete(void *p) noexcept -> void
+{
+  std::free(p);
+}
+
+auto operator delete[](void *p) noexcept -> void
+{
+  std::free(p);
+}
+
+auto operator delete(void *p, size_t) noexcept -> void
+{
+  std::free(p);
+}
+
+auto operator delete[](void *p, size_t) noexcept -> void
+{
+  std::free(p);
+}
+
+struct Event
+{
+  SER_PROPS(a, b)
+  std::vector<int> a;
+  std::string b;
+};
+
+struct Note
+{
+  SER_PROPS(id, text)
+  uint32_t id;
+  std::optional<std::string> text;
+};
+
+TEST_CASE("Stats", "[msgpack-stats]")
+{
+  // {"a": [1, 2, 3], "b": "x"}
+  const auto msg = std::string{"\x82\xa1" "a\x93\x01\x02\x03\xa1" "b\xa1x"};
+
+  SECTION("Parsing")
+  {
+    auto s = msgpack::Stats{};
+    auto scope = msgpack::StatsScope{s};
+    const auto before = heapAllocations;
+    auto blob = msgpack::Blob{toBytes(msg)};
+    REQUIRE(heapAllocations - before == 2);
+    REQUIRE(s.growths == 2);
+    REQUIRE(s.bytes == msg.size());
+    REQUIRE(s.count(msgpack::NodeType::Map) == 1);
+    REQUIRE(s.count(msgpack::NodeType::Array) == 1);
+    REQUIRE(s.count(msgpack::NodeType::Str) == 3);
+    REQUIRE(s.count(msgpack::NodeType::Int) == 3);
+    REQUIRE(s.maxDepth == 2);
+    REQUIRE(s.maxContainer == 3);
+    REQUIRE(s.containerElements == 5);
+
+    // same shape again: the containers are reused
+    const auto before2 = heapAllocations;
+    blob.assign(toBytes(msg));
+    REQUIRE(heapAllocations == before2);
+    REQUIRE(s.growths == 2);
+    REQUIRE(s.bytes == 2 * msg.size());
+  }
+
+  SECTION("Decoding")
+  {
+    const auto blob = msgpack::Blob{toBytes(msg)};
+    const auto longMsg = std::string{"\x81\xa1" "b\xd9\x20"} + std::string(32, 'y');
+    const auto longBlob = msgpack::Blob{toBytes(longMsg)};
+    auto s = msgpack::Stats{};
+    auto scope = msgpack::StatsScope{s};
+    auto e = Event{};
+    const auto before = heapAllocations;
+    msgpackDeser(blob.val, e);
+    REQUIRE(heapAllocations - before == 1);
+    REQUIRE(s.growths == 1);
+    msgpackDeser(blob.val, e);
+    REQUIRE(heapAllocations - before == 1);
+    REQUIRE(s.growths == 1);
+    REQUIRE(e.a.size() == 3);
+
+    msgpackDeser(longBlob.val, e);
+    REQUIRE(heapAllocations - before == 2);
+    REQUIRE(s.growths == 2);
+    REQUIRE(e.b.size() == 32);
+  }
+
+  SECTION("Encoding")
+  {
+    auto s = msgpack::Stats{};
+    auto ss = std::ostringstream{};
+    // field names are encoded once per type, on first use
+    msgpackSer(ss, Event{});
+    ss.str({});
+    {
+      auto scope = msgpack::StatsScope{s};
+      msgpackSer(ss, Event{{1, 2, 3}, "x"});
+    }
+    REQUIRE(ss.str() == msg);
+    REQUIRE(s.bytes == msg.size());
+    REQUIRE(s.count(msgpack::NodeType::Map) == 1);
+    REQUIRE(s.count(msgpack::NodeType::Array) == 1);
+    REQUIRE(s.count(msgpack::NodeType::Str) == 1);
+    REQUIRE(s.count(msgpack::NodeType::Int) == 3);
+    REQUIRE(s.elapsed.count() > 0);
+  }
+
+  SECTION("Schema fast path")
+  {
+    auto ss = std::ostringstream{};
+    msgpackSer(ss, Note{7, "X"});
+    const auto bytes = ss.str();
+    auto s = msgpack::Stats{};
+    auto scope = msgpack::StatsScope{s};
+    auto out = Note{};
+    msgpackDeserFast(toBytes(bytes), out);
+    REQUIRE(out.text == "X");
+    // only the optional went through msgpack::Blob
+    REQUIRE(s.bytes == 2);
+  }
+
+  SECTION("Callback")
+  {
+    auto total = msgpack::Stats{};
+    {
+      auto scope = msgpack::StatsScope{[&total](const msgpack::Stats &s) { total += s; }};
+      auto blob = msgpack::Blob{toBytes(msg)};
+      blob.assign(toBytes(msg));
+    }
+    REQUIRE(total.bytes == 2 * msg.size());
+    REQUIRE(total.growths == 2);
+    REQUIRE(msgpack::StatsScope::current() == nullptr);
+  }
+}
@@ -247,3 +247,61 @@ TEST_CASE("Nested structures", "[msgpack]")
   REQUIRE(std::get<std::string_view>(inner[0].first) == "k");
   REQUIRE(std::get<bool>(inner[0].second) == true);
 }
+
+TEST_CASE("Skip", "[msgpack]")
+{
+  // [ {"a": [1, "xy"]}, bin8(2), 0xcd 0x01 0x02 ] followed by a trailing nil
+  const auto buf = std::vector<std::byte>{std::byte{0x93},
+                                          std::byte{0x81},
+                                          std::byte{0xa1},
+                                          std::byte{'a'},
+                                          std::byte{0x92},
+                                          std::byte{0x01},
+                                          std::byte{0xa2},
+                                          std::byte{'x'},
+                                          std::byte{'y'},
+                                          std::byte{0xc4},
+                                          std::byte{0x02},
+                                          std::byte{0xff},
+                                          std::byte{0xff},
+                                          std::byte{0xcd},
+                                          std::byte{0x01},
+                                          std::byte{0x02},
+                                          std::byte{0xc0}};
+  const auto rem = msgpack::skip(std::span{buf});
+  REQUIRE(rem.size() == 1);
+  REQUIRE(rem[0] == std::byte{0xc0});
+  REQUIRE(msgpack::skip(rem).empty());
+  REQUIRE_THROWS_AS(msgpack::skip(std::span{buf}.first(12)), msgpack::ParsingError);
+}
+
+TEST_CASE("Reparsing into the same Blob", "[msgpack]")
+{
+  // [[1, 2], {"k": 3}] and [[4, 5], {"k": 6}]
+  const auto a = std::vector<std::byte>{std::byte{0x92},
+                                        std::byte{0x92},
+                                        std::byte{1},
+                                        std::byte{2},
+                                        std::byte{0x81},
+                                        std::byte{0xa1},
+                                        std::byte{'k'},
+                                        std::byte{3}};
+  auto b = a;
+  b[2] = std::byte{4};
+  b[3] = std::byte{5};
+  b[7] = std::byte{6};
+
+  auto blob = msgpack::Blob{std::span{a}};
+  const auto *inner = std::get<msgpack::Array>(std::get<msgpack::Array>(blob.val)[0]).data();
+  blob.assign(std::span{b});
+  const auto &top = std::get<msgpack::Array>(blob.val);
+  const auto &arr = std::get<msgpack::Array>(top[0]);
+  REQUIRE(arr.data() == inner);
+  REQUIRE(std::get<int64_t>(arr[1]) == 5);
+  REQUIRE(std::get<int64_t>(std::get<msgpack::Map>(top[1])[0].second) == 6);
+
+  // an array count larger than the input is rejected before allocating
+  const auto huge = std::vector<std::byte>{
+    std::byte{0xdd}, std::byte{0xff}, std::byte{0xff}, std::byte{0xff}, std::byte{0xff}, std::byte{1}};
+  REQUIRE_THROWS_AS(msgpack::Blob{std::span{huge}}, msgpack::ParsingError);
+}
@@ -0,0 +1,175 @@
+#include "../msgpack-async.hpp"
+#include "../msgpack-ser.hpp"
+#include <catch2/catch.hpp>
+#include <ser/macro.hpp>
+#include <sstream>
+#include <sys/socket.h>
+#include <thread>
+#include <unistd.h>
+
+struct Frame
+{
+  SER_PROPS(seq, text)
+  int seq;
+  std::string text;
+};
+
+namespace
+{
+  struct SocketPair
+  {
+    SocketPair()
+    {
+      if (socketpair(AF_UNIX, SOCK_STREAM, 0, fds) != 0)
+        throw std::runtime_error{"socketpair"};
+    }
+    ~SocketPair()
+    {
+      closeWriter();
+      close(fds[0]);
+    }
+    auto closeWriter() -> void
+    {
+      if (fds[1] >= 0)
+        close(std::exchange(fds[1], -1));
+    }
+    auto write(std::string_view v) -> void
+    {
+      while (!v.empty())
+      {
+        const auto n = ::write(fds[1], v.data(), v.size());
+        if (n <= 0)
+          throw std::runtime_error{"write"};
+        v.remove_prefix(static_cast<size_t>(n));
+      }
+    }
+    int fds[2];
+  };
+
+  auto encodeFrames(int count) -> std::string
+  {
+    auto ss = std::ostringstream{};
+    for (auto i = 0; i < count; ++i)
+      msgpackSer(ss, Frame{i, std::string(static_cast<size_t>(i % 50), 'a')});
+    return ss.str();
+  }
+
+  auto collect(msgpack::AsyncReader &r, std::vector<Frame> &out) -> msgpack::Task
+  {
+    auto f = Frame{};
+    while (co_await r.next(f))
+      out.push_back(f);
+  }
+} // namespace
+
+TEST_CASE("Async reader", "[msgpack-async]")
+{
+  SECTION("Messages split across reads")
+  {
+    const auto data = encodeFrames(200);
+    auto sp = SocketPair{};
+    auto loop = msgpack::EventLoop{};
+    auto reader = msgpack::AsyncReader{loop, sp.fds[0]};
+    auto out = std::vector<Frame>{};
+    loop.spawn(collect(reader, out));
+
+    auto writer = std::thread{[&sp, &data]() {
+      for (size_t i = 0; i < data.size(); i += 7)
+      {
+        sp.write(std::string_view{data}.substr(i, 7));
+        if (i % 700 == 0)
+          std::this_thread::yield();
+      }
+      sp.closeWriter();
+    }};
+    loop.run();
+    writer.join();
+
+    REQUIRE(out.size() == 200);
+    for (auto i = 0; i < 200; ++i)
+    {
+      REQUIRE(out[static_cast<size_t>(i)].seq == i);
+      REQUIRE(out[static_cast<size_t>(i)].text.size() == static_cast<size_t>(i % 50));
+    }
+  }
+
+  SECTION("Many connections on one thread")
+  {
+    constexpr auto Conns = 300;
+    const auto data = encodeFrames(20);
+    auto sps = std::vector<SocketPair>(Conns);
+    auto loop = msgpack::EventLoop{};
+    auto readers = std::vector<std::unique_ptr<msgpack::AsyncReader>>{};
+    auto outs = std::vector<std::vector<Frame>>(Conns);
+    for (size_t i = 0; i < Conns; ++i)
+    {
+      readers.push_back(std::make_unique<msgpack::AsyncReader>(loop, sps[i].fds[0]));
+      loop.spawn(collect(*readers.back(), outs[i]));
+    }
+    auto writer = std::thread{[&sps, &data]() {
+      const auto half = data.size() / 2;
+      for (auto &sp : sps)
+        sp.write(std::string_view{data}.substr(0, half));
+      for (auto &sp : sps)
+      {
+        sp.write(std::string_view{data}.substr(half));
+        sp.closeWriter();
+      }
+    }};
+    loop.run();
+    writer.join();
+    for (const auto &out : outs)
+    {
+      REQUIRE(out.size() == 20);
+      REQUIRE(out.back().seq == 19);
+    }
+  }
+
+  SECTION("Untyped values")
+  {
+    auto sp = SocketPair{};
+    sp.write("\x93\x01\x02\x03\xa2hi");
+    sp.closeWriter();
+    auto loop = msgpack::EventLoop{};
+    auto reader = msgpack::AsyncReader{loop, sp.fds[0]};
+    auto sizes = std::vector<size_t>{};
+    auto strs = std::vector<std::string>{};
+    loop.spawn([](msgpack::AsyncReader &r,
+                  std::vector<size_t> &arraySizes,
+                  std::vector<std::string> &texts) -> msgpack::Task {
+      while (co_await r.next())
+        if (const auto a = std::get_if<msgpack::Array>(&r.val()))
+          arraySizes.push_back(a->size());
+        else
+          texts.emplace_back(std::get<std::string_view>(r.val()));
+    }(reader, sizes, strs));
+    loop.run();
+    REQUIRE(sizes == std::vector<size_t>{3});
+    REQUIRE(strs == std::vector<std::string>{"hi"});
+  }
+
+  SECTION("Truncated stream")
+  {
+    auto sp = SocketPair{};
+    sp.write("\x93\x01\x02");
+    sp.closeWriter();
+    auto loop = msgpack::EventLoop{};
+    auto reader = msgpack::AsyncReader{loop, sp.fds[0]};
+    auto out = std::vector<Frame>{};
+    loop.spawn(collect(reader, out));
+    REQUIRE_THROWS_AS(loop.run(), msgpack::ParsingError);
+  }
+
+  SECTION("Unknown type byte")
+  {
+    auto sp = SocketPair{};
+    sp.write(encodeFrames(2) + "\x91\xc1");
+    sp.closeWriter();
+    auto loop = msgpack::EventLoop{};
+    auto reader = msgpack::AsyncReader{loop, sp.fds[0]};
+    auto out = std::vector<Frame>{};
+    loop.spawn(collect(reader, out));
+    REQUIRE_THROWS_AS(loop.run(), msgpack::ParsingError);
+    REQUIRE(out.size() == 2);
+  }
+}
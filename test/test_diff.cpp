@@ -0,0 +1,159 @@
+#include "../msgpack-diff.hpp"
+#include "../msgpack-ser.hpp"
+#include "helpers.hpp"
+#include <catch2/catch.hpp>
+#include <ser/macro.hpp>
+#include <sstream>
+
+struct Product
+{
+  SER_PROPS(sku, price, tags)
+  std::string sku;
+  double price;
+  std::vector<std::string> tags;
+};
+
+struct Catalog
+{
+  SER_PROPS(version, products, settings)
+  int version;
+  std::vector<Product> products;
+  std::map<std::string, int> settings;
+};
+
+namespace
+{
+  auto diff(const std::string &from, const std::string &to) -> std::string
+  {
+    auto ss = std::ostringstream{};
+    msgpack::diff(toBytes(from), toBytes(to), ss);
+    return ss.str();
+  }
+
+  auto patch(const std::string &from, const std::string &delta) -> std::string
+  {
+    auto ss = std::ostringstream{};
+    msgpack::patch(toBytes(from), toBytes(delta), ss);
+    return ss.str();
+  }
+
+  auto makeCatalog() -> Catalog
+  {
+    auto c = Catalog{};
+    c.version = 1;
+    for (auto i = 0; i < 2000; ++i)
+      c.products.push_back(Product{"sku" + std::to_string(i), i * 0.5, {"a", "b"}});
+    c.settings = {{"currency", 1}, {"region", 2}};
+    return c;
+  }
+} // namespace
+
+using namespace std::string_literals;
+
+TEST_CASE("Diff and patch", "[msgpack-diff]")
+{
+  const auto base = makeCatalog();
+  const auto from = encode(base);
+
+  SECTION("Patches grow with the change")
+  {
+    auto c = base;
+    c.version = 2;
+    c.products[700].price = 1.25;
+    c.products[1500].tags.push_back("sale");
+    c.products.insert(c.products.begin() + 10, Product{"new", 9.0, {}});
+    c.products.erase(c.products.begin() + 1900);
+    c.settings.erase("region");
+    c.settings["tax"] = 3;
+    const auto to = encode(c);
+    const auto delta = diff(from, to);
+    REQUIRE(delta.size() < 200);
+    REQUIRE(patch(from, delta) == to);
+
+    REQUIRE(diff(from, from) == "\x90"s);
+    REQUIRE(patch(from, "\x90"s) == from);
+  }
+
+  SECTION("Random edits")
+  {
+    auto seed = 1u;
+    const auto next = [&](unsigned n) {
+      seed = seed * 1103515245u + 12345u;
+      return (seed >> 16) % n;
+    };
+    for (auto round = 0; round < 200; ++round)
+    {
+      auto a = std::vector<std::vector<int>>(next(40));
+      for (auto &e : a)
+        e.resize(next(3), static_cast<int>(next(4)));
+      auto b = a;
+      for (auto edits = next(6); edits > 0; --edits)
+      {
+        const auto at = b.empty() ? 0 : next(static_cast<unsigned>(b.size()));
+        switch (next(3))
+        {
+        case 0:
+          b.insert(b.begin() + at, std::vector<int>{static_cast<int>(next(100))});
+          break;
+        case 1:
+          if (!b.empty())
+            b.erase(b.begin() + at);
+          break;
+        default:
+          if (!b.empty())
+            b[at].push_back(7);
+        }
+      }
+      const auto before = encode(a);
+      const auto after = encode(b);
+      REQUIRE(patch(before, diff(before, after)) == after);
+      REQUIRE(patch(after, diff(after, before)) == before);
+    }
+  }
+
+  SECTION("Scalars and other types are set whole")
+  {
+    for (const auto &[a, b] : {std::pair{"\x01"s, "\x02"s},
+                               std::pair{encode(std::vector<int>{1, 2}), "\xc0"s},
+                               std::pair{"\x80"s, "\x90"s},
+                               std::pair{encode(std::vector<int>{1, 2, 3}), "\x90"s},
+                               std::pair{"\x90"s, encode(std::vector<int>{1, 2, 3})}})
+    {
+      const auto delta = diff(a, b);
+      REQUIRE(patch(a, delta) == b);
+    }
+    REQUIRE(diff("\x01"s, "\x02"s) == "\x91\x93\x00\x90\x02"s);
+  }
+
+  SECTION("Hand-written patches")
+  {
+    const auto m = encode(std::map<std::string, std::vector<int>>{{"a", {1, 2, 3}}, {"b", {}}});
+    // delete b and the middle element of a
+    const auto delta = "\x92\x92\x01\x91\xa1"
+                       "b\x92\x01\x92\xa1"
+                       "a\x01"s;
+    REQUIRE(patch(m, delta) == encode(std::map<std::string, std::vector<int>>{{"a", {1, 3}}}));
+    // splice into a
+    const auto splice = "\x91\x95\x02\x91\xa1"
+                        "a\x01\x01\x92\x07\x08"s;
+    REQUIRE(patch(m, splice) ==
+            encode(std::map<std::string, std::vector<int>>{{"a", {1, 7, 8, 3}}, {"b", {}}}));
+    // set a missing key
+    REQUIRE(patch(m, "\x91\x93\x00\x91\xa1z\x01"s) == "\x83" + m.substr(1) + "\xa1z\x01");
+
+    // a missing key, an index out of range, a path through a scalar, deleting the whole
+    // message, an unknown op, a splice past the end, a truncated patch
+    const auto bad = {"\x91\x92\x01\x91\xa1z"s,
+                      "\x91\x93\x00\x92\xa1"
+                      "a\x09\x01"s,
+                      "\x91\x93\x00\x93\xa1"
+                      "a\x00\x00\x01"s,
+                      "\x91\x92\x01\x90"s,
+                      "\x91\x93\x07\x90\x01"s,
+                      "\x91\x95\x02\x91\xa1"
+                      "a\x02\x05\x90"s,
+                      "\x92\x93\x00\x90\x01"s};
+    for (const auto &d : bad)
+      REQUIRE_THROWS_AS(patch(m, d), msgpack::ParsingError);
+  }
+}
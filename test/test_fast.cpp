@@ -0,0 +1,83 @@
+#include "../msgpack-fast.hpp"
+#include "../msgpack-ser.hpp"
+#include "helpers.hpp"
+#include <catch2/catch.hpp>
+#include <optional>
+#include <ser/macro.hpp>
+#include <sstream>
+
+struct Quote
+{
+  SER_PROPS(symbol, bid, ask, size, live, venue)
+  std::string symbol;
+  double bid;
+  double ask;
+  int64_t size;
+  bool live;
+  std::optional<std::string> venue;
+};
+
+struct Book
+{
+  SER_PROPS(id, quotes, raw)
+  uint32_t id;
+  std::vector<Quote> quotes;
+  std::vector<std::byte> raw;
+};
+
+using namespace std::string_literals;
+
+TEST_CASE("Schema fast path", "[msgpack-fast]")
+{
+  const auto book = Book{
+    70000,
+    {Quote{"ABC", 1.5, 1.75, -300, true, std::nullopt}, Quote{"XYZ", 2.0, 2.25, 1LL << 40, false, "X"}},
+    {std::byte{1}, std::byte{2}}};
+
+  SECTION("Encoded layout")
+  {
+    const auto bytes = encode(book);
+    auto out = Book{};
+    msgpackDeserFast(toBytes(bytes), out);
+    REQUIRE(out.id == 70000);
+    REQUIRE(out.quotes.size() == 2);
+    REQUIRE(out.quotes[0].symbol == "ABC");
+    REQUIRE(out.quotes[0].size == -300);
+    REQUIRE(out.quotes[1].size == 1LL << 40);
+    REQUIRE(out.quotes[1].ask == 2.25);
+    REQUIRE_FALSE(out.quotes[1].live);
+    REQUIRE_FALSE(out.quotes[0].venue);
+    REQUIRE(out.quotes[1].venue == "X");
+    REQUIRE(out.raw == book.raw);
+  }
+
+  SECTION("Diverging layouts fall back")
+  {
+    // keys out of order, a missing field, an integer where a double is expected
+    const auto bytes = "\x82\xa3" "ask\xcb\x3f\xf8\x00\x00\x00\x00\x00\x00\xa6symbol\xa1Q"s;
+    auto fast = Quote{"old", 9.0, 9.0, 9, true, "V"};
+    auto generic = fast;
+    msgpackDeserFast(toBytes(bytes), fast);
+    msgpackDeser(msgpack::Blob{toBytes(bytes)}.val, generic);
+    REQUIRE(fast.symbol == "Q");
+    REQUIRE(fast.ask == 1.5);
+    REQUIRE(fast.bid == generic.bid);
+    REQUIRE(fast.size == generic.size);
+    REQUIRE(fast.venue == generic.venue);
+
+    const auto wrongType = "\x81\xa1" "a\x01"s;
+    auto b = Book{};
+    REQUIRE_THROWS_AS(msgpackDeserFast(toBytes(encode(std::string{"a"})), b),
+                      msgpack::ParsingError);
+    REQUIRE_NOTHROW(msgpackDeserFast(toBytes(wrongType), b));
+  }
+
+  SECTION("Truncated and trailing bytes")
+  {
+    const auto bytes = encode(book);
+    auto out = Book{};
+    REQUIRE_THROWS(msgpackDeserFast(toBytes(bytes).first(bytes.size() - 1), out));
+    const auto extra = bytes + '\xc0';
+    REQUIRE_THROWS(msgpackDeserFast(toBytes(extra), out));
+  }
+}
@@ -0,0 +1,73 @@
+#include "../msgpack-gather.hpp"
+#include "../msgpack-ser.hpp"
+#include <catch2/catch.hpp>
+#include <cstdio>
+#include <ser/macro.hpp>
+#include <sstream>
+
+struct Payload
+{
+  SER_PROPS(id, name, data)
+  int id;
+  std::string name;
+  std::string data;
+};
+
+TEST_CASE("Scatter-gather output", "[msgpack-gather]")
+{
+  auto p = Payload{7, "small", std::string(1 << 20, 'x')};
+
+  SECTION("Large payloads are referenced in place")
+  {
+    auto gs = msgpack::GatherStream{};
+    msgpackSer(gs, p);
+    const auto iov = gs.segments();
+    REQUIRE(iov.size() == 2);
+    REQUIRE(iov[1].iov_base == p.data.data());
+    REQUIRE(iov[1].iov_len == p.data.size());
+    REQUIRE(gs.staged() < 32);
+
+    auto ss = std::ostringstream{};
+    msgpackSer(ss, p);
+    REQUIRE(gs.size() == ss.str().size());
+    auto joined = std::string{};
+    for (const auto &s : iov)
+      joined.append(static_cast<const char *>(s.iov_base), s.iov_len);
+    REQUIRE(joined == ss.str());
+  }
+
+  SECTION("writev produces the sequential encoding")
+  {
+    const auto v = std::vector<Payload>{p, Payload{8, "other", "short"}, p};
+    auto gs = msgpack::GatherStream{};
+    msgpackSer(gs, v);
+    REQUIRE(gs.segments().size() == 4);
+
+    auto f = std::tmpfile();
+    gs.writev(fileno(f));
+    std::rewind(f);
+    auto written = std::string(gs.size(), '\0');
+    REQUIRE(std::fread(written.data(), 1, written.size(), f) == written.size());
+    std::fclose(f);
+
+    auto ss = std::ostringstream{};
+    msgpackSer(ss, v);
+    REQUIRE(written == ss.str());
+
+    auto iss = std::istringstream{written};
+    auto out = std::vector<Payload>{};
+    msgpackDeser(iss, out);
+    REQUIRE(out.size() == 3);
+    REQUIRE(out[2].data == p.data);
+    REQUIRE(out[1].name == "other");
+  }
+
+  SECTION("Reset")
+  {
+    auto gs = msgpack::GatherStream{};
+    msgpackSer(gs, p);
+    gs.reset();
+    REQUIRE(gs.size() == 0);
+    REQUIRE(gs.segments().empty());
+  }
+}
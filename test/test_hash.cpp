@@ -0,0 +1,161 @@
+#include "../msgpack-fast.hpp"
+#include "../msgpack-hash.hpp"
+#include "../msgpack-parallel.hpp"
+#include "../msgpack-ser.hpp"
+#include <catch2/catch.hpp>
+#include <cmath>
+#include <ser/macro.hpp>
+#include <sstream>
+
+struct Entry
+{
+  SER_PROPS(name, weight, tags, scores)
+  std::string name;
+  double weight;
+  std::unordered_set<std::string> tags;
+  std::unordered_map<int, float> scores;
+};
+
+namespace
+{
+  auto xxh64(std::string_view s) -> uint64_t
+  {
+    auto hs = msgpack::HashStream{};
+    hs.write(s.data(), static_cast<std::streamsize>(s.size()));
+    return hs.digest();
+  }
+
+  auto makeEntries(int n, bool reversed) -> std::unordered_map<std::string, Entry>
+  {
+    auto r = std::unordered_map<std::string, Entry>{};
+    if (!reversed)
+      r.reserve(static_cast<size_t>(n) * 4);
+    for (auto j = 0; j < n; ++j)
+    {
+      const auto i = reversed ? n - 1 - j : j;
+      auto &e = r["entry" + std::to_string(i)];
+      e.name = "n" + std::to_string(i);
+      e.weight = i * 0.5;
+      const auto tags = i % 5;
+      for (auto t = 0; t < tags; ++t)
+        e.tags.insert("t" + std::to_string(reversed ? tags - 1 - t : t));
+      const auto scores = i % 7;
+      for (auto s = 0; s < scores; ++s)
+      {
+        const auto k = reversed ? scores - 1 - s : s;
+        e.scores[k * 37] = static_cast<float>(k);
+      }
+    }
+    return r;
+  }
+
+  auto encode(const auto &v) -> std::string
+  {
+    auto ss = std::ostringstream{};
+    ss << msgpack::canonical;
+    msgpackSer(ss, v);
+    return ss.str();
+  }
+} // namespace
+
+using namespace std::string_literals;
+
+TEST_CASE("Canonical encoding and content hash", "[msgpack-hash]")
+{
+  SECTION("XXH64")
+  {
+    REQUIRE(xxh64("") == 0xef46db3751d8e999);
+    REQUIRE(xxh64("a") == 0xd24ec4f1a98c6e5b);
+    REQUIRE(xxh64("abc") == 0x44bc2cf5ad770999);
+    REQUIRE(xxh64("Nobody inspects the spammish repetition") == 0xfbcea83c8a378bf1);
+
+    auto data = std::string{};
+    for (auto i = 0; i < 10000; ++i)
+      data += static_cast<char>(i * 7 + i / 13);
+    const auto whole = xxh64(data);
+    auto hs = msgpack::HashStream{};
+    for (size_t i = 0, n = 1; i < data.size(); i += n, n = n % 61 + 5)
+      hs.write(data.data() + i, static_cast<std::streamsize>(std::min(n, data.size() - i)));
+    REQUIRE(hs.size() == data.size());
+    REQUIRE(hs.digest() == whole);
+
+    hs.reset();
+    hs.write("abc", 3);
+    REQUIRE(hs.digest() == 0x44bc2cf5ad770999);
+  }
+
+  SECTION("Equal maps give equal bytes")
+  {
+    const auto a = makeEntries(500, false);
+    const auto b = makeEntries(500, true);
+    REQUIRE(encode(a) == encode(b));
+    REQUIRE(msgpack::contentHash(a) == msgpack::contentHash(b));
+    REQUIRE(msgpack::contentHash(a) != msgpack::contentHash(makeEntries(499, false)));
+
+    auto ss = std::ostringstream{};
+    ss << msgpack::canonical;
+    msgpackSerParallel(ss, b, 4);
+    REQUIRE(ss.str() == encode(a));
+
+    auto out = std::unordered_map<std::string, Entry>{};
+    const auto bytes = encode(a);
+    const auto blob = msgpack::Blob{std::as_bytes(std::span{bytes})};
+    msgpackDeser(blob.val, out);
+    REQUIRE(out.size() == a.size());
+    REQUIRE(out.at("entry7").tags == a.at("entry7").tags);
+    REQUIRE(out.at("entry13").scores == a.at("entry13").scores);
+  }
+
+  SECTION("Keys are ordered by encoded bytes")
+  {
+    const auto m = std::map<int, int>{{-1, 0}, {0, 0}, {200, 0}};
+    REQUIRE(encode(m) == "\x83\x00\x00\xcc\xc8\x00\xff\x00"s);
+    const auto s = std::map<std::string, int>{{"bb", 0}, {"c", 0}};
+    REQUIRE(encode(s) == "\x82\xa1" "c\x00\xa2" "bb\x00"s);
+  }
+
+  SECTION("Floats")
+  {
+    REQUIRE(encode(1.5) == "\xca\x3f\xc0\x00\x00"s);
+    REQUIRE(encode(0.1) == "\xcb\x3f\xb9\x99\x99\x99\x99\x99\x9a"s);
+    REQUIRE(encode(1e300) == "\xcb\x7e\x37\xe4\x3c\x88\x00\x75\x9c"s);
+    REQUIRE(encode(-HUGE_VAL) == "\xca\xff\x80\x00\x00"s);
+    REQUIRE(encode(std::nan("1")) == "\xca\x7f\xc0\x00\x00"s);
+    REQUIRE(encode(-std::nanf("2")) == "\xca\x7f\xc0\x00\x00"s);
+
+    auto plain = std::ostringstream{};
+    msgpackSer(plain, 1.5);
+    REQUIRE(plain.str().size() == 9);
+
+    const auto e = Entry{"x", 2.25, {}, {}};
+    const auto bytes = encode(e);
+    const auto blob = msgpack::Blob{std::as_bytes(std::span{bytes})};
+    auto out = Entry{};
+    msgpackDeser(blob.val, out);
+    REQUIRE(out.weight == 2.25);
+    auto fast = Entry{};
+    msgpackDeserFast(std::as_bytes(std::span{bytes}), fast);
+    REQUIRE(fast.weight == 2.25);
+  }
+
+  SECTION("Tee")
+  {
+    const auto v = makeEntries(100, true);
+    auto sink = std::ostringstream{};
+    auto hs = msgpack::HashStream{sink};
+    hs << msgpack::canonical;
+    msgpackSer(hs, v);
+    REQUIRE(hs.digest() == msgpack::contentHash(v));
+    REQUIRE(sink.str() == encode(v));
+    REQUIRE(hs.size() == sink.str().size());
+
+    // reset() without digest() still passes the buffered bytes on
+    hs.reset();
+    msgpackSer(hs, std::string{"abc"});
+    hs.reset();
+    REQUIRE(sink.str() == encode(v) + encode(std::string{"abc"}));
+    msgpackSer(hs, v);
+    REQUIRE(hs.digest() == msgpack::contentHash(v));
+    REQUIRE(sink.str() == encode(v) + encode(std::string{"abc"}) + encode(v));
+  }
+}
@@ -0,0 +1,104 @@
+#include "../msgpack-intern.hpp"
+#include "../msgpack-ser.hpp"
+#include <catch2/catch.hpp>
+#include <map>
+#include <ser/macro.hpp>
+#include <sstream>
+#include <unordered_map>
+
+struct Tagged
+{
+  SER_PROPS(name, tags)
+  msgpack::Interned name;
+  std::map<msgpack::Interned, int> tags;
+};
+
+TEST_CASE("Interning pool", "[msgpack-intern]")
+{
+  SECTION("Repeated strings share storage")
+  {
+    auto pool = msgpack::InternPool{};
+    const auto a = pool.intern("status");
+    const auto b = pool.intern(std::string{"stat"} + "us");
+    REQUIRE(a.view().data() == b.view().data());
+    REQUIRE(a == b);
+    REQUIRE(pool.size() == 1);
+    REQUIRE(msgpack::hashBytes("status") == std::hash<msgpack::Interned>{}(a));
+  }
+
+  SECTION("Long strings are not pooled")
+  {
+    auto pool = msgpack::InternPool{16, 4};
+    const auto a = pool.intern("longer");
+    const auto b = pool.intern("longer");
+    REQUIRE(a == b);
+    REQUIRE(a.view().data() != b.view().data());
+    REQUIRE(pool.size() == 0);
+  }
+
+  SECTION("Bounded with clock eviction")
+  {
+    auto pool = msgpack::InternPool{2};
+    const auto hot = pool.intern("hot");
+    pool.intern("cold");
+    pool.intern("hot");
+    const auto newer = pool.intern("newer");
+    REQUIRE(pool.size() == 2);
+    REQUIRE(pool.intern("hot").view().data() == hot.view().data());
+    REQUIRE(pool.intern("newer").view().data() == newer.view().data());
+    // evicted handles stay valid
+    REQUIRE(pool.intern("cold") == msgpack::Interned{"cold"});
+  }
+
+  SECTION("Decoding interns keys across messages")
+  {
+    auto ss1 = std::ostringstream{};
+    auto ss2 = std::ostringstream{};
+    msgpackSer(ss1, Tagged{msgpack::Interned{"first"}, {{msgpack::Interned{"k1"}, 1}}});
+    msgpackSer(ss2, Tagged{msgpack::Interned{"first"}, {{msgpack::Interned{"k1"}, 2}}});
+
+    auto pool = msgpack::InternPool{};
+    auto scope = msgpack::InternPool::Scope{pool};
+    REQUIRE(msgpack::InternPool::current() == &pool);
+    auto iss1 = std::istringstream{ss1.str()};
+    auto iss2 = std::istringstream{ss2.str()};
+    auto first = Tagged{};
+    auto second = Tagged{};
+    msgpackDeser(iss1, first);
+    msgpackDeser(iss2, second);
+    REQUIRE(first.name.view() == "first");
+    REQUIRE(second.tags.at(msgpack::Interned{"k1"}) == 2);
+    REQUIRE(first.name.view().data() == second.name.view().data());
+    REQUIRE(first.tags.begin()->first.view().data() == second.tags.begin()->first.view().data());
+  }
+
+  SECTION("Unordered maps")
+  {
+    const auto in = std::unordered_map<msgpack::Interned, int>{{msgpack::Interned{"a"}, 1},
+                                                               {msgpack::Interned{"b"}, 2}};
+    auto ss = std::ostringstream{};
+    msgpackSer(ss, in);
+    auto pool = msgpack::InternPool{};
+    auto scope = msgpack::InternPool::Scope{pool};
+    auto iss = std::istringstream{ss.str()};
+    auto out = std::unordered_map<msgpack::Interned, int>{};
+    msgpackDeser(iss, out);
+    REQUIRE(out == in);
+    REQUIRE(pool.size() == 2);
+  }
+
+  SECTION("Looking up existing keys does not intern them")
+  {
+    auto ss = std::ostringstream{};
+    msgpackSer(ss, std::map<msgpack::Interned, int>{{msgpack::Interned{"k1"}, 5}});
+    auto out = std::map<msgpack::Interned, int>{{msgpack::Interned{"k1"}, 0}};
+    auto pool = msgpack::InternPool{};
+    auto scope = msgpack::InternPool::Scope{pool};
+    auto iss = std::istringstream{ss.str()};
+    msgpackDeser(iss, out);
+    REQUIRE(pool.size() == 0);
+    REQUIRE(out.begin()->second == 5);
+  }
+
+  REQUIRE(msgpack::InternPool::current() == nullptr);
+}
@@ -0,0 +1,165 @@
+#include "../msgpack-json.hpp"
+#include "../msgpack-ser.hpp"
+#include <catch2/catch.hpp>
+#include <optional>
+#include <ser/macro.hpp>
+#include <sstream>
+
+using namespace std::string_literals;
+
+struct Doc
+{
+  SER_PROPS(name, count, ratio, flags, note, blob, tags)
+  std::string name;
+  int count;
+  double ratio;
+  std::vector<int> flags;
+  std::optional<std::string> note;
+  std::vector<std::byte> blob;
+  std::map<int, std::string> tags;
+};
+
+struct DocHead
+{
+  SER_PROPS(name, count, ratio, flags)
+  std::string name;
+  int count;
+  double ratio;
+  std::vector<int> flags;
+};
+
+namespace
+{
+  auto toJson(const std::string &bytes) -> std::string
+  {
+    auto in = std::istringstream{bytes};
+    auto out = std::ostringstream{};
+    msgpack::toJson(in, out);
+    return out.str();
+  }
+
+  auto fromJson(const std::string &json) -> std::string
+  {
+    auto in = std::istringstream{json};
+    auto out = std::ostringstream{};
+    msgpack::fromJson(in, out);
+    return out.str();
+  }
+
+  // A sink that cannot seek, like a pipe.
+  class PipeBuf final : public std::stringbuf
+  {
+  protected:
+    auto seekoff(off_type, std::ios_base::seekdir, std::ios_base::openmode) -> pos_type final
+    {
+      return pos_type(-1);
+    }
+    auto seekpos(pos_type, std::ios_base::openmode) -> pos_type final { return pos_type(-1); }
+  };
+} // namespace
+
+TEST_CASE("JSON transcoding", "[msgpack-json]")
+{
+  const auto doc = Doc{"a \"q\"\n\x01",
+                       -300,
+                       0.25,
+                       {1, -2},
+                       std::nullopt,
+                       {std::byte{0xfb}, std::byte{0xff}},
+                       {{1, "one"}, {70000, "big"}}};
+  auto ss = std::ostringstream{};
+  msgpackSer(ss, doc);
+  const auto bytes = ss.str();
+  const auto json = std::string{R"({"name":"a \"q\"\n\u0001","count":-300,"ratio":0.25,)"
+                                R"("flags":[1,-2],"note":null,"blob":"+/8=",)"
+                                R"("tags":{"1":"one","70000":"big"}})"
+                                "\n"};
+
+  SECTION("msgpack to JSON")
+  {
+    REQUIRE(toJson(bytes) == json);
+    REQUIRE(toJson(bytes + bytes) == json + json);
+    REQUIRE(toJson("\xc3\x90\x80\xcb\x7f\xf0\x00\x00\x00\x00\x00\x00"s) == "true\n[]\n{}\nnull\n");
+  }
+
+  SECTION("JSON to msgpack")
+  {
+    const auto packed = fromJson(json);
+    // blob and integer keys come back as strings
+    REQUIRE(toJson(packed) == json);
+    auto back = DocHead{};
+    msgpackDeser(msgpack::Blob{std::as_bytes(std::span{packed})}.val, back);
+    REQUIRE(back.name == doc.name);
+    REQUIRE(back.count == doc.count);
+    REQUIRE(back.ratio == doc.ratio);
+    REQUIRE(back.flags == doc.flags);
+
+    REQUIRE(fromJson(" [ 1 , -1, 18446744073709551615, 1e3, \"\\ud83d\\ude00\" ] ") ==
+            "\x95\x01\xff\xcf\xff\xff\xff\xff\xff\xff\xff\xff"
+            "\xcb\x40\x8f\x40\x00\x00\x00\x00\x00\xa4\xf0\x9f\x98\x80"s);
+    REQUIRE(fromJson("{} [] 7") == "\x80\x90\x07"s);
+  }
+
+  SECTION("Container headers match msgpackSer")
+  {
+    auto head = DocHead{"x", 7, 0.5, std::vector<int>(20, 1)};
+    auto nested = std::map<std::string, std::vector<std::vector<int>>>{};
+    nested["a"].resize(300);
+    nested["b"] = {{1, 2}, std::vector<int>(16, 3)};
+    auto ss2 = std::ostringstream{};
+    msgpackSer(ss2, head);
+    msgpackSer(ss2, nested);
+    const auto packed = ss2.str();
+    REQUIRE(fromJson(toJson(packed)) == packed);
+  }
+
+  SECTION("Non-seekable output")
+  {
+    auto buf = PipeBuf{};
+    auto out = std::ostream{&buf};
+    auto in = std::istringstream{json + json};
+    msgpack::fromJson(in, out);
+    REQUIRE(buf.str() == fromJson(json) + fromJson(json));
+  }
+
+  SECTION("Ext and timestamps")
+  {
+    const auto ts32 = "\xd6\xff\x00\x00\x00\x01"s;
+    REQUIRE(toJson(ts32) == "{\"$timestamp\":\"1970-01-01T00:00:01Z\"}\n");
+    REQUIRE(fromJson(toJson(ts32)) == ts32);
+
+    // 2024-02-29T12:00:00.5Z: 30-bit nanoseconds, 34-bit seconds
+    const auto ts64 = "\xd7\xff\x77\x35\x94\x00\x65\xe0\x71\xc0"s;
+    REQUIRE(toJson(ts64) == "{\"$timestamp\":\"2024-02-29T12:00:00.500000000Z\"}\n");
+    REQUIRE(fromJson(toJson(ts64)) == ts64);
+
+    const auto ts96 = "\xc7\x0c\xff\x00\x00\x00\x01\xff\xff\xff\xff\xff\xff\xff\xff"s;
+    REQUIRE(toJson(ts96) == "{\"$timestamp\":\"1969-12-31T23:59:59.000000001Z\"}\n");
+    REQUIRE(fromJson(toJson(ts96)) == ts96);
+
+    const auto ext = "\xc7\x03\x05\x01\x02\x03"s;
+    REQUIRE(toJson(ext) == "{\"$ext\":[5,\"AQID\"]}\n");
+    REQUIRE(fromJson(toJson(ext)) == ext);
+
+    for (const auto bad : {"2020-01-01T1", "2020-01-01T12:00:0", "2020-", "2020-13-01T00:00:00Z"})
+      REQUIRE_THROWS_AS(fromJson("{\"$timestamp\":\""s + bad + "\"}"), msgpack::ParsingError);
+  }
+
+  SECTION("Errors")
+  {
+    REQUIRE_THROWS_AS(toJson(bytes.substr(0, bytes.size() - 1)), msgpack::ParsingError);
+    REQUIRE_THROWS_AS(toJson("\x81\x90\x01"s), msgpack::ParsingError);
+    REQUIRE_THROWS_AS(fromJson("[1,"), msgpack::ParsingError);
+    REQUIRE_THROWS_AS(fromJson("{\"a\" 1}"), msgpack::ParsingError);
+    REQUIRE_THROWS_AS(fromJson("[1 2]"), msgpack::ParsingError);
+    REQUIRE_THROWS_AS(fromJson("nul"), msgpack::ParsingError);
+    REQUIRE_THROWS_AS(fromJson("\"\\x\""), msgpack::ParsingError);
+
+    const auto utf8 = "\xc3\xa9\xe2\x82\xac\xf0\x9f\x98\x80"s;
+    REQUIRE(toJson("\xa9" + utf8) == "\"" + utf8 + "\"\n");
+    // stray continuation, overlong, surrogate, past U+10FFFF, cut short
+    for (const auto &bad : {"\xa1\x80"s, "\xa2\xc0\xaf"s, "\xa3\xed\xa0\x80"s,
+                           "\xa4\xf4\x90\x80\x80"s, "\xa2\xc3\x41"s, "\xa1\xc3"s})
+      REQUIRE_THROWS_AS(toJson(bad), msgpack::ParsingError);
+  }
+}
@@ -0,0 +1,119 @@
+#include "../msgpack-keydict.hpp"
+#include "../msgpack-parallel.hpp"
+#include "../msgpack-ser.hpp"
+#include "helpers.hpp"
+#include <catch2/catch.hpp>
+#include <ser/macro.hpp>
+#include <sstream>
+
+struct Reading
+{
+  SER_PROPS(sensorId, temperature, description)
+  int sensorId;
+  double temperature;
+  std::string description;
+};
+
+namespace
+{
+  auto makeReadings(int n) -> std::vector<Reading>
+  {
+    auto r = std::vector<Reading>{};
+    for (auto i = 0; i < n; ++i)
+      r.push_back(Reading{i, 20.0 + i % 10, i % 2 ? "ok" : ""});
+    return r;
+  }
+} // namespace
+
+using namespace std::string_literals;
+
+TEST_CASE("Key dictionary", "[msgpack-keydict]")
+{
+  const auto in = makeReadings(2000);
+
+  SECTION("Round trip")
+  {
+    auto enc = msgpack::KeyDict{};
+    auto ss = std::ostringstream{};
+    ss << msgpack::keyDict(enc);
+    msgpackSer(ss, in);
+    REQUIRE(enc.size() == 3);
+
+    auto plain = std::ostringstream{};
+    msgpackSer(plain, in);
+    REQUIRE(ss.str().size() < plain.str().size() * 2 / 3);
+
+    auto dec = msgpack::KeyDict{};
+    const auto bytes = ss.str();
+    const auto blob = msgpack::Blob{toBytes(bytes), dec};
+    auto out = std::vector<Reading>{};
+    msgpackDeser(blob.val, out);
+    REQUIRE(out.size() == in.size());
+    REQUIRE(out[1999].sensorId == 1999);
+    REQUIRE(out[1999].description == "ok");
+    REQUIRE(dec.size() == 3);
+  }
+
+  SECTION("Later messages only refer to keys")
+  {
+    auto enc = msgpack::KeyDict{};
+    auto dec = msgpack::KeyDict{};
+    auto first = std::ostringstream{};
+    first << msgpack::keyDict(enc);
+    msgpackSer(first, in[0]);
+    auto second = std::ostringstream{};
+    second << msgpack::keyDict(enc);
+    msgpackSer(second, in[1]);
+    REQUIRE(second.str().find("sensorId") == std::string::npos);
+    // fixmap, then fixext1 reference to key 0
+    REQUIRE(second.str().substr(0, 4) == "\x83\xd4\x6b\x00"s);
+
+    const auto b1 = first.str();
+    const auto b2 = second.str();
+    auto r = Reading{};
+    msgpackDeser(msgpack::Blob{toBytes(b1), dec}.val, r);
+    msgpackDeser(msgpack::Blob{toBytes(b2), dec}.val, r);
+    REQUIRE(r.sensorId == 1);
+    REQUIRE(r.description == "ok");
+  }
+
+  SECTION("Sparse structs and the plain mode")
+  {
+    auto enc = msgpack::KeyDict{};
+    auto dec = msgpack::KeyDict{};
+    auto ss = std::ostringstream{};
+    ss << msgpack::keyDict(enc) << msgpack::omitDefaults;
+    msgpackSer(ss, in[0]);
+    REQUIRE(enc.size() == 1);
+    ss << msgpack::noKeyDict;
+    REQUIRE(msgpack::keyDictOf(ss) == nullptr);
+
+    const auto bytes = ss.str();
+    auto r = Reading{1, 1.0, "x"};
+    msgpackDeser(msgpack::Blob{toBytes(bytes), dec}.val, r);
+    REQUIRE(r.sensorId == 0);
+    REQUIRE(r.temperature == 20.0);
+    REQUIRE(r.description.empty());
+  }
+
+  SECTION("Parallel encoding falls back to serial")
+  {
+    auto enc1 = msgpack::KeyDict{};
+    auto enc2 = msgpack::KeyDict{};
+    auto serial = std::ostringstream{};
+    serial << msgpack::keyDict(enc1);
+    msgpackSer(serial, in);
+    auto parallel = std::ostringstream{};
+    parallel << msgpack::keyDict(enc2);
+    msgpackSerParallel(parallel, in, 4);
+    REQUIRE(parallel.str() == serial.str());
+  }
+
+  SECTION("Undefined references")
+  {
+    auto dec = msgpack::KeyDict{};
+    const auto bytes = "\x81\xd4\x6b\x05\x01"s;
+    REQUIRE_THROWS_AS(msgpack::Blob(toBytes(bytes), dec), msgpack::ParsingError);
+    REQUIRE_THROWS_AS(msgpack::Blob(toBytes(bytes)), msgpack::ParsingError);
+  }
+}
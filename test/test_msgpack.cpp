@@ -2,6 +2,7 @@
 #include <catch2/catch.hpp>
 #include <ser/macro.hpp>
 #include <sstream>
+#include <thread>
 
 struct Test
 {
@@ -29,6 +30,76 @@ struct Test3
   std::variant<int, std::string, Test> variant;
 };
 
+// a byte type of the tests' own, so no other translation unit sees a different IsBinElement
+enum class Octet : uint8_t
+{
+};
+
+template <>
+struct msgpack::IsBinElement<Octet> : std::true_type
+{
+};
+
+struct TestBin
+{
+  SER_PROPS(vec, arr, u8, view)
+  std::vector<std::byte> vec;
+  std::array<std::byte, 4> arr;
+  std::vector<Octet> u8;
+  std::span<const std::byte> view;
+};
+
+struct TestBorrowed
+{
+  SER_PROPS(name, tags, attrs)
+  std::string_view name;
+  std::vector<std::string_view> tags;
+  std::map<std::string_view, std::string_view> attrs;
+};
+
+struct TestPoint
+{
+  SER_PROPS(x, y, label)
+  int x;
+  int y;
+  std::string label;
+};
+
+template <>
+struct msgpack::SerAsArray<TestPoint> : std::true_type
+{
+};
+
+struct TestVariants
+{
+  SER_PROPS(list, byName)
+  std::vector<std::variant<int, std::string, Test>> list;
+  std::map<std::string, std::variant<float, std::vector<int>>> byName;
+};
+
+struct TestSparse
+{
+  SER_PROPS(id, name, score, tags, note, nested)
+  int id;
+  std::optional<std::string> name;
+  std::optional<double> score;
+  std::vector<std::string> tags;
+  std::optional<std::string> note;
+  std::optional<Test> nested;
+};
+
+struct TestContainers
+{
+  SER_PROPS(pos, ids, range, row, names, queue, hashes)
+  std::array<float, 3> pos;
+  std::array<Test, 2> ids;
+  std::pair<int, std::string> range;
+  std::tuple<int, double, std::string> row;
+  std::set<std::string> names;
+  std::deque<int> queue;
+  std::unordered_set<int> hashes;
+};
+
 struct TestMismatched
 {
   SER_PROPS(one, two)
@@ -138,4 +209,331 @@ TEST_CASE("Msgpack serialization and deserialization", "[msgpack-ser]")
     TestMismatched test2;
     REQUIRE_THROWS_WITH(msgpackDeser(iss, test2), "Type mismatch. Expected float, got uint64_t");
   }
+
+  SECTION("Binary fields")
+  {
+    const auto raw = std::vector<std::byte>(300, std::byte{0xab});
+    auto test = TestBin{};
+    test.vec = raw;
+    test.arr = {std::byte{1}, std::byte{2}, std::byte{3}, std::byte{4}};
+    test.u8 = {Octet{9}, Octet{8}, Octet{7}};
+    test.view = std::span{raw}.first(5);
+    auto ss = std::ostringstream{};
+    msgpackSer(ss, test);
+    const auto str = ss.str();
+    // fixmap, "vec", bin16 of 300 bytes
+    REQUIRE(str.substr(0, 8) == "\x84\xa3vec\xc5\x01\x2c");
+    REQUIRE(str.size() == 1 + 4 + 3 + 300 + 4 + 2 + 4 + 3 + 2 + 3 + 5 + 2 + 5);
+
+    const auto buf = std::as_bytes(std::span{str});
+    const auto blob = msgpack::Blob{buf};
+    auto test2 = TestBin{};
+    msgpackDeser(blob.val, test2);
+    REQUIRE(test2.vec == test.vec);
+    REQUIRE(test2.arr == test.arr);
+    REQUIRE(test2.u8 == test.u8);
+    REQUIRE(test2.view.size() == 5);
+    REQUIRE(test2.view.data() >= buf.data());
+    REQUIRE(test2.view.data() < buf.data() + buf.size());
+    REQUIRE(test2.view[4] == std::byte{0xab});
+  }
+
+  SECTION("Borrowed strings")
+  {
+    auto test = TestBorrowed{};
+    test.name = "borrowed";
+    test.tags = {"a", "bb", "a string longer than the small string buffer"};
+    test.attrs = {{"k1", "v1"}, {"k2", "v2"}};
+    auto ss = std::ostringstream{};
+    msgpackSer(ss, test);
+
+    const auto str = ss.str();
+    const auto blob = msgpack::Blob{std::as_bytes(std::span{str})};
+    auto test2 = TestBorrowed{};
+    msgpackDeser(blob.val, test2);
+
+    const auto inBuf = [&](std::string_view sv) {
+      return sv.data() >= str.data() && sv.data() + sv.size() <= str.data() + str.size();
+    };
+    REQUIRE(test2.name == test.name);
+    REQUIRE(inBuf(test2.name));
+    REQUIRE(test2.tags == test.tags);
+    for (const auto &t : test2.tags)
+      REQUIRE(inBuf(t));
+    REQUIRE(test2.attrs == test.attrs);
+    for (const auto &[k, v] : test2.attrs)
+    {
+      REQUIRE(inBuf(k));
+      REQUIRE(inBuf(v));
+    }
+  }
+
+  SECTION("Structs as arrays")
+  {
+    auto test = Test3{};
+    test.vec = {1, 2};
+    test.map["a"] = {1, "one"};
+    test.variant = Test{7, "seven"};
+
+    auto asMap = std::ostringstream{};
+    msgpackSer(asMap, test);
+    auto asArray = std::ostringstream{};
+    asArray << msgpack::structAsArray;
+    msgpackSer(asArray, test);
+    REQUIRE(static_cast<uint8_t>(asArray.str()[0]) == 0x93);
+    REQUIRE(asArray.str().size() * 2 < asMap.str().size());
+
+    auto iss = std::istringstream{asArray.str()};
+    auto test2 = Test3{};
+    msgpackDeser(iss, test2);
+    REQUIRE(test2.vec == test.vec);
+    REQUIRE(test2.map["a"].two == "one");
+    REQUIRE(std::get<Test>(test2.variant).two == "seven");
+
+    asArray.str("");
+    asArray << msgpack::structAsMap;
+    msgpackSer(asArray, test);
+    REQUIRE(asArray.str() == asMap.str());
+  }
+
+  SECTION("Struct as array per type")
+  {
+    auto ss = std::ostringstream{};
+    msgpackSer(ss, std::vector<TestPoint>{{1, 2, "a"}, {3, 4, "b"}});
+    REQUIRE(ss.str() == "\x92\x93\x01\x02\xa1" "a" "\x93\x03\x04\xa1" "b");
+
+    auto iss = std::istringstream{ss.str()};
+    auto points = std::vector<TestPoint>{};
+    msgpackDeser(iss, points);
+    REQUIRE(points.size() == 2);
+    REQUIRE(points[1].y == 4);
+    REQUIRE(points[1].label == "b");
+  }
+
+  SECTION("Field names")
+  {
+    auto ss = std::ostringstream{};
+    msgpackSer(ss, Test{1, "x"});
+    msgpackSer(ss, Test{2, "y"});
+    REQUIRE(ss.str() == "\x82\xa3one\x01\xa3two\xa1x\x82\xa3one\x02\xa3two\xa1y");
+
+    ss.str("");
+    auto test = Test3{};
+    test.variant = 5;
+    msgpackSer(ss, test);
+    using namespace std::string_literals;
+    REQUIRE(ss.str() == "\x83\xa3vec\x90\xa3map\x80\xa7variant\x92\x00\x05"s);
+  }
+
+  SECTION("Variants in containers")
+  {
+    auto test = TestVariants{};
+    test.list = {1, "two", Test{3, "three"}, 4};
+    test.byName["f"] = 1.5f;
+    test.byName["v"] = std::vector<int>{1, 2};
+    auto ss = std::ostringstream{};
+    msgpackSer(ss, test);
+
+    auto iss = std::istringstream{ss.str()};
+    auto test2 = TestVariants{};
+    msgpackDeser(iss, test2);
+    REQUIRE(test2.list.size() == 4);
+    REQUIRE(std::get<int>(test2.list[0]) == 1);
+    REQUIRE(std::get<std::string>(test2.list[1]) == "two");
+    REQUIRE(std::get<Test>(test2.list[2]).two == "three");
+    REQUIRE(std::get<int>(test2.list[3]) == 4);
+    REQUIRE(std::get<float>(test2.byName["f"]) == 1.5f);
+    REQUIRE(std::get<std::vector<int>>(test2.byName["v"]) == std::vector<int>{1, 2});
+
+    const auto bad = std::string{"\x92\x05\x01"};
+    auto v = std::variant<int, std::string>{};
+    const auto blob = msgpack::Blob{std::as_bytes(std::span{bad})};
+    REQUIRE_THROWS_WITH(msgpackDeser(blob.val, v), "Variant index 5 out of range");
+  }
+
+  SECTION("Optional fields")
+  {
+    auto test = TestSparse{};
+    test.id = 3;
+    test.score = 0.5;
+    test.nested = Test{1, "n"};
+    auto ss = std::ostringstream{};
+    msgpackSer(ss, test);
+
+    auto iss = std::istringstream{ss.str()};
+    auto test2 = TestSparse{};
+    test2.name = "stale";
+    msgpackDeser(iss, test2);
+    REQUIRE(test2.id == 3);
+    REQUIRE(!test2.name);
+    REQUIRE(test2.score == 0.5);
+    REQUIRE(test2.nested->two == "n");
+  }
+
+  SECTION("Omitting default fields")
+  {
+    auto test = TestSparse{};
+    test.id = 0;
+    test.note = "only this";
+    auto full = std::ostringstream{};
+    msgpackSer(full, test);
+    auto sparse = std::ostringstream{};
+    sparse << msgpack::omitDefaults;
+    msgpackSer(sparse, test);
+    REQUIRE(sparse.str() == "\x81\xa4note\xa9only this");
+    REQUIRE(sparse.str().size() < full.str().size() / 2);
+
+    auto iss = std::istringstream{sparse.str()};
+    auto test2 = TestSparse{};
+    test2.id = 42;
+    test2.tags = {"stale"};
+    test2.score = 1.0;
+    msgpackDeser(iss, test2);
+    REQUIRE(test2.id == 0);
+    REQUIRE(test2.tags.empty());
+    REQUIRE(!test2.score);
+    REQUIRE(test2.note == "only this");
+
+    // negative zero is not the default
+    auto zeros = Test2{};
+    zeros.e = -0.0f;
+    zeros.f = 0.0;
+    auto zss = std::ostringstream{};
+    zss << msgpack::omitDefaults;
+    msgpackSer(zss, zeros);
+    REQUIRE(zss.str() == std::string("\x81\xa1" "e\xca\x80\x00\x00\x00", 8));
+  }
+
+  SECTION("Key-based decoding")
+  {
+    // { "two": "b", "one": 1 }, fields out of declaration order
+    auto iss = std::istringstream{"\x82\xa3two\xa1" "b" "\xa3one\x01"};
+    auto test = Test{};
+    msgpackDeser(iss, test);
+    REQUIRE(test.one == 1);
+    REQUIRE(test.two == "b");
+  }
+
+  SECTION("Fixed-size and tuple-like containers")
+  {
+    auto test = TestContainers{};
+    test.pos = {1.f, 2.f, 3.f};
+    test.ids = {Test{1, "a"}, Test{2, "b"}};
+    test.range = {5, "five"};
+    test.row = {1, 2.5, "row"};
+    test.names = {"x", "y", "z"};
+    test.queue = {3, 2, 1};
+    test.hashes = {10, 20};
+    auto ss = std::ostringstream{};
+    msgpackSer(ss, test);
+
+    auto iss = std::istringstream{ss.str()};
+    auto test2 = TestContainers{};
+    test2.queue = {9, 9, 9, 9, 9};
+    msgpackDeser(iss, test2);
+    REQUIRE(test2.pos == test.pos);
+    REQUIRE(test2.ids[1].two == "b");
+    REQUIRE(test2.range == test.range);
+    REQUIRE(test2.row == test.row);
+    REQUIRE(test2.names == test.names);
+    REQUIRE(test2.queue == test.queue);
+    REQUIRE(test2.hashes == test.hashes);
+
+    ss.str("");
+    msgpackSer(ss, std::array<int, 20>{});
+    REQUIRE(ss.str().substr(0, 3) == std::string{"\xdc\x00\x14", 3});
+
+    const auto wrongSize = std::string{"\x92\x01\x02"};
+    const auto blob = msgpack::Blob{std::as_bytes(std::span{wrongSize})};
+    auto arr = std::array<int, 3>{};
+    REQUIRE_THROWS_WITH(msgpackDeser(blob.val, arr), "Size mismatch. Expected Array of 3 elements, got 2");
+  }
+
+  SECTION("Decoding into an existing object reuses its storage")
+  {
+    auto test = Test3{};
+    test.vec = {1, 2, 3};
+    test.map["first"] = {1, "a string longer than the small string buffer"};
+    test.map["second"] = {2, "two"};
+    auto ss = std::ostringstream{};
+    msgpackSer(ss, test);
+    const auto str = ss.str();
+    const auto blob = msgpack::Blob{std::as_bytes(std::span{str})};
+
+    auto test2 = Test3{};
+    test2.map["stale"] = {};
+    msgpackDeser(blob.val, test2);
+    REQUIRE(test2.map.size() == 2);
+    REQUIRE(test2.map.count("stale") == 0);
+    const auto *vecData = test2.vec.data();
+    const auto *first = &test2.map["first"];
+    const auto *firstData = first->two.data();
+
+    msgpackDeser(blob.val, test2);
+    REQUIRE(test2.vec.data() == vecData);
+    REQUIRE(&test2.map["first"] == first);
+    REQUIRE(test2.map["first"].two.data() == firstData);
+    REQUIRE(test2.map["first"].two == test.map["first"].two);
+
+    // {"a": 1, "a": 2, "b": 3} into {a, b, c}: c is erased although the sizes match
+    const auto dup = std::string{"\x83\xa1" "a\x01\xa1" "a\x02\xa1" "b\x03"};
+    auto m = std::map<std::string, int>{{"a", 0}, {"b", 0}, {"c", 0}};
+    msgpackDeser(msgpack::Blob{std::as_bytes(std::span{dup})}.val, m);
+    REQUIRE(m == std::map<std::string, int>{{"a", 2}, {"b", 3}});
+    auto n = std::unordered_map<int, std::map<std::string, int>>{{1, {{"c", 0}}}, {2, {}}};
+    const auto nested = std::string{"\x82\x01\x82\xa1" "a\x01\xa1" "a\x02\x01\x80"};
+    msgpackDeser(msgpack::Blob{std::as_bytes(std::span{nested})}.val, n);
+    REQUIRE(n.size() == 1);
+    REQUIRE(n[1].size() == 0);
+  }
+
+  SECTION("Heterogeneous lookup in maps with transparent comparators")
+  {
+    auto m = std::map<std::string, int, std::less<>>{{"a", 1}, {"b", 2}};
+    auto ss = std::ostringstream{};
+    msgpackSer(ss, m);
+    const auto str = ss.str();
+    const auto blob = msgpack::Blob{std::as_bytes(std::span{str})};
+    auto m2 = std::map<std::string, int, std::less<>>{{"b", 0}, {"c", 3}};
+    msgpackDeser(blob.val, m2);
+    REQUIRE(m2 == m);
+  }
+
+  SECTION("Shared buffers")
+  {
+    auto test = TestBorrowed{};
+    test.name = "shared";
+    test.tags = {"a", "a string longer than the small string buffer"};
+    test.attrs = {{"k1", "v1"}};
+    auto ss = std::ostringstream{};
+    msgpackSer(ss, std::vector<TestBorrowed>{test, test});
+
+    auto copy = std::optional<msgpack::Blob>{};
+    auto sub = msgpack::Slice{};
+    auto name = msgpack::Slice{};
+    {
+      auto in = std::istringstream{ss.str()};
+      const auto blob = msgpack::Blob{in};
+      copy = blob;
+      const auto &second = std::get<msgpack::Array>(blob.val)[1];
+      sub = blob.subtree(second);
+      name = blob.slice(std::get<std::string_view>(std::get<msgpack::Map>(second)[0].second));
+      REQUIRE(blob.subtree(blob.val).size() == ss.str().size());
+      REQUIRE_THROWS_AS(blob.subtree(copy->val), std::out_of_range);
+    }
+    REQUIRE(name.str() == "shared");
+    REQUIRE(sub.owned());
+
+    auto fromCopy = std::vector<TestBorrowed>{};
+    msgpackDeser(copy->val, fromCopy);
+    REQUIRE(fromCopy[1].tags == test.tags);
+
+    auto test2 = TestBorrowed{};
+    std::thread([&, s = std::move(sub)]() { msgpackDeser(msgpack::Blob{s}.val, test2); }).join();
+    REQUIRE(test2.name == test.name);
+    REQUIRE(test2.attrs == test.attrs);
+
+    REQUIRE_THROWS_AS(name.sub(std::string_view{"shared"}), std::out_of_range);
+    REQUIRE(name.sub(name.str().substr(1, 3)).str() == "har");
+  }
 }
@@ -0,0 +1,133 @@
+#include "../msgpack-parallel.hpp"
+#include <catch2/catch.hpp>
+#include <ser/macro.hpp>
+#include <sstream>
+
+using namespace std::string_literals;
+
+namespace
+{
+  struct Record
+  {
+    SER_PROPS(id, name, values)
+    int id;
+    std::string name;
+    std::vector<double> values;
+  };
+
+  auto makeRecords(int n) -> std::vector<Record>
+  {
+    auto r = std::vector<Record>{};
+    for (int i = 0; i < n; ++i)
+      r.push_back(Record{i, "record " + std::to_string(i), std::vector<double>(i % 7, i * 0.5)});
+    return r;
+  }
+} // namespace
+
+TEST_CASE("Parallel decode of a top-level array", "[msgpack-parallel]")
+{
+  const auto records = makeRecords(20000);
+  auto ss = std::ostringstream{};
+  msgpackSer(ss, records);
+  const auto str = ss.str();
+  const auto buf = std::as_bytes(std::span{str});
+
+  SECTION("Element boundaries")
+  {
+    const auto elems = msgpack::arrayElements(buf);
+    REQUIRE(elems.size() == records.size());
+    REQUIRE(elems.front().data() == buf.data() + 3);
+    REQUIRE(elems.back().data() + elems.back().size() == buf.data() + buf.size());
+  }
+
+  SECTION("Into Val")
+  {
+    const auto arr = msgpack::parallelParse(buf, 4);
+    const auto blob = msgpack::Blob{buf};
+    const auto &seq = std::get<msgpack::Array>(blob.val);
+    REQUIRE(arr.size() == seq.size());
+    for (size_t i = 0; i < arr.size(); i += 997)
+    {
+      const auto &m = std::get<msgpack::Map>(arr[i]);
+      REQUIRE(std::get<std::string_view>(m[1].second) ==
+              std::get<std::string_view>(std::get<msgpack::Map>(seq[i])[1].second));
+    }
+  }
+
+  SECTION("Into typed vector")
+  {
+    auto out = std::vector<Record>{};
+    msgpackDeserParallel(buf, out, 8);
+    REQUIRE(out.size() == records.size());
+    for (size_t i = 0; i < out.size(); ++i)
+    {
+      REQUIRE(out[i].id == records[i].id);
+      REQUIRE(out[i].name == records[i].name);
+      REQUIRE(out[i].values == records[i].values);
+    }
+  }
+
+  SECTION("Errors are propagated")
+  {
+    auto bad = str;
+    bad.resize(bad.size() - 1);
+    REQUIRE_THROWS_AS(msgpack::parallelParse(std::as_bytes(std::span{bad}), 4), msgpack::ParsingError);
+    auto out = std::vector<int>{};
+    REQUIRE_THROWS_AS(msgpackDeserParallel(buf, out, 4), msgpack::ParsingError);
+
+    const auto parse = [](const std::string &bytes) {
+      return msgpack::parallelParse(std::as_bytes(std::span{bytes}), 4);
+    };
+    REQUIRE_THROWS_WITH(parse("\xdc\x00"s), "Unexpected EOF");
+    REQUIRE_THROWS_WITH(parse("\xdd\x00\x00\x01"s), "Unexpected EOF");
+    REQUIRE_THROWS_WITH(parse("\x81\x01\x02"), "Expected a top-level array");
+    REQUIRE_THROWS_AS(parse("\x91\x01\x02"), msgpack::ParsingError);
+    REQUIRE_THROWS_WITH(parse("\x91\x01\x02"), "Extra bytes after top-level object");
+  }
+}
+
+TEST_CASE("Parallel serialization", "[msgpack-parallel]")
+{
+  SECTION("Vector of structs")
+  {
+    const auto records = makeRecords(20000);
+    auto seq = std::ostringstream{};
+    msgpackSer(seq, records);
+    auto par = std::ostringstream{};
+    msgpackSerParallel(par, records, 4);
+    REQUIRE(par.str() == seq.str());
+  }
+
+  SECTION("Vector of maps")
+  {
+    auto maps = std::vector<std::map<std::string, int>>(5000);
+    for (size_t i = 0; i < maps.size(); ++i)
+      maps[i] = {{"a", static_cast<int>(i)}, {"b", -static_cast<int>(i)}};
+    auto seq = std::ostringstream{};
+    msgpackSer(seq, maps);
+    auto par = std::ostringstream{};
+    msgpackSerParallel(par, maps, 3);
+    REQUIRE(par.str() == seq.str());
+  }
+
+  SECTION("Map")
+  {
+    auto map = std::map<int, std::string>{};
+    for (int i = 0; i < 70000; ++i)
+      map[i * 3] = std::to_string(i);
+    auto seq = std::ostringstream{};
+    msgpackSer(seq, map);
+    auto par = std::ostringstream{};
+    msgpackSerParallel(par, map, 4);
+    REQUIRE(par.str() == seq.str());
+  }
+
+  SECTION("Small input")
+  {
+    auto seq = std::ostringstream{};
+    msgpackSer(seq, std::vector<int>{1, 2, 3});
+    auto par = std::ostringstream{};
+    msgpackSerParallel(par, std::vector<int>{1, 2, 3});
+    REQUIRE(par.str() == seq.str());
+  }
+}
@@ -0,0 +1,106 @@
+#include "../msgpack-record.hpp"
+#include <atomic>
+#include <catch2/catch.hpp>
+#include <filesystem>
+#include <ser/macro.hpp>
+#include <unistd.h>
+
+namespace
+{
+  struct Event
+  {
+    SER_PROPS(seq, kind, payload)
+    uint64_t seq;
+    std::string kind;
+    std::vector<int> payload;
+  };
+
+  auto makeEvent(uint64_t i) -> Event
+  {
+    return Event{i, i % 3 == 0 ? "start" : "stop", std::vector<int>(i % 5, static_cast<int>(i))};
+  }
+
+  // A per-process temporary file, removed when the test leaves, even by a failed REQUIRE.
+  struct TempFile
+  {
+    TempFile()
+      : path((std::filesystem::temp_directory_path() /
+              ("msgpack-record-test-" + std::to_string(getpid()) + ".bin"))
+               .string())
+    {
+    }
+    TempFile(const TempFile &) = delete;
+    auto operator=(const TempFile &) -> TempFile & = delete;
+    ~TempFile()
+    {
+      auto ec = std::error_code{};
+      std::filesystem::remove(path, ec);
+    }
+
+    std::string path;
+  };
+} // namespace
+
+TEST_CASE("Indexed record file", "[msgpack-record]")
+{
+  const auto file = TempFile{};
+  const auto &path = file.path;
+  const auto n = uint64_t{1000};
+  const auto stride = GENERATE(size_t{1}, size_t{16});
+  {
+    auto w = msgpack::RecordWriter{path, stride};
+    for (uint64_t i = 0; i < n; ++i)
+      w.write(makeEvent(i));
+  }
+
+  auto r = msgpack::RecordReader{path};
+  REQUIRE(r.size() == n);
+
+  SECTION("Random access")
+  {
+    for (const auto i : {uint64_t{0}, uint64_t{1}, uint64_t{15}, uint64_t{16}, uint64_t{517}, n - 1})
+    {
+      auto e = Event{};
+      r.read(i, e);
+      const auto expected = makeEvent(i);
+      REQUIRE(e.seq == expected.seq);
+      REQUIRE(e.kind == expected.kind);
+      REQUIRE(e.payload == expected.payload);
+    }
+    REQUIRE_THROWS_AS(r.record(n), std::out_of_range);
+  }
+
+  SECTION("Parallel range scan")
+  {
+    auto sum = std::atomic<uint64_t>{0};
+    auto visited = std::atomic<uint64_t>{0};
+    auto mismatched = std::atomic<uint64_t>{0};
+    r.scan(
+      100,
+      900,
+      [&](size_t i, std::span<const std::byte> bytes) {
+        auto e = Event{};
+        msgpackDeser(msgpack::Blob{bytes}.val, e);
+        if (e.seq != i)
+          ++mismatched;
+        sum += e.seq;
+        ++visited;
+      },
+      4);
+    REQUIRE(mismatched == 0);
+    REQUIRE(visited == 800);
+    REQUIRE(sum == (100 + 899) * 800 / 2);
+  }
+
+  SECTION("Records stay plain msgpack")
+  {
+    auto f = std::ifstream{path, std::ios::binary};
+    const auto str = std::string{std::istreambuf_iterator<char>{f}, {}};
+    auto cur = std::as_bytes(std::span{str});
+    auto objects = size_t{0};
+    for (; !cur.empty(); ++objects)
+      cur = msgpack::skip(cur);
+    // records, index map, index offset
+    REQUIRE(objects == n + 2);
+  }
+}
@@ -0,0 +1,147 @@
+#include "../msgpack-ring.hpp"
+#include <catch2/catch.hpp>
+#include <ser/macro.hpp>
+#include <thread>
+#include <unistd.h>
+
+struct Tick
+{
+  SER_PROPS(seq, symbol, levels)
+  uint32_t seq;
+  std::string symbol;
+  std::vector<double> levels;
+};
+
+// Counts how often it is serialized.
+struct Bulky
+{
+  template <typename Arch>
+  auto ser(Arch &arch) const -> void
+  {
+    ++*writes;
+    arch("text", text);
+  }
+  std::string text;
+  int *writes;
+};
+
+namespace
+{
+  auto ringName() -> std::string
+  {
+    return "/msgpack-test-" + std::to_string(getpid());
+  }
+
+  auto makeTick(uint32_t i) -> Tick
+  {
+    return Tick{i, std::string(i % 50, 's'), std::vector<double>(i % 13, i * 0.5)};
+  }
+} // namespace
+
+TEST_CASE("Shared memory ring", "[msgpack-ring]")
+{
+  const auto name = ringName();
+
+  SECTION("Messages are parsed in place")
+  {
+    auto out = msgpack::Ring::create(name, 1000);
+    auto in = msgpack::Ring::open(name);
+    msgpack::Ring::unlink(name);
+    REQUIRE(in.tryFront().empty());
+    REQUIRE_THROWS_AS(in.pop(), std::logic_error);
+
+    out.push(makeTick(7));
+    out.push(std::string{"next"});
+    const auto msg = in.front();
+    auto q = Tick{};
+    msgpackDeser(msgpack::Blob{msg}.val, q);
+    REQUIRE(q.seq == 7);
+    REQUIRE(q.symbol == "sssssss");
+    REQUIRE(q.levels == std::vector<double>(7, 3.5));
+    REQUIRE(reinterpret_cast<uintptr_t>(msg.data()) % 8 == 0);
+    in.pop();
+    REQUIRE(in.front().size() == 5);
+    in.pop();
+    REQUIRE(in.tryFront().empty());
+  }
+
+  SECTION("Full rings and wraparound")
+  {
+    auto out = msgpack::Ring::create(name, 256);
+    auto in = msgpack::Ring::open(name);
+    msgpack::Ring::unlink(name);
+    REQUIRE_THROWS_AS(out.push(std::string(300, 'x')), std::length_error);
+
+    // 99-byte messages take 112 bytes: two fit, and the third wraps around once one is popped
+    const auto s = [](char c) { return std::string(97, c); };
+    REQUIRE(out.tryPush(s('a')));
+    REQUIRE(out.tryPush(s('b')));
+    REQUIRE(!out.tryPush(s('c')));
+    in.pop();
+    REQUIRE(out.tryPush(s('c')));
+    REQUIRE(in.front().back() == std::byte{'b'});
+    in.pop();
+    REQUIRE(in.front().back() == std::byte{'c'});
+    in.pop();
+    REQUIRE(in.tryFront().empty());
+  }
+
+  SECTION("Large messages wait for enough room")
+  {
+    auto out = msgpack::Ring::create(name, 256);
+    auto in = msgpack::Ring::open(name);
+    msgpack::Ring::unlink(name);
+    for (auto i = 0; i < 7; ++i)
+      out.push(std::string(20, 'a'));
+    auto writes = 0;
+    out.push(Bulky{"", &writes}); // field names are encoded on first use
+    in.pop();
+    writes = 0;
+    // needs 5 of the 6 small messages left popped; it is serialized in place and once more
+    auto producer = std::thread{[&] { out.push(Bulky{std::string(150, 'b'), &writes}); }};
+    for (auto i = 0; i < 6; ++i)
+    {
+      REQUIRE(in.front().size() == 21);
+      in.pop();
+      std::this_thread::sleep_for(std::chrono::milliseconds{1});
+    }
+    REQUIRE(in.front().size() == 7);
+    in.pop();
+    REQUIRE(in.front().size() > 150);
+    producer.join();
+    REQUIRE(writes == 2);
+  }
+
+  SECTION("Producer and consumer threads")
+  {
+    auto out = msgpack::Ring::create(name, 4096);
+    auto in = msgpack::Ring::open(name);
+    msgpack::Ring::unlink(name);
+    constexpr auto N = uint32_t{100000};
+    auto producer = std::thread{[&] {
+      for (auto i = uint32_t{0}; i < N; ++i)
+        out.push(makeTick(i));
+    }};
+    auto ok = true;
+    for (auto i = uint32_t{0}; i < N; ++i)
+    {
+      auto q = Tick{};
+      msgpackDeser(msgpack::Blob{in.front()}.val, q);
+      in.pop();
+      const auto expected = makeTick(i);
+      ok = ok && q.seq == i && q.symbol == expected.symbol && q.levels == expected.levels;
+    }
+    producer.join();
+    REQUIRE(ok);
+    REQUIRE(in.tryFront().empty());
+  }
+
+  SECTION("Errors")
+  {
+    REQUIRE_THROWS_AS(msgpack::Ring::open(name), std::system_error);
+    REQUIRE_THROWS_AS(msgpack::Ring::create(name, 0), std::invalid_argument);
+    auto r = msgpack::Ring::create(name, 64);
+    REQUIRE_THROWS_AS(msgpack::Ring::create(name, 64), std::system_error);
+    msgpack::Ring::unlink(name);
+  }
+}
@@ -0,0 +1,152 @@
+#include "../msgpack-sax.hpp"
+#include "../msgpack-ser.hpp"
+#include "helpers.hpp"
+#include <catch2/catch.hpp>
+#include <ser/macro.hpp>
+#include <sstream>
+
+struct Trade
+{
+  SER_PROPS(id, qty, venue, fills)
+  int id;
+  int qty;
+  std::string venue;
+  std::vector<double> fills;
+};
+
+namespace
+{
+  // Every event, as text.
+  struct Trace
+  {
+    auto onNil() -> void { out += "nil "; }
+    auto onBool(bool v) -> void { out += v ? "true " : "false "; }
+    auto onInt(int64_t v) -> void { out += "i" + std::to_string(v) + " "; }
+    auto onUInt(uint64_t v) -> void { out += "u" + std::to_string(v) + " "; }
+    auto onFloat(double v) -> void { out += "f" + std::to_string(v) + " "; }
+    auto onStr(std::string_view v) -> void { out += "'" + std::string{v} + "' "; }
+    auto onBin(std::span<const std::byte> v) -> void
+    {
+      out += "bin" + std::to_string(v.size()) + " ";
+    }
+    auto onExt(int8_t type, std::span<const std::byte> v) -> void
+    {
+      out += "ext" + std::to_string(type) + ":" + std::to_string(v.size()) + " ";
+    }
+    auto onArrayBegin(size_t n) -> void { out += "[" + std::to_string(n) + " "; }
+    auto onArrayEnd() -> void { out += "] "; }
+    auto onMapBegin(size_t n) -> void { out += "{" + std::to_string(n) + " "; }
+    auto onMapEnd() -> void { out += "} "; }
+    std::string out;
+  };
+
+  // Sums the qty of every trade, skipping the other fields.
+  struct QtySum
+  {
+    auto onKey(std::string_view k) -> bool
+    {
+      inQty = k == "qty";
+      return inQty;
+    }
+    auto onInt(int64_t v) -> void
+    {
+      if (inQty)
+        sum += v;
+    }
+    auto onArrayBegin(size_t) -> bool { return depth++ == 0; }
+    bool inQty = false;
+    int depth = 0;
+    int64_t sum = 0;
+  };
+} // namespace
+
+using namespace std::string_literals;
+
+TEST_CASE("SAX visitor", "[msgpack-sax]")
+{
+  SECTION("Events")
+  {
+    const auto s = "\x93\xc0\xc3\x82\xa1k\xcd\x01\x00\xc4\x02xy\x92\xff\xca\x3f\xc0\x00\x00"s +
+                   "\xd3\xff\xff\xff\xff\xff\xff\xff\xfe\xd6\x05\x01\x02\x03\x04\x90\x80"s;
+    auto t = Trace{};
+    const auto rest = msgpack::sax(toBytes(s), t);
+    REQUIRE(t.out ==
+            "[3 nil true {2 'k' u256 bin2 [2 i-1 f1.500000 ] } ] ");
+    REQUIRE(rest.size() == 17);
+    t.out.clear();
+    auto r = rest;
+    for (auto i = 0; i < 4; ++i)
+      r = msgpack::sax(r, t);
+    REQUIRE(r.empty());
+    REQUIRE(t.out == "i-2 ext5:4 [0 ] {0 } ");
+
+    // handlers that are left out drop their events
+    struct Strings
+    {
+      auto onStr(std::string_view v) -> void { out += v; }
+      std::string out;
+    } strings;
+    msgpack::sax(toBytes(encode(std::map<std::string, std::vector<std::string>>{
+                   {"a", {"b", "c"}}, {"d", {}}})),
+                 strings);
+    REQUIRE(strings.out == "abcd");
+  }
+
+  SECTION("Skipping subtrees")
+  {
+    auto trades = std::vector<Trade>{};
+    auto expected = int64_t{0};
+    for (auto i = 0; i < 1000; ++i)
+    {
+      trades.push_back(Trade{i, i % 7 - 3, "v" + std::to_string(i), {1.0, 2.0}});
+      expected += i % 7 - 3;
+    }
+    const auto s = encode(trades);
+    auto q = QtySum{};
+    REQUIRE(msgpack::sax(toBytes(s), q).empty());
+    REQUIRE(q.sum == expected);
+
+    // a visitor that skips everything sees only the outermost begin
+    struct SkipAll
+    {
+      auto onArrayBegin(size_t) -> bool
+      {
+        ++n;
+        return false;
+      }
+      auto onArrayEnd() -> void { ++n; }
+      int n = 0;
+    } none;
+    REQUIRE(msgpack::sax(toBytes(s + "\x01"), none).size() == 1);
+    REQUIRE(none.n == 1);
+  }
+
+  SECTION("Malformed input")
+  {
+    const auto s = encode(std::vector<Trade>{{1, 2, "x", {3.0}}});
+    for (size_t n = 0; n < s.size(); ++n)
+    {
+      auto t = Trace{};
+      REQUIRE_THROWS_AS(msgpack::sax(toBytes(s).first(n), t), msgpack::ParsingError);
+      auto q = QtySum{};
+      REQUIRE_THROWS_AS(msgpack::sax(toBytes(s).first(n), q), msgpack::ParsingError);
+    }
+    auto t = Trace{};
+    REQUIRE_THROWS_AS(msgpack::sax(toBytes("\x91\xc1"s), t), msgpack::ParsingError);
+    REQUIRE_THROWS_AS(msgpack::sax(toBytes("\xdd\xff\xff\xff\xff"s), t),
+                      msgpack::ParsingError);
+
+    // nesting is limited by memory, not by the call stack
+    auto deep = std::string(100000, '\x91') + '\x01';
+    struct Depth
+    {
+      auto onArrayBegin(size_t) -> void { max = std::max(max, ++cur); }
+      auto onArrayEnd() -> void { --cur; }
+      int cur = 0;
+      int max = 0;
+    } d;
+    msgpack::sax(toBytes(deep), d);
+    REQUIRE(d.max == 100000);
+    REQUIRE(d.cur == 0);
+  }
+}
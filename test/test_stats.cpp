@@ -0,0 +1,41 @@
+#include "../msgpack-ser.hpp"
+#include "../msgpack-stats.hpp"
+#include "helpers.hpp"
+#include <catch2/catch.hpp>
+#include <ser/macro.hpp>
+#include <sstream>
+
+struct Event
+{
+  SER_PROPS(a, b)
+  std::vector<int> a;
+  std::string b;
+};
+
+// Counting is tested by the stats/ test binary, which is built with MSGPACK_STATS.
+TEST_CASE("Stats", "[msgpack-stats]")
+{
+  // {"a": [1, 2, 3], "b": "x"}
+  const auto msg = std::string{"\x82\xa1" "a\x93\x01\x02\x03\xa1" "b\xa1x"};
+
+  SECTION("Hooks compile to nothing without MSGPACK_STATS")
+  {
+    static_assert(std::is_empty_v<msgpack::StatsTimer>);
+    auto s = msgpack::Stats{};
+    {
+      auto scope = msgpack::StatsScope{s};
+      REQUIRE(msgpack::StatsScope::current() == &scope);
+      const auto blob = msgpack::Blob{toBytes(msg)};
+      auto e = Event{};
+      msgpackDeser(blob.val, e);
+      auto ss = std::ostringstream{};
+      msgpackSer(ss, e);
+      REQUIRE(ss.str() == msg);
+    }
+    REQUIRE(s.bytes == 0);
+    REQUIRE(s.count(msgpack::NodeType::Map) == 0);
+    REQUIRE(s.growths == 0);
+    REQUIRE(s.elapsed.count() == 0);
+    REQUIRE(msgpack::StatsScope::current() == nullptr);
+  }
+}
@@ -0,0 +1,209 @@
+#include "../msgpack-try.hpp"
+#include "helpers.hpp"
+#include <catch2/catch.hpp>
+#include <ser/macro.hpp>
+#include <sstream>
+
+struct Item
+{
+  SER_PROPS(id, name, price, tags)
+  int id;
+  std::string_view name;
+  double price;
+  std::vector<std::string_view> tags;
+};
+
+struct Order
+{
+  SER_PROPS(customer, items, extra, choice, hash)
+  std::string customer;
+  std::vector<Item> items;
+  std::map<std::string, std::optional<int>> extra;
+  std::variant<int, std::string_view> choice;
+  std::array<std::byte, 4> hash;
+};
+
+// Decoding rejects lo > hi, which the message check cannot see.
+struct Bounds
+{
+  template <typename Arch>
+  auto ser(Arch &arch) const -> void
+  {
+    arch("lo", lo);
+    arch("hi", hi);
+  }
+  template <typename Arch>
+  auto deser(Arch &arch) -> void
+  {
+    arch("lo", lo);
+    arch("hi", hi);
+    if (lo > hi)
+      throw msgpack::ParsingError{"Bounds: lo > hi"};
+  }
+  int lo;
+  int hi;
+};
+
+template <>
+struct msgpack::ValidatingDeser<Bounds> : std::true_type
+{
+};
+
+// A deser() that rejects even the default object the check visits.
+struct Unusable
+{
+  template <typename Arch>
+  auto ser(Arch &arch) const -> void
+  {
+    arch("x", x);
+  }
+  template <typename Arch>
+  auto deser(Arch &arch) -> void
+  {
+    arch("x", x);
+    throw std::runtime_error{"Unusable"};
+  }
+  int x;
+};
+
+namespace
+{
+  auto makeOrder() -> Order
+  {
+    auto o = Order{};
+    o.customer = "ann";
+    o.items = {Item{1, "pen", 1.5, {"office"}}, Item{2, "ink", 2.25, {"office", "refill"}}};
+    o.extra = {{"gift", 1}, {"note", std::nullopt}};
+    o.choice = std::string_view{"fast"};
+    o.hash = {std::byte{1}, std::byte{2}, std::byte{3}, std::byte{4}};
+    return o;
+  }
+} // namespace
+
+using namespace std::string_literals;
+
+TEST_CASE("Non-throwing decoding", "[msgpack-try]")
+{
+  const auto bytes = encode(makeOrder());
+
+  SECTION("Valid messages decode like msgpackDeser")
+  {
+    auto o = Order{};
+    const auto r = msgpackTryDeser(toBytes(bytes), o);
+    REQUIRE(r);
+    REQUIRE(o.customer == "ann");
+    REQUIRE(o.items.size() == 2);
+    REQUIRE(o.items[1].tags[1] == "refill");
+    REQUIRE(o.extra.at("gift") == 1);
+    REQUIRE(std::get<std::string_view>(o.choice) == "fast");
+    REQUIRE(o.hash[3] == std::byte{4});
+
+    const auto blob = msgpack::tryParse(toBytes(bytes));
+    REQUIRE(blob.hasValue());
+    REQUIRE(std::holds_alternative<msgpack::Map>(blob->val));
+  }
+
+  SECTION("Every truncation is reported")
+  {
+    for (size_t n = 0; n < bytes.size(); ++n)
+    {
+      const auto part = toBytes(bytes).first(n);
+      auto o = Order{};
+      const auto r = msgpackTryDeser(part, o);
+      REQUIRE(!r);
+      REQUIRE(r.error().code() == msgpack::Errc::UnexpectedEof);
+      REQUIRE(r.error().offset() <= n);
+      REQUIRE(o.customer.empty());
+      REQUIRE(!msgpack::tryParse(part));
+      REQUIRE_THROWS_AS(msgpack::Blob{part}, msgpack::ParsingError);
+    }
+  }
+
+  SECTION("Type mismatches have an offset and a path")
+  {
+    auto bad = makeOrder();
+    auto s = encode(bad);
+    // price of the second item as a string
+    const auto at = s.find("price", s.find("ink")) + 5;
+    s.replace(at, 9, "\xa3" "two"s);
+    auto o = Order{};
+    const auto r = msgpackTryDeser(toBytes(s), o);
+    REQUIRE(!r);
+    REQUIRE(r.error().code() == msgpack::Errc::TypeMismatch);
+    REQUIRE(r.error().offset() == at);
+    REQUIRE(r.error().pathString() == "$.items[1].price");
+    REQUIRE(r.error().path()[0].key == "price");
+    REQUIRE_THROWS_WITH(r.value(), "Type mismatch at offset " + std::to_string(at) +
+                                     " in $.items[1].price");
+    REQUIRE_THROWS_AS(msgpackDeser(msgpack::Blob{toBytes(s)}.val, o), msgpack::ParsingError);
+  }
+
+  SECTION("Sizes, variants and extra bytes")
+  {
+    auto v = std::tuple<int, int>{};
+    auto r = msgpackTryDeser(toBytes("\x93\x01\x02\x03"s), v);
+    REQUIRE(r.error().code() == msgpack::Errc::SizeMismatch);
+
+    auto var = std::variant<int, bool>{};
+    r = msgpackTryDeser(toBytes("\x92\x05\x01"s), var);
+    REQUIRE(r.error().code() == msgpack::Errc::OutOfRange);
+    REQUIRE(r.error().pathString() == "$[0]");
+    REQUIRE(msgpackTryDeser(toBytes("\x92\x01\xc3"s), var));
+    REQUIRE(std::get<bool>(var));
+
+    auto i = 0;
+    r = msgpackTryDeser(toBytes("\x01\x02"s), i);
+    REQUIRE(r.error().code() == msgpack::Errc::ExtraBytes);
+    REQUIRE(r.error().offset() == 1);
+    r = msgpackTryDeser(toBytes("\xc1"s), i);
+    REQUIRE(r.error().code() == msgpack::Errc::UnknownType);
+
+    auto d = 0.0;
+    REQUIRE(msgpackTryDeser(toBytes("\xca\x3f\xc0\x00\x00"s), d));
+    REQUIRE(d == 1.5);
+  }
+
+  SECTION("Decoder errors leave the value unchanged")
+  {
+    auto v = std::vector<Bounds>{{1, 2}};
+    const auto r = msgpackTryDeser(toBytes(encode(std::vector<Bounds>{{3, 4}, {5, 0}})), v);
+    REQUIRE(r.error().code() == msgpack::Errc::TypeMismatch);
+    REQUIRE(v.size() == 1);
+    REQUIRE(v[0].lo == 1);
+    REQUIRE(msgpackTryDeser(toBytes(encode(std::vector<Bounds>{{3, 4}})), v));
+    REQUIRE(v[0].lo == 3);
+
+    auto u = Unusable{};
+    const auto ru = msgpackTryDeser(toBytes(encode(Unusable{1})), u);
+    REQUIRE(ru.error().code() == msgpack::Errc::TypeMismatch);
+  }
+
+  SECTION("Checked types decode in place")
+  {
+    auto o = Order{};
+    REQUIRE(msgpackTryDeser(toBytes(bytes), o));
+    const auto *items = o.items.data();
+    const auto *tags = o.items[1].tags.data();
+    REQUIRE(msgpackTryDeser(toBytes(bytes), o));
+    REQUIRE(o.items.data() == items);
+    REQUIRE(o.items[1].tags.data() == tags);
+  }
+
+  SECTION("Hostile input")
+  {
+    // fixed-width fields and lengths running past the end
+    for (const auto &s :
+         {"\xcd\x01"s, "\xdb\x00\x00"s, "\xdd\xff\xff\xff\xff"s, "\xdf\x00\x00\x00\x02\x01"s})
+    {
+      REQUIRE(msgpack::tryParse(toBytes(s)).error().code() == msgpack::Errc::UnexpectedEof);
+      REQUIRE_THROWS_AS(msgpack::Blob{toBytes(s)}, msgpack::ParsingError);
+    }
+
+    auto deep = std::string(1000, '\x91') + '\x01';
+    REQUIRE(msgpack::tryParse(toBytes(deep)).error().code() == msgpack::Errc::TooDeep);
+    auto nested = std::vector<std::vector<int>>{};
+    REQUIRE(msgpackTryDeser(toBytes(deep), nested).error().code() ==
+            msgpack::Errc::TypeMismatch);
+    REQUIRE(msgpackTryDeser(toBytes(deep), nested).error().pathString() == "$[0][0]");
+  }
+}
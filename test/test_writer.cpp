@@ -0,0 +1,148 @@
+#include "../msgpack-hash.hpp"
+#include "../msgpack-writer.hpp"
+#include "helpers.hpp"
+#include <catch2/catch.hpp>
+#include <ranges>
+#include <ser/macro.hpp>
+#include <sstream>
+
+struct Row
+{
+  SER_PROPS(id, label)
+  int id;
+  std::string label;
+};
+
+namespace
+{
+  class PipeBuf final : public std::stringbuf
+  {
+  protected:
+    auto seekoff(off_type, std::ios_base::seekdir, std::ios_base::openmode) -> pos_type final
+    {
+      return pos_type(-1);
+    }
+    auto seekpos(pos_type, std::ios_base::openmode) -> pos_type final { return pos_type(-1); }
+  };
+
+  auto rows(int n)
+  {
+    return std::views::iota(0, n) | std::views::filter([](int i) { return i % 3 != 0; }) |
+           std::views::transform([](int i) { return Row{i, "r" + std::to_string(i)}; });
+  }
+} // namespace
+
+using namespace std::string_literals;
+
+TEST_CASE("Streaming writer", "[msgpack-writer]")
+{
+  SECTION("Known counts")
+  {
+    auto ss = std::ostringstream{};
+    auto w = msgpack::Writer{ss};
+    w.beginMap(2).value("a").beginArray(2).value(1).value(Row{2, "x"}).end();
+    w.value("b").value(std::vector<int>{3}).end();
+    auto ref = std::ostringstream{};
+    InternalMsgPack::msgpackSerMapHeader(ref, 2);
+    msgpackSer(ref, "a");
+    msgpackSer(ref, std::make_tuple(1, Row{2, "x"}));
+    msgpackSer(ref, "b");
+    msgpackSer(ref, std::vector<int>{3});
+    REQUIRE(ss.str() == ref.str());
+
+    w.beginArray(2).value(1);
+    REQUIRE_THROWS_AS(w.end(), std::logic_error);
+    w.beginMap(1).value(1);
+    REQUIRE_THROWS_AS(w.end(), std::logic_error);
+  }
+
+  SECTION("Unknown counts are back-patched")
+  {
+    auto ss = std::ostringstream{};
+    ss << "prefix";
+    msgpackSerRange(ss, rows(100000));
+    const auto bytes = ss.str().substr(6);
+    REQUIRE(static_cast<uint8_t>(bytes[0]) == 0xdd);
+    auto out = std::vector<Row>{};
+    msgpackDeser(msgpack::Blob{toBytes(bytes)}.val, out);
+    REQUIRE(out.size() == 66666);
+    REQUIRE(out.back().id == 99998);
+    REQUIRE(out.back().label == "r99998");
+
+    auto m = std::ostringstream{};
+    auto w = msgpack::Writer{m};
+    w.beginMap();
+    for (auto i = 0; i < 3; ++i)
+    {
+      w.value(std::to_string(i)).beginArray();
+      for (auto j = 0; j < i; ++j)
+        w.value(j);
+      w.end();
+    }
+    w.end();
+    auto parsed = std::map<std::string, std::vector<int>>{};
+    const auto str = m.str();
+    msgpackDeser(msgpack::Blob{toBytes(str)}.val, parsed);
+    REQUIRE(parsed ==
+            std::map<std::string, std::vector<int>>{{"0", {}}, {"1", {0}}, {"2", {0, 1}}});
+  }
+
+  SECTION("Unknown counts are staged for other streams")
+  {
+    auto all = rows(2000);
+    const auto expected = encode(std::vector<Row>(all.begin(), all.end()));
+
+    auto pipe = PipeBuf{};
+    auto os = std::ostream{&pipe};
+    msgpackSerRange(os, rows(2000));
+    REQUIRE(pipe.str() == expected);
+
+    auto hs = msgpack::HashStream{};
+    msgpackSerRange(hs, rows(2000));
+    auto ref = msgpack::HashStream{};
+    ref.write(expected.data(), static_cast<std::streamsize>(expected.size()));
+    REQUIRE(hs.digest() == ref.digest());
+
+    auto canonical = std::ostringstream{};
+    canonical << msgpack::canonical;
+    msgpackSerRange(canonical, rows(2000));
+    REQUIRE(canonical.str() == expected);
+  }
+
+  SECTION("Canonical streams")
+  {
+    auto ss = std::ostringstream{};
+    ss << msgpack::canonical;
+    auto w = msgpack::Writer{ss};
+    w.beginArray().beginArray().value(1).end().end();
+    REQUIRE(ss.str() == "\x91\x91\x01"s);
+
+    // map entries are sorted at every level, with or without a count
+    const auto m = std::unordered_map<std::string, std::unordered_map<int, int>>{
+      {"b", {{3, 0}, {1, 0}}}, {"a", {}}, {"c", {{2, 0}}}};
+    auto ref = std::ostringstream{};
+    ref << msgpack::canonical;
+    msgpackSer(ref, m);
+    ss.str({});
+    w.beginMap();
+    w.value("c").beginMap(1).value(2).value(0).end();
+    w.value("a").beginMap().end();
+    w.value("b").beginMap().value(3).value(0).value(1).value(0).end();
+    w.end();
+    REQUIRE(ss.str() == ref.str());
+    ss.str({});
+    msgpackSerMapRange(ss, m);
+    REQUIRE(ss.str() == ref.str());
+  }
+
+  SECTION("Map ranges")
+  {
+    const auto m = std::map<int, std::string>{{1, "one"}, {2, "two"}};
+    auto ss = std::ostringstream{};
+    msgpackSerMapRange(ss, m | std::views::filter([](const auto &) { return true; }));
+    REQUIRE(ss.str().substr(5) == encode(m).substr(1));
+    ss.str({});
+    msgpackSerMapRange(ss, m);
+    REQUIRE(ss.str() == encode(m));
+  }
+}